@@ -0,0 +1,76 @@
+#ifndef DWARFEXPR_DWARF_CALL_SITES_H
+#define DWARFEXPR_DWARF_CALL_SITES_H
+
+#include <libdwarf/dwarf.h>
+#include <libdwarf/libdwarf.h>
+
+#include <vector>
+
+#include "dwarfexpr/dwarf_expression.h"
+
+namespace dwarfexpr {
+
+// DW_TAG_call_site_parameter
+// DW_TAG_GNU_call_site_parameter
+struct DwarfCallSiteParam {
+  uint32_t reg;           // DW_AT_location of the callee, a DW_OP_reg*
+  DwarfExpression value;  // DW_AT_call_value, evaluated in the caller frame
+};
+
+// DW_TAG_call_site
+// DW_TAG_GNU_call_site
+struct DwarfCallSite {
+  Dwarf_Addr return_pc;   // DW_AT_call_return_pc, or DW_AT_low_pc of GNU
+  Dwarf_Off cu_offset;    // CU of the caller
+  Dwarf_Off func_offset;  // subprogram DIE of the caller
+  std::vector<DwarfCallSiteParam> params;
+
+  /**
+   * @brief find the parameter passed in the register of the callee
+   *
+   * @return nullptr if the caller does not describe it
+   */
+  const DwarfCallSiteParam* findParam(uint32_t reg) const;
+
+  /**
+   * @brief the value of the register at the entry of the callee, for
+   *        DW_OP_entry_value
+   *
+   * @param context the context of the caller frame
+   * @param pc the return address, the pc of the caller frame
+   */
+  bool entryValue(uint32_t reg, const DwarfExpression::Context& context,
+                  Dwarf_Addr pc, uint64_t* value) const;
+};
+
+/**
+ * @brief The call sites of a function which have parameters, sorted by
+ *        return address.
+ *
+ * The table is built once per function by a walk of its DIEs, then every
+ * DW_OP_entry_value of its callees is resolved by a binary search.
+ */
+class DwarfCallSiteTable {
+ public:
+  DwarfCallSiteTable() {}
+  ~DwarfCallSiteTable() {}
+
+  /**
+   * @brief collect the call sites of the subprogram, including the ones of
+   *        its inlined subroutines and lexical blocks
+   */
+  bool load(Dwarf_Debug dbg, Dwarf_Off cu_offset, Dwarf_Die func_die,
+            Dwarf_Error* errp);
+
+  const DwarfCallSite* find(Dwarf_Addr return_pc) const;
+
+  std::size_t size() const { return sites_.size(); }
+  std::size_t memoryUsage() const;
+
+ private:
+  std::vector<DwarfCallSite> sites_;
+};  // class DwarfCallSiteTable
+
+}  // namespace dwarfexpr
+
+#endif  // DWARFEXPR_DWARF_CALL_SITES_H
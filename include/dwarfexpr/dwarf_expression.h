@@ -6,12 +6,15 @@
 #include <libdwarf/dwarf.h>
 #include <libdwarf/libdwarf.h>
 
+#include <algorithm>  // std::copy
 #include <functional>
 #include <initializer_list>
 #include <stack>
 #include <string>
 #include <vector>
 
+#include "dwarfexpr/dwarf_tracer.h"
+
 namespace dwarfexpr {
 
 class DwarfLocation;  // forward declaration
@@ -24,6 +27,134 @@ struct DwarfOp {
   Dwarf_Unsigned off;  // Offset in locexpr used in OP_BRA.
 };
 
+// The base type of a typed value, see DW_TAG_base_type.
+struct DwarfBaseType {
+  uint8_t encoding;  // DW_ATE_*, 0 for the generic type
+  uint8_t size;      // in bytes, at most 16
+};
+
+/**
+ * @brief A value of the stack, of the generic type or of a base type.
+ *
+ * The generic type is an integer of the size of an address. A typed integer
+ * is sign or zero extended to 64 bits, so the arithmetic ops, which work on
+ * the low 64 bits and give generic values, see it as an integer.
+ */
+struct DwarfStackValue {
+  Dwarf_Signed value;  // the low 64 bits
+  uint64_t high;       // the high 64 bits of a 16-byte type
+  DwarfBaseType type;  // all 0 for the generic type
+};
+
+/**
+ * @brief The stack of a DWARF expression evaluation.
+ *
+ * The values are stored inline up to `kInlineSize`, only the pathological
+ * expressions spill to the heap. The entries are indexed from the top.
+ */
+class DwarfStack {
+ public:
+  static const size_t kInlineSize = 16;
+
+  DwarfStack() : data_(inline_), size_(0), capacity_(kInlineSize) {}
+  ~DwarfStack() {
+    if (data_ != inline_) {
+      delete[] data_;
+    }
+  }
+
+  DwarfStack(const DwarfStack&) = delete;
+  DwarfStack& operator=(const DwarfStack&) = delete;
+
+  // Push a value of the generic type.
+  void push(Dwarf_Signed value) { push(DwarfStackValue{value, 0, {0, 0}}); }
+  void push(DwarfStackValue value) {
+    if (size_ == capacity_) {
+      grow();
+    }
+    data_[size_++] = value;
+  }
+  void pop() {
+    assert(size_ > 0);
+    --size_;
+  }
+  Dwarf_Signed& top() { return at(0); }
+  // The low 64 bits of the `index`th entry below the top.
+  Dwarf_Signed& at(size_t index) { return entry(index).value; }
+  // The `index`th entry below the top, with its type.
+  DwarfStackValue& entry(size_t index) {
+    assert(index < size_);
+    return data_[size_ - 1 - index];
+  }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  void grow() {
+    DwarfStackValue* data = new DwarfStackValue[capacity_ * 2];
+    std::copy(data_, data_ + size_, data);
+    if (data_ != inline_) {
+      delete[] data_;
+    }
+    data_ = data;
+    capacity_ *= 2;
+  }
+
+  DwarfStackValue inline_[kInlineSize];
+  DwarfStackValue* data_;
+  size_t size_;
+  size_t capacity_;
+};  // class DwarfStack
+
+// A piece of a composite location, see DW_OP_piece and DW_OP_bit_piece.
+struct DwarfPiece {
+  enum class Kind : uint8_t {
+    kEmpty = 0,  // optimized out
+    kRegister,   // in `reg`
+    kMemory,     // at the address `value`
+    kValue,      // DW_OP_stack_value or DW_OP_implicit_value: `value`
+  };
+
+  Kind kind;
+  uint32_t reg;
+  Dwarf_Unsigned size_bits;
+  Dwarf_Unsigned offset_bits;  // of the piece in its location
+  Dwarf_Unsigned value;
+};
+
+/**
+ * @brief The pieces of a composite location.
+ *
+ * The first `kInlineSize` pieces are stored inline, which covers the
+ * variables split in a few registers without allocating.
+ */
+class DwarfPieces {
+ public:
+  static const size_t kInlineSize = 4;
+
+  DwarfPieces() : size_(0) {}
+
+  void push_back(const DwarfPiece& piece) {
+    if (size_ < kInlineSize) {
+      inline_[size_] = piece;
+    } else {
+      more_.push_back(piece);
+    }
+    ++size_;
+  }
+  const DwarfPiece& operator[](size_t index) const {
+    assert(index < size_);
+    return index < kInlineSize ? inline_[index] : more_[index - kInlineSize];
+  }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  DwarfPiece inline_[kInlineSize];
+  std::vector<DwarfPiece> more_;
+  size_t size_;
+};  // class DwarfPieces
+
 /**
  * @brief DWARF expression.
  * @see https://dwarfstd.org/doc/040408.1.html
@@ -33,6 +164,11 @@ class DwarfExpression {
   using RegisterProvider = std::function<bool(int, uint64_t*)>;
   using MemoryProvider = std::function<bool(uint64_t, size_t, char**, size_t*)>;
   using CfaProvider = std::function<Dwarf_Addr(Dwarf_Addr)>;
+  // The value of a register at the entry of the function, for
+  // DW_OP_entry_value, e.g. from the call site in the caller.
+  using EntryValueProvider = std::function<bool(uint32_t, uint64_t*)>;
+  // The base type DIE at an offset in the CU, for the typed ops.
+  using BaseTypeProvider = std::function<bool(Dwarf_Off, DwarfBaseType*)>;
 
   enum class ErrorCode {
     kNone = 0,
@@ -46,37 +182,57 @@ class DwarfExpression {
     kCfaInvalid,
     kNotImplemented,
     kAddressInvalid,
+    kEntryValueInvalid,
+    kTypeInvalid,
     kUnknown = 255
   };
 
   struct Result {
-    enum class Type { kInvalid = 0, kAddress, kValue };
+    enum class Type { kInvalid = 0, kAddress, kValue, kComposite };
 
     Type type;
     Dwarf_Addr value;
+    uint64_t value_high;  // the high 64 bits of a 16-byte typed kValue
 
     ErrorCode error_code;
     uint64_t error_addr;
 
+    DwarfPieces pieces;  // of kComposite
+
     static Result Error(ErrorCode err_code, uint64_t err_addr) {
       return Result{.type = Type::kInvalid,
                     .value = 0,
+                    .value_high = 0,
                     .error_code = err_code,
-                    .error_addr = err_addr};
+                    .error_addr = err_addr,
+                    .pieces = {}};
     }
 
-    static Result Value(Dwarf_Addr value) {
+    static Result Value(Dwarf_Addr value, uint64_t value_high = 0) {
       return Result{.type = Type::kValue,
                     .value = value,
+                    .value_high = value_high,
                     .error_code = ErrorCode::kNone,
-                    .error_addr = 0};
+                    .error_addr = 0,
+                    .pieces = {}};
     }
 
     static Result Address(Dwarf_Addr address) {
       return Result{.type = Type::kAddress,
                     .value = address,
+                    .value_high = 0,
                     .error_code = ErrorCode::kNone,
-                    .error_addr = 0};
+                    .error_addr = 0,
+                    .pieces = {}};
+    }
+
+    static Result Composite() {
+      return Result{.type = Type::kComposite,
+                    .value = 0,
+                    .value_high = 0,
+                    .error_code = ErrorCode::kNone,
+                    .error_addr = 0,
+                    .pieces = {}};
     }
 
     bool valid() const {
@@ -90,34 +246,74 @@ class DwarfExpression {
     DwarfLocation* frameBaseLoc;  // for DW_OP_fbreg
     RegisterProvider registers;
     MemoryProvider memory;
-    CfaProvider cfa;  // for DW_OP_call_frame_cfa
+    CfaProvider cfa;                // for DW_OP_call_frame_cfa
+    DwarfTracer* tracer;            // nullptr for no tracing
+    EntryValueProvider entryValue;  // for DW_OP_entry_value
+    BaseTypeProvider baseType;      // for the typed ops, e.g. DW_OP_convert
   };
 
   DwarfExpression() {}
   ~DwarfExpression() {}
 
-  void addOp(DwarfOp&& op) { ops_.emplace_back(op); }
+  void addOp(DwarfOp&& op) {
+    ops_.emplace_back(op);
+    program_.clear();
+    size_ = 0;
+  }
   void setOps(std::initializer_list<DwarfOp> ops) {
     ops_.clear();
     ops_.insert(ops_.end(), ops.begin(), ops.end());
+    program_.clear();
+    size_ = 0;
   }
   const DwarfOp& getOp(int64_t index) const {
     assert(static_cast<size_t>(index) < ops_.size());
     return ops_.at(index);
   }
-  void clear() { ops_.clear(); }
+  void clear() {
+    ops_.clear();
+    program_.clear();
+    size_ = 0;
+  }
+
+  /**
+   * @brief pre-decode the ops into the program run by evaluate()
+   *
+   * The opcodes are checked and the targets of DW_OP_skip and DW_OP_bra are
+   * resolved once here instead of in every evaluation. Changing the ops drops
+   * the program, an expression which is not compiled is compiled on each
+   * evaluation.
+   */
+  void compile();
+  bool compiled() const { return !program_.empty(); }
 
   /**
    * @brief evaluate this dwarf expression
    *
    * @param context the context of evaluate
    * @param pc the target pc address
-   * @param mystack the stack for evaluate(only for unit testing)
+   * @param mystack the stack for evaluate(only for unit testing), its values
+   *        are copied in before and out after the evaluation
    * @return Result the result of evaluate
    */
   Result evaluate(const Context& context, Dwarf_Addr pc,
                   std::stack<Dwarf_Signed>* mystack = nullptr) const;
 
+  /**
+   * @brief evaluate this dwarf expression with concrete providers
+   *
+   * The providers are called like the ones of the context, which is only
+   * used for its frame base and CU range. Defined in
+   * dwarf_expression_eval.h, the `std::function` providers of the context
+   * are one instantiation.
+   *
+   * @param stack the stack for evaluate, a local one if nullptr
+   */
+  template <typename Regs, typename Mem, typename Cfa>
+  Result evaluate(const Context& context, const Regs& registers,
+                  const Mem& memory, const Cfa& cfa, Dwarf_Addr pc,
+                  DwarfStack* stack = nullptr) const;
+
   void dump() const;
   std::size_t count() const { return ops_.size(); }
 
@@ -125,17 +321,26 @@ class DwarfExpression {
                                   Dwarf_Unsigned idx, DwarfExpression* expr,
                                   Dwarf_Addr* lowAddr, Dwarf_Addr* highAddr);
 
-  template <typename T>
-  static T readMemory(MemoryProvider memory, uint64_t addr, T def_val) {
+  /**
+   * @brief decode and compile the expression bytes in place, without libdwarf
+   *
+   * The bytes are a DW_FORM_exprloc or a CFI block, little endian. The block
+   * operands of DW_OP_implicit_value, DW_OP_entry_value and DW_OP_const_type
+   * point into `data`, like the ones of libdwarf.
+   *
+   * @return false if the bytes are truncated or have an op of unknown size,
+   *         the caller can fall back to `loadExprFromLoclist()`
+   */
+  static bool decode(const void* data, Dwarf_Unsigned size,
+                     Dwarf_Half addr_size, Dwarf_Half offset_size,
+                     Dwarf_Half version, DwarfExpression* expr);
+
+  // `def_val` if the value can not be read, the caller reports the error.
+  template <typename T, typename Mem = MemoryProvider>
+  static T readMemory(const Mem& memory, uint64_t addr, T def_val) {
     char* buf = nullptr;
     size_t out_size = 0;
-    if (!memory(addr, sizeof(T), &buf, &out_size)) {
-      printf("Error: can not read memory at addr 0x%" PRIx64 "\n", addr);
-      return def_val;
-    }
-    if (sizeof(T) != out_size) {
-      printf("Error: expect size: %zu, actual size: %zu\n", sizeof(T),
-             out_size);
+    if (!memory(addr, sizeof(T), &buf, &out_size) || sizeof(T) != out_size) {
       return def_val;
     }
 
@@ -148,9 +353,35 @@ class DwarfExpression {
   int64_t findOpIndexByOffset(Dwarf_Unsigned off) const;
 
  private:
+  // A pre-decoded op of the compiled program.
+  struct Insn {
+    uint8_t handler;  // index of the handler in the dispatch table
+    Dwarf_Small opcode;
+    uint16_t size;  // bytes of the operand of a typed op
+    uint32_t arg;   // register number, op index of the branch target, or
+                    // offset of the base type of a typed op
+    Dwarf_Unsigned value;  // constant or offset
+    Dwarf_Unsigned off;
+  };
+  using Program = std::vector<Insn>;
+
+  static void compileOps(const std::vector<DwarfOp>& ops, Dwarf_Unsigned size,
+                         Program* program);
+  template <typename Regs, typename Mem, typename Cfa>
+  Result run(const Program& program, const Context& context,
+             const Regs& registers, const Mem& memory, const Cfa& cfa,
+             Dwarf_Addr pc, DwarfStack* stack) const;
+
   std::vector<DwarfOp> ops_;
+  Program program_;          // empty if not compiled
+  Dwarf_Unsigned size_ = 0;  // bytes of the decoded ops, 0 if unknown
 };
 
+extern template DwarfExpression::Result DwarfExpression::evaluate(
+    const Context& context, const RegisterProvider& registers,
+    const MemoryProvider& memory, const CfaProvider& cfa, Dwarf_Addr pc,
+    DwarfStack* stack) const;
+
 }  // namespace dwarfexpr
 
 #endif  // DWARFEXPR_DWARF_EXPRESSION_H
@@ -0,0 +1,932 @@
+#ifndef DWARFEXPR_DWARF_EXPRESSION_EVAL_H
+#define DWARFEXPR_DWARF_EXPRESSION_EVAL_H
+
+// The interpreter of the compiled DWARF expressions, templated on the
+// register, memory and CFA providers. Include it to evaluate with concrete
+// provider types, whose calls can be inlined, instead of `std::function`.
+// The frame base of DW_OP_fbreg is evaluated with the same providers.
+
+#include <inttypes.h>
+#include <libdwarf/dwarf.h>
+#include <libdwarf/libdwarf.h>
+
+#include <algorithm>  // std::min
+#include <cstdlib>    // abs
+#include <cstring>    // memcpy
+#include <functional>
+#include <limits>
+#include <utility>  // std::swap
+
+#include "dwarfexpr/dwarf_expression.h"
+#include "dwarfexpr/dwarf_location.h"
+#include "dwarfexpr/dwarf_utils.h"
+
+namespace dwarfexpr {
+
+namespace internal {
+
+// The handlers of the compiled program, in the order of the dispatch table.
+#define DWARFEXPR_HANDLERS(X)                                                \
+  X(Push) X(Reg) X(Fbreg) X(Breg) X(Dup) X(Drop) X(Pick) X(Over) X(Swap)     \
+  X(Rot) X(Deref) X(DerefSize) X(CallFrameCfa) X(Abs) X(Neg) X(Not)          \
+  X(PlusUconst) X(And) X(Div) X(Minus) X(Mod) X(Mul) X(Or) X(Plus) X(Shl)    \
+  X(Shr) X(Shra) X(Xor) X(Le) X(Ge) X(Eq) X(Lt) X(Gt) X(Ne) X(Skip) X(Bra)   \
+  X(Nop) X(StackValue) X(ImplicitValue) X(Piece) X(BitPiece) X(EntryValue)   \
+  X(ConstType) X(RegvalType) X(DerefType) X(Convert) X(Reinterpret)         \
+  X(NotImplemented) X(IllegalOp) X(End)
+
+enum Handler : uint8_t {
+#define DWARFEXPR_HANDLER_ENUM(name) k##name,
+  DWARFEXPR_HANDLERS(DWARFEXPR_HANDLER_ENUM)
+#undef DWARFEXPR_HANDLER_ENUM
+};
+
+// The branch target is not the offset of an op.
+const uint32_t kNoTarget = std::numeric_limits<uint32_t>::max();
+
+// Only a `std::function` provider can be missing.
+template <typename T>
+bool isNull(const T&) {
+  return false;
+}
+
+template <typename R, typename... Args>
+bool isNull(const std::function<R(Args...)>& provider) {
+  return provider == nullptr;
+}
+
+inline size_t sizeOf(DwarfBaseType type) {
+  return type.size == 0 ? sizeof(Dwarf_Signed) : type.size;
+}
+
+inline bool isFloat(DwarfBaseType type) {
+  return type.encoding == DW_ATE_float;
+}
+
+// The generic type has an unspecified signedness, it converts as signed.
+inline bool isSigned(DwarfBaseType type) {
+  return type.size == 0 || type.encoding == DW_ATE_signed ||
+         type.encoding == DW_ATE_signed_char;
+}
+
+// The binary ops require the operands of the same type.
+inline bool sameType(DwarfBaseType a, DwarfBaseType b) {
+  return a.encoding == b.encoding && a.size == b.size;
+}
+
+// Sign or zero extend a typed value of less than 8 bytes to 64 bits, the
+// floats are zero extended.
+inline DwarfStackValue extend(DwarfStackValue v) {
+  if (v.type.size == 0 || v.type.size >= sizeof(Dwarf_Signed)) {
+    return v;
+  }
+  uint64_t mask = (uint64_t(1) << (v.type.size * 8)) - 1;
+  uint64_t bits = static_cast<uint64_t>(v.value) & mask;
+  if (isSigned(v.type) && !isFloat(v.type) && (bits & ~(mask >> 1)) != 0) {
+    bits |= ~mask;
+  }
+  v.value = static_cast<Dwarf_Signed>(bits);
+  v.high = 0;
+  return v;
+}
+
+// Read a little endian value of the type.
+inline DwarfStackValue readTyped(const uint8_t* bytes, DwarfBaseType type) {
+  uint64_t parts[2] = {0, 0};
+  for (size_t i = 0; i < type.size; ++i) {
+    parts[i / 8] |= static_cast<uint64_t>(bytes[i]) << (i % 8 * 8);
+  }
+  return extend(
+      DwarfStackValue{static_cast<Dwarf_Signed>(parts[0]), parts[1], type});
+}
+
+// Convert the value to the type, between the integers and the floats of 4
+// or 8 bytes. False if the value does not fit.
+inline bool convertTyped(const DwarfStackValue& from, DwarfBaseType to,
+                         DwarfStackValue* out) {
+  DwarfStackValue v = {0, 0, to};
+  double real = 0;
+  if (isFloat(from.type)) {
+    if (from.type.size == sizeof(float)) {
+      uint32_t bits = static_cast<uint32_t>(from.value);
+      float f = 0;
+      memcpy(&f, &bits, sizeof(f));
+      real = f;
+    } else if (from.type.size == sizeof(double)) {
+      memcpy(&real, &from.value, sizeof(real));
+    } else {
+      return false;
+    }
+  } else if (isFloat(to)) {
+    real = isSigned(from.type)
+               ? static_cast<double>(from.value)
+               : static_cast<double>(static_cast<uint64_t>(from.value));
+  }
+
+  if (isFloat(to)) {
+    if (to.size == sizeof(float)) {
+      float f = static_cast<float>(real);
+      uint32_t bits = 0;
+      memcpy(&bits, &f, sizeof(bits));
+      v.value = bits;
+    } else if (to.size == sizeof(double)) {
+      memcpy(&v.value, &real, sizeof(real));
+    } else {
+      return false;
+    }
+  } else if (isFloat(from.type)) {
+    // 2^63 and 2^64, the first values out of the integers.
+    const double kSignedEnd = 9223372036854775808.0;
+    const double kUnsignedEnd = 18446744073709551616.0;
+    if (isSigned(to) && real >= -kSignedEnd && real < kSignedEnd) {
+      v.value = static_cast<Dwarf_Signed>(real);
+    } else if (!isSigned(to) && real > -1.0 && real < kUnsignedEnd) {
+      v.value = static_cast<Dwarf_Signed>(static_cast<uint64_t>(real));
+    } else {
+      return false;
+    }
+    v.high = to.size == 16 && v.value < 0 ? ~uint64_t(0) : 0;
+  } else {
+    v.value = from.value;
+    if (to.size == 16 && from.type.size == 16) {
+      v.high = from.high;
+    } else if (to.size == 16 && isSigned(from.type) && from.value < 0) {
+      v.high = ~uint64_t(0);
+    }
+  }
+  *out = extend(v);
+  return true;
+}
+
+}  // namespace internal
+
+template <typename Regs, typename Mem, typename Cfa>
+DwarfExpression::Result DwarfExpression::evaluate(
+    const Context& context, const Regs& registers, const Mem& memory,
+    const Cfa& cfa, Dwarf_Addr pc, DwarfStack* stack) const {
+  if (count() < 1) {
+    return Result::Error(ErrorCode::kIllegalState, 0);
+  }
+
+  DwarfStack local_stack;
+  if (stack == nullptr) {
+    stack = &local_stack;
+  }
+
+  if (compiled()) {
+    return run(program_, context, registers, memory, cfa, pc, stack);
+  }
+  Program program;
+  compileOps(ops_, size_, &program);
+  return run(program, context, registers, memory, cfa, pc, stack);
+}
+
+// Direct threading with the computed goto of GCC and Clang: every handler
+// jumps straight to the next one, instead of going back to one switch.
+#if defined(__GNUC__) && !defined(DWARFEXPR_NO_THREADED_DISPATCH)
+#define DWARFEXPR_THREADED_DISPATCH
+#endif
+
+template <typename Regs, typename Mem, typename Cfa>
+DwarfExpression::Result DwarfExpression::run(
+    const Program& program, const Context& context, const Regs& registers,
+    const Mem& memory, const Cfa& cfa, Dwarf_Addr pc, DwarfStack* stack) const {
+  const Insn* insn = program.data();
+
+  // The pieces of a composite location, and the location of the next piece:
+  // kMemory if it is the address at the top of the stack.
+  Result composite = Result::Composite();
+  DwarfPiece location = {};
+  location.kind = DwarfPiece::Kind::kMemory;
+  size_t piece_depth = stack->size();
+
+#ifdef DWARFEXPR_THREADED_DISPATCH
+  static const void* const kDispatchTable[] = {
+#define DWARFEXPR_HANDLER_LABEL(name) &&do_##name,
+      DWARFEXPR_HANDLERS(DWARFEXPR_HANDLER_LABEL)
+#undef DWARFEXPR_HANDLER_LABEL
+  };
+#define HANDLER(name)     \
+  case internal::k##name: \
+  do_##name:
+#define DISPATCH() goto* kDispatchTable[insn->handler]
+#else
+#define HANDLER(name) case internal::k##name:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT() \
+  ++insn;      \
+  DISPATCH()
+#define RETURN_ERROR(code) return Result::Error(ErrorCode::code, insn->off)
+#define RETURN_MEMORY_ERROR(addr, size)                                     \
+  if (DWARFEXPR_TRACING(context.tracer)) {                                  \
+    context.tracer->onEvent(DwarfTraceEvent::MemoryInvalid(pc, addr, size)); \
+  }                                                                         \
+  RETURN_ERROR(kMemoryInvalid)
+#define REQUIRE_STACK(n)              \
+  if (stack->size() < (n)) {          \
+    RETURN_ERROR(kStackIndexInvalid); \
+  }
+#define RESOLVE_TYPE(offset, type)                                          \
+  DwarfBaseType type = {0, 0};                                              \
+  if ((offset) != 0 &&                                                      \
+      (context.baseType == nullptr || !context.baseType((offset), &type) || \
+       type.size > 16)) {                                                   \
+    RETURN_ERROR(kTypeInvalid);                                             \
+  }
+#define PIECE_FOLLOWS()                       \
+  ((insn + 1)->handler == internal::kPiece || \
+   (insn + 1)->handler == internal::kBitPiece)
+// The arithmetic is on the integers of at most 64 bits only.
+#define REQUIRE_INTEGERS(n)                                              \
+  for (size_t i = 0; i < (n); ++i) {                                     \
+    if (internal::isFloat(stack->entry(i).type) ||                       \
+        internal::sizeOf(stack->entry(i).type) > sizeof(Dwarf_Signed)) { \
+      RETURN_ERROR(kNotImplemented);                                     \
+    }                                                                    \
+  }
+// Pops the operands of a binary op of the same integer type, e1 is the top
+// and e2 the one below.
+#define POP2()                                                           \
+  REQUIRE_STACK(2);                                                      \
+  if (!internal::sameType(stack->entry(0).type, stack->entry(1).type)) { \
+    RETURN_ERROR(kTypeInvalid);                                          \
+  }                                                                      \
+  REQUIRE_INTEGERS(1);                                                   \
+  const DwarfStackValue v1 = stack->entry(0);                            \
+  stack->pop();                                                          \
+  const DwarfStackValue v2 = stack->entry(0);                            \
+  stack->pop();                                                          \
+  const Dwarf_Signed e1 = v1.value;                                      \
+  const Dwarf_Signed e2 = v2.value
+// Pushes the result of an arithmetic op with the type of its operands.
+#define PUSH_TYPED(type, result) \
+  stack->push(internal::extend(  \
+      DwarfStackValue{static_cast<Dwarf_Signed>(result), 0, (type)}))
+
+#ifndef DWARFEXPR_THREADED_DISPATCH
+dispatch:
+#endif
+  switch (insn->handler) {
+    //
+    // Literal Encodings.
+    // Push a value onto the DWARF stack.
+    //
+
+    // Literals, addresses and constants, signed and unsigned together.
+    HANDLER(Push) {
+      stack->push(insn->value);
+      NEXT();
+    }
+
+    //
+    // Register Locations.
+    // The object is in the register, the expression ends here unless it is a
+    // piece.
+    //
+
+    HANDLER(Reg) {
+      if (PIECE_FOLLOWS()) {
+        location.kind = DwarfPiece::Kind::kRegister;
+        location.reg = insn->arg;
+        NEXT();
+      }
+      if (internal::isNull(registers)) {
+        RETURN_ERROR(kRegisterInvalid);
+      }
+      uint64_t reg_val = 0;
+      if (!registers(insn->arg, &reg_val)) {
+        RETURN_ERROR(kRegisterInvalid);
+      }
+      if (DWARFEXPR_TRACING(context.tracer)) {
+        context.tracer->onEvent(
+            DwarfTraceEvent::Register(pc, insn->opcode, insn->arg, reg_val));
+      }
+      stack->push(reg_val);
+      return Result::Value(reg_val);
+    }
+
+    //
+    // Register Based Addressing.
+    // Pushed value is result of adding the contents of a register
+    // with a given signed offset.
+    //
+
+    // Frame base plus signed first operand.
+    HANDLER(Fbreg) {
+      if (context.frameBaseLoc == nullptr) {
+        RETURN_ERROR(kFrameBaseInvalid);
+      }
+
+      Result frameBase =
+          context.frameBaseLoc->evalValue(context, registers, memory, cfa, pc);
+      if (!frameBase.valid()) {
+        RETURN_ERROR(kFrameBaseInvalid);
+      }
+      stack->push(frameBase.value + insn->value);
+      NEXT();
+    }
+
+    // Content of register (address) plus signed first operand.
+    HANDLER(Breg) {
+      if (internal::isNull(registers)) {
+        RETURN_ERROR(kRegisterInvalid);
+      }
+      uint64_t reg_val = 0;
+      if (!registers(insn->arg, &reg_val)) {
+        RETURN_ERROR(kRegisterInvalid);
+      }
+      if (DWARFEXPR_TRACING(context.tracer)) {
+        context.tracer->onEvent(DwarfTraceEvent::RegisterOffset(
+            pc, insn->opcode, insn->arg, insn->value, reg_val + insn->value));
+      }
+      stack->push(reg_val + insn->value);
+      NEXT();
+    }
+
+    //
+    // Stack Operations.
+    // Operations manipulate the DWARF stack.
+    //
+
+    // Duplicates the value at the top of the stack.
+    HANDLER(Dup) {
+      REQUIRE_STACK(1);
+      stack->push(stack->entry(0));
+      NEXT();
+    }
+
+    // Pops the value at the top of the stack
+    HANDLER(Drop) {
+      REQUIRE_STACK(1);
+      stack->pop();
+      NEXT();
+    }
+
+    // Entry with specified index is copied at the top.
+    HANDLER(Pick) {
+      Dwarf_Unsigned idx = insn->value;
+      if (stack->size() <= idx) {
+        RETURN_ERROR(kStackIndexInvalid);
+      }
+      stack->push(stack->entry(idx));
+      NEXT();
+    }
+
+    // Duplicates the second entry to the top of the stack.
+    HANDLER(Over) {
+      REQUIRE_STACK(2);
+      stack->push(stack->entry(1));
+      NEXT();
+    }
+
+    // Swaps the top two stack entries.
+    HANDLER(Swap) {
+      REQUIRE_STACK(2);
+      std::swap(stack->entry(0), stack->entry(1));
+      NEXT();
+    }
+
+    // Rotates the first three stack entries
+    HANDLER(Rot) {
+      REQUIRE_STACK(3);
+
+      DwarfStackValue e1 = stack->entry(0);
+      stack->entry(0) = stack->entry(1);
+      stack->entry(1) = stack->entry(2);
+      stack->entry(2) = e1;
+      NEXT();
+    }
+
+    // Pops the top stack entry and treats it as an address.
+    // The value retrieved from that address is pushed.
+    HANDLER(Deref) {
+      if (internal::isNull(memory)) {
+        RETURN_ERROR(kMemoryInvalid);
+      }
+      REQUIRE_STACK(1);
+
+      Dwarf_Addr adr = stack->top();
+      stack->pop();
+
+      Dwarf_Signed defref_val =
+          readMemory<Dwarf_Signed>(memory, adr, MAX_DWARF_SIGNED);
+      if (defref_val == MAX_DWARF_SIGNED) {
+        RETURN_MEMORY_ERROR(adr, sizeof(Dwarf_Signed));
+      }
+
+      stack->push(defref_val);
+      NEXT();
+    }
+
+    // Like DW_OP_deref, but the size in bytes of the data retrieved is
+    // specified by the single operand, and the data is zero extended to the
+    // size of an address before being pushed.
+    HANDLER(DerefSize) {
+      if (internal::isNull(memory)) {
+        RETURN_ERROR(kMemoryInvalid);
+      }
+      REQUIRE_STACK(1);
+
+      Dwarf_Unsigned size = insn->value;
+      if (size > sizeof(Dwarf_Signed) || size == 0) {
+        RETURN_ERROR(kIllegalOpd);
+      }
+
+      Dwarf_Addr adr = stack->top();
+      stack->pop();
+
+      char* buf = nullptr;
+      size_t buf_size = 0;
+      if (!memory(adr, size, &buf, &buf_size)) {
+        RETURN_MEMORY_ERROR(adr, size);
+      }
+
+      Dwarf_Signed deref_val = 0;
+      char* defref_val_ptr = reinterpret_cast<char*>(&deref_val);
+      for (size_t i = 0; i < sizeof(Dwarf_Signed); i++) {
+        *(defref_val_ptr + i) = i < buf_size ? buf[i] : 0;
+      }
+      stack->push(deref_val);
+      NEXT();
+    }
+
+    // The DW_OP_call_frame_cfa operation pushes the value of the CFA,
+    // obtained from the Call Frame Information (see Section 6.4).
+    HANDLER(CallFrameCfa) {
+      if (internal::isNull(cfa)) {
+        RETURN_ERROR(kCfaInvalid);
+      }
+      stack->push(cfa(pc));
+      NEXT();
+    }
+
+    //
+    // Arithmetic and Logical Operations.
+    // The arithmetic operations perform addressing arithmetic, that is,
+    // unsigned arithmetic that wraps on an address-sized boundary.
+    //
+
+    // Replace top with it's absolute value.
+    HANDLER(Abs) {
+      REQUIRE_STACK(1);
+      REQUIRE_INTEGERS(1);
+      const DwarfBaseType type = stack->entry(0).type;
+      Dwarf_Signed top = stack->top();
+      stack->pop();
+      PUSH_TYPED(type, internal::isSigned(type) ? std::abs(top) : top);
+      NEXT();
+    }
+
+    // Negate top.
+    HANDLER(Neg) {
+      REQUIRE_STACK(1);
+      REQUIRE_INTEGERS(1);
+      const DwarfBaseType type = stack->entry(0).type;
+      Dwarf_Signed top = stack->top();
+      stack->pop();
+      PUSH_TYPED(type, -static_cast<Dwarf_Unsigned>(top));
+      NEXT();
+    }
+
+    // Bitwise complement of the top.
+    HANDLER(Not) {
+      REQUIRE_STACK(1);
+      REQUIRE_INTEGERS(1);
+      const DwarfBaseType type = stack->entry(0).type;
+      Dwarf_Signed top = stack->top();
+      stack->pop();
+      PUSH_TYPED(type, ~top);
+      NEXT();
+    }
+
+    // Top value plus unsigned first operand.
+    HANDLER(PlusUconst) {
+      REQUIRE_STACK(1);
+      REQUIRE_INTEGERS(1);
+      const DwarfBaseType type = stack->entry(0).type;
+      Dwarf_Signed top = stack->top();
+      stack->pop();
+      PUSH_TYPED(type, top + insn->value);
+      NEXT();
+    }
+
+    // Bitwise and on top 2 values.
+    HANDLER(And) {
+      POP2();
+      PUSH_TYPED(v1.type, e1 & e2);
+      NEXT();
+    }
+
+    // Second div first from top, signed unless the type is unsigned.
+    HANDLER(Div) {
+      POP2();
+      if (e1 == 0) {
+        RETURN_ERROR(kIllegalState);
+      }
+      if (!internal::isSigned(v1.type)) {
+        PUSH_TYPED(v1.type, static_cast<Dwarf_Unsigned>(e2) /
+                            static_cast<Dwarf_Unsigned>(e1));
+      } else if (e1 == -1) {
+        // The minimum divided by -1 overflows, it wraps like the other ops.
+        PUSH_TYPED(v1.type, 0 - static_cast<Dwarf_Unsigned>(e2));
+      } else {
+        PUSH_TYPED(v1.type, e2 / e1);
+      }
+      NEXT();
+    }
+
+    // Second minus first from top.
+    HANDLER(Minus) {
+      POP2();
+      PUSH_TYPED(v1.type, e2 - e1);
+      NEXT();
+    }
+
+    // Second modulo first from top.
+    HANDLER(Mod) {
+      POP2();
+      if (e1 == 0) {
+        RETURN_ERROR(kIllegalState);
+      }
+      if (!internal::isSigned(v1.type)) {
+        PUSH_TYPED(v1.type, static_cast<Dwarf_Unsigned>(e2) %
+                            static_cast<Dwarf_Unsigned>(e1));
+      } else {
+        // The minimum modulo -1 overflows.
+        PUSH_TYPED(v1.type, e1 == -1 ? 0 : e2 % e1);
+      }
+      NEXT();
+    }
+
+    // Second times first from top.
+    HANDLER(Mul) {
+      POP2();
+      PUSH_TYPED(v1.type, e2 * e1);
+      NEXT();
+    }
+
+    // Bitwise or of top 2 entries.
+    HANDLER(Or) {
+      POP2();
+      PUSH_TYPED(v1.type, e2 | e1);
+      NEXT();
+    }
+
+    // Adds together top two entries.
+    HANDLER(Plus) {
+      POP2();
+      PUSH_TYPED(v1.type, e2 + e1);
+      NEXT();
+    }
+
+    // Shift second entry to left by first entry.
+    HANDLER(Shl) {
+      POP2();
+      PUSH_TYPED(v1.type, e2 << e1);
+      NEXT();
+    }
+
+    // Shift second entry logically to right by first entry.
+    HANDLER(Shr) {
+      POP2();
+      PUSH_TYPED(v1.type, static_cast<Dwarf_Unsigned>(e2) >> e1);
+      NEXT();
+    }
+
+    // Shift second entry arithmetically to right by first entry.
+    HANDLER(Shra) {
+      POP2();
+      PUSH_TYPED(v1.type, e2 >> e1);
+      NEXT();
+    }
+
+    // Bitwise XOR on top two entries.
+    HANDLER(Xor) {
+      POP2();
+      PUSH_TYPED(v1.type, e2 ^ e1);
+      NEXT();
+    }
+
+    //
+    // Control Flow Operations.
+    // The comparisons push 1 or 0 of the generic type.
+    //
+
+    HANDLER(Le) {
+      POP2();
+      stack->push(internal::isSigned(v1.type)
+                      ? e2 <= e1
+                      : static_cast<Dwarf_Unsigned>(e2) <=
+                            static_cast<Dwarf_Unsigned>(e1));
+      NEXT();
+    }
+
+    HANDLER(Ge) {
+      POP2();
+      stack->push(internal::isSigned(v1.type)
+                      ? e2 >= e1
+                      : static_cast<Dwarf_Unsigned>(e2) >=
+                            static_cast<Dwarf_Unsigned>(e1));
+      NEXT();
+    }
+
+    HANDLER(Eq) {
+      POP2();
+      stack->push(e2 == e1);
+      NEXT();
+    }
+
+    HANDLER(Lt) {
+      POP2();
+      stack->push(internal::isSigned(v1.type)
+                      ? e2 < e1
+                      : static_cast<Dwarf_Unsigned>(e2) <
+                            static_cast<Dwarf_Unsigned>(e1));
+      NEXT();
+    }
+
+    HANDLER(Gt) {
+      POP2();
+      stack->push(internal::isSigned(v1.type)
+                      ? e2 > e1
+                      : static_cast<Dwarf_Unsigned>(e2) >
+                            static_cast<Dwarf_Unsigned>(e1));
+      NEXT();
+    }
+
+    HANDLER(Ne) {
+      POP2();
+      stack->push(e2 != e1);
+      NEXT();
+    }
+
+    // Unconditional branch to the resolved target.
+    HANDLER(Skip) {
+      if (insn->arg == internal::kNoTarget) {
+        RETURN_ERROR(kIllegalOpd);
+      }
+      insn = &program[insn->arg];
+      DISPATCH();
+    }
+
+    // Pops the top entry, branch if it is not zero.
+    HANDLER(Bra) {
+      REQUIRE_STACK(1);
+      Dwarf_Signed cond = stack->top();
+      stack->pop();
+      if (cond == 0) {
+        NEXT();
+      }
+      if (insn->arg == internal::kNoTarget) {
+        RETURN_ERROR(kIllegalOpd);
+      }
+      insn = &program[insn->arg];
+      DISPATCH();
+    }
+
+    //
+    // Special Operations.
+    //
+
+    // This has no effect.
+    HANDLER(Nop) { NEXT(); }
+
+    //
+    // Object does not exist in memory but its value is known and it is at
+    // the top of the DWARF expression stack. DWARF expression represents
+    // actual value of the object, rather then its location.
+    // DW_OP_stack_alue operation terminates the expression.
+    //
+    HANDLER(StackValue) {
+      REQUIRE_STACK(1);
+      if (PIECE_FOLLOWS()) {
+        location.kind = DwarfPiece::Kind::kValue;
+        location.value = stack->top();
+        stack->pop();
+        NEXT();
+      }
+      return Result::Value(stack->top(), stack->entry(0).high);
+    }
+
+    // The value is the block of the op, at most 8 bytes.
+    HANDLER(ImplicitValue) {
+      if (PIECE_FOLLOWS()) {
+        location.kind = DwarfPiece::Kind::kValue;
+        location.value = insn->value;
+        NEXT();
+      }
+      return Result::Value(insn->value);
+    }
+
+    // The value the register had at the entry of the function, which is
+    // usually recovered from the call site parameters of the caller.
+    HANDLER(EntryValue) {
+      uint64_t value = 0;
+      if (context.entryValue == nullptr ||
+          !context.entryValue(insn->arg, &value)) {
+        RETURN_ERROR(kEntryValueInvalid);
+      }
+      stack->push(value);
+      NEXT();
+    }
+
+    //
+    // Typed Operations.
+    // The values have the base type of the DIE at the offset in the CU of
+    // the operand, the offset 0 is the generic type.
+    //
+
+    // A constant of the base type, the block of the op holds its bytes.
+    HANDLER(ConstType) {
+      RESOLVE_TYPE(insn->arg, type);
+      if (type.size != insn->size) {
+        RETURN_ERROR(kIllegalOpd);
+      }
+      stack->push(internal::readTyped(
+          reinterpret_cast<const uint8_t*>(insn->value), type));
+      NEXT();
+    }
+
+    // The content of a register as a value of the base type, the providers
+    // give the low 64 bits of the registers only.
+    HANDLER(RegvalType) {
+      RESOLVE_TYPE(insn->value, type);
+      if (internal::isNull(registers)) {
+        RETURN_ERROR(kRegisterInvalid);
+      }
+      uint64_t reg_val = 0;
+      if (!registers(insn->arg, &reg_val)) {
+        RETURN_ERROR(kRegisterInvalid);
+      }
+      stack->push(internal::extend(
+          DwarfStackValue{static_cast<Dwarf_Signed>(reg_val), 0, type}));
+      NEXT();
+    }
+
+    // Like DW_OP_deref_size, the data is a value of the base type.
+    HANDLER(DerefType) {
+      if (internal::isNull(memory)) {
+        RETURN_ERROR(kMemoryInvalid);
+      }
+      REQUIRE_STACK(1);
+      RESOLVE_TYPE(insn->arg, type);
+
+      Dwarf_Addr adr = stack->top();
+      stack->pop();
+
+      char* buf = nullptr;
+      size_t buf_size = 0;
+      if (!memory(adr, insn->size, &buf, &buf_size)) {
+        RETURN_MEMORY_ERROR(adr, insn->size);
+      }
+      uint8_t bytes[16] = {};
+      memcpy(bytes, buf, std::min<size_t>(buf_size, insn->size));
+      stack->push(internal::readTyped(bytes, type));
+      NEXT();
+    }
+
+    // Converts the top entry to the base type.
+    HANDLER(Convert) {
+      REQUIRE_STACK(1);
+      RESOLVE_TYPE(insn->arg, type);
+      if (!internal::convertTyped(stack->entry(0), type, &stack->entry(0))) {
+        RETURN_ERROR(kIllegalOpd);
+      }
+      NEXT();
+    }
+
+    // Retypes the bits of the top entry, the sizes of the types must match.
+    HANDLER(Reinterpret) {
+      REQUIRE_STACK(1);
+      RESOLVE_TYPE(insn->arg, type);
+      DwarfStackValue& top = stack->entry(0);
+      if (internal::sizeOf(top.type) != internal::sizeOf(type)) {
+        RETURN_ERROR(kIllegalOpd);
+      }
+      top.type = type;
+      top = internal::extend(top);
+      NEXT();
+    }
+
+    //
+    // Composite Location Descriptions.
+    // Each piece ends the location description before it, the location of
+    // the object is the list of the pieces.
+    //
+
+    HANDLER(Piece)
+    HANDLER(BitPiece) {
+      DwarfPiece piece = location;
+      piece.size_bits = insn->value;
+      piece.offset_bits = insn->arg;
+      if (location.kind == DwarfPiece::Kind::kMemory) {
+        if (stack->size() > piece_depth) {
+          piece.value = stack->top();
+          stack->pop();
+        } else {
+          piece.kind = DwarfPiece::Kind::kEmpty;  // no location
+        }
+      }
+      composite.pieces.push_back(piece);
+
+      location = DwarfPiece();
+      location.kind = DwarfPiece::Kind::kMemory;
+      piece_depth = stack->size();
+      NEXT();
+    }
+
+    //
+    // Invalid or unrecognized operations.
+    //
+    HANDLER(NotImplemented) {
+      if (DWARFEXPR_TRACING(context.tracer)) {
+        context.tracer->onEvent(
+            DwarfTraceEvent::NotImplemented(pc, insn->opcode));
+      }
+      RETURN_ERROR(kNotImplemented);
+    }
+
+    HANDLER(IllegalOp) { RETURN_ERROR(kIllegalOp); }
+
+    // The expression ends, the top of the stack is the address.
+    HANDLER(End) {
+      if (!composite.pieces.empty()) {
+        return composite;
+      }
+      REQUIRE_STACK(1);
+      return Result::Address(stack->top());
+    }
+
+    default:
+      RETURN_ERROR(kIllegalOp);
+  }  // switch
+
+#undef POP2
+#undef PUSH_TYPED
+#undef REQUIRE_INTEGERS
+#undef PIECE_FOLLOWS
+#undef RESOLVE_TYPE
+#undef REQUIRE_STACK
+#undef RETURN_MEMORY_ERROR
+#undef RETURN_ERROR
+#undef NEXT
+#undef DISPATCH
+#undef HANDLER
+}  // end of DwarfExpression::run
+
+// Same results as the interpreter for the single-op locations, the error
+// address is the offset 0 of the op.
+template <typename Regs, typename Mem, typename Cfa>
+DwarfExpression::Result DwarfLocation::evalValue(
+    const DwarfExpression::Context& context, const Regs& registers,
+    const Mem& memory, const Cfa& cfa, Dwarf_Addr pc) const {
+  using Result = DwarfExpression::Result;
+  using ErrorCode = DwarfExpression::ErrorCode;
+  const LocationExpression* e = findExpression(context, pc);
+  if (e == nullptr) {
+    return Result::Error(ErrorCode::kAddressInvalid, 0);
+  }
+  const SimpleLocation& simple = e->simple;
+  switch (simple.kind) {
+    case SimpleLocation::Kind::kFbreg: {
+      if (context.frameBaseLoc == nullptr) {
+        return Result::Error(ErrorCode::kFrameBaseInvalid, 0);
+      }
+      Result frameBase =
+          context.frameBaseLoc->evalValue(context, registers, memory, cfa, pc);
+      if (!frameBase.valid()) {
+        return Result::Error(ErrorCode::kFrameBaseInvalid, 0);
+      }
+      return Result::Address(frameBase.value + simple.value);
+    }
+    case SimpleLocation::Kind::kBreg:
+    case SimpleLocation::Kind::kReg: {
+      uint64_t reg_val = 0;
+      if (internal::isNull(registers) || !registers(simple.reg, &reg_val)) {
+        return Result::Error(ErrorCode::kRegisterInvalid, 0);
+      }
+      if (simple.kind == SimpleLocation::Kind::kReg) {
+        if (DWARFEXPR_TRACING(context.tracer)) {
+          context.tracer->onEvent(DwarfTraceEvent::Register(
+              pc, simple.opcode, simple.reg, reg_val));
+        }
+        return Result::Value(reg_val);
+      }
+      if (DWARFEXPR_TRACING(context.tracer)) {
+        context.tracer->onEvent(DwarfTraceEvent::RegisterOffset(
+            pc, simple.opcode, simple.reg, simple.value,
+            reg_val + simple.value));
+      }
+      return Result::Address(reg_val + simple.value);
+    }
+    case SimpleLocation::Kind::kAddr:
+      return Result::Address(simple.value);
+    default:
+      return e->expr.evaluate(context, registers, memory, cfa, pc);
+  }
+}
+
+}  // namespace dwarfexpr
+
+#endif  // DWARFEXPR_DWARF_EXPRESSION_EVAL_H
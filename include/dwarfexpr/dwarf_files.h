@@ -0,0 +1,64 @@
+#ifndef DWARFEXPR_DWARF_FILES_H
+#define DWARFEXPR_DWARF_FILES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace dwarfexpr {
+
+using DwarfFileId = uint32_t;
+constexpr DwarfFileId kDwarfNoFileId = 0xffffffff;
+
+/**
+ * @brief Source file paths interned as small ids, shared by all the CUs and
+ *        modules of the process.
+ *
+ * Thousands of CUs include the same headers, each path is stored once and the
+ * lookup results carry ids, the paths are only materialized for output.
+ * `intern()` and `path()` may be called from any thread.
+ */
+class DwarfFilePool {
+ public:
+  DwarfFilePool() {}
+  ~DwarfFilePool() {}
+
+  DwarfFilePool(const DwarfFilePool&) = delete;
+  DwarfFilePool& operator=(const DwarfFilePool&) = delete;
+
+  static DwarfFilePool* global();
+
+  DwarfFileId intern(const std::string& path);
+
+  /**
+   * @brief the path of an id, or `def_val` for kDwarfNoFileId, the reference
+   *        stays valid as long as the pool.
+   */
+  const std::string& path(DwarfFileId id, const std::string& def_val) const;
+
+  size_t size() const;
+
+ private:
+  struct PathHash {
+    size_t operator()(const std::string* path) const {
+      return std::hash<std::string>()(*path);
+    }
+  };
+  struct PathEqual {
+    bool operator()(const std::string* a, const std::string* b) const {
+      return *a == *b;
+    }
+  };
+
+  mutable std::mutex mutex_;
+  std::deque<std::string> paths_;  // by id, a deque never moves its items
+  std::unordered_map<const std::string*, DwarfFileId, PathHash, PathEqual>
+      ids_;
+};  // class DwarfFilePool
+
+}  // namespace dwarfexpr
+
+#endif  // DWARFEXPR_DWARF_FILES_H
@@ -4,6 +4,8 @@
 #include <libdwarf/dwarf.h>
 #include <libdwarf/libdwarf.h>
 
+#include <vector>
+
 #include "dwarfexpr/dwarf_expression.h"
 
 namespace dwarfexpr {
@@ -31,6 +33,36 @@ class DwarfFrames {
     Dwarf_Addr cfa;
   };
 
+  // The rule of a register (or the CFA) in a row of the CFI table, see
+  // `dwarf_get_fde_info_for_all_regs3()`.
+  struct CfiRule {
+    Dwarf_Small value_type = DW_EXPR_OFFSET;
+    Dwarf_Unsigned offset_relevant = 0;
+    Dwarf_Unsigned reg = DW_FRAME_UNDEFINED_VAL;
+    Dwarf_Signed offset = 0;
+
+    bool operator==(const CfiRule& o) const {
+      return value_type == o.value_type &&
+             offset_relevant == o.offset_relevant && reg == o.reg &&
+             offset == o.offset;
+    }
+    bool operator!=(const CfiRule& o) const { return !(*this == o); }
+  };
+
+  struct CfiRow {
+    Dwarf_Addr pc;
+    CfiRule cfa;
+    std::vector<CfiRule> regs;  // indexed by the register number
+  };
+
+  // The CFI table of a FDE.
+  struct CfiTable {
+    Dwarf_Addr low_pc;
+    Dwarf_Addr high_pc;
+    Dwarf_Half ra_reg;  // the return address register of the CIE
+    std::vector<CfiRow> rows;
+  };
+
   DwarfFrames(Dwarf_Debug dbg, Dwarf_Half addr_size, Dwarf_Half offset_size,
               Dwarf_Half version)
       : dbg_(dbg),
@@ -42,6 +74,14 @@ class DwarfFrames {
   Dwarf_Addr GetCfa(const DwarfExpression::Context& context,
                     Dwarf_Addr pc) const;
 
+  /**
+   * @brief decode the CFI tables of all the FDEs
+   *
+   * @param reg_count the rules of the registers [0, reg_count) are decoded
+   * @param tables the CFI tables sorted by low_pc
+   */
+  bool GetAllCfi(Dwarf_Half reg_count, std::vector<CfiTable>* tables) const;
+
  private:
   Dwarf_Addr GetReg(const DwarfExpression::Context& context, Dwarf_Half i,
                     Dwarf_Addr pc, const FdeInfo& info) const;
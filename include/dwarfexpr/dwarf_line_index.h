@@ -0,0 +1,71 @@
+#ifndef DWARFEXPR_DWARF_LINE_INDEX_H
+#define DWARFEXPR_DWARF_LINE_INDEX_H
+
+#include <libdwarf/dwarf.h>
+#include <libdwarf/libdwarf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dwarfexpr/dwarf_files.h"
+#include "dwarfexpr/dwarf_lines.h"
+
+namespace dwarfexpr {
+
+struct DwarfLineAddrRange {
+  Dwarf_Addr low;   // Lowest address of the range.
+  Dwarf_Addr high;  // First address past the end of the range.
+};
+
+/**
+ * @brief The reverse of the line tables: source file:line to the address
+ *        ranges of its code.
+ *
+ * Every CU is added with `addTable()`, the indexes built by several threads
+ * are combined with `merge()`, then `finalize()` sorts the ranges by
+ * (file, line, address) and joins the adjacent ones, so that a query is a
+ * single binary search.
+ */
+class DwarfLineIndex {
+ public:
+  DwarfLineIndex() {}
+  ~DwarfLineIndex() {}
+
+  void addTable(const DwarfLineTable& table);
+  void merge(DwarfLineIndex* other);
+  void finalize();
+
+  /**
+   * @brief find the address ranges of a line
+   *
+   * @return false if the line has no code
+   */
+  bool find(DwarfFileId file, uint32_t line,
+            std::vector<DwarfLineAddrRange>* out_ranges) const;
+
+  /**
+   * @brief find the indexed files whose path is `name` or ends with
+   *        `/name`, e.g. `foo.cpp` or `src/foo.cpp`
+   */
+  std::vector<DwarfFileId> findFiles(const std::string& name) const;
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    DwarfFileId file;
+    uint32_t line;
+    Dwarf_Addr low;
+    Dwarf_Addr high;
+  };
+  static bool entryLess(const Entry& a, const Entry& b);
+
+  std::vector<Entry> entries_;
+  std::vector<DwarfFileId> files_;  // sorted ids of the indexed files
+};  // class DwarfLineIndex
+
+}  // namespace dwarfexpr
+
+#endif  // DWARFEXPR_DWARF_LINE_INDEX_H
@@ -0,0 +1,135 @@
+#ifndef DWARFEXPR_DWARF_LINES_H
+#define DWARFEXPR_DWARF_LINES_H
+
+#include <libdwarf/dwarf.h>
+#include <libdwarf/libdwarf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "dwarfexpr/dwarf_files.h"
+#include "dwarfexpr/dwarf_utils.h"  // DwarfLineRow
+
+namespace dwarfexpr {
+
+enum DwarfLineFlags : uint16_t {
+  kDwarfLineIsStmt = 1 << 0,
+  kDwarfLineEndSequence = 1 << 1,  // The first address past the sequence.
+};
+
+struct DwarfLineEntry {
+  Dwarf_Addr addr;
+  DwarfFileId file;  // kDwarfNoFileId if unknown.
+  uint32_t line;
+  uint16_t column;
+  uint16_t flags;  // DwarfLineFlags
+  uint32_t discriminator;
+};
+
+struct DwarfLineSequence {
+  Dwarf_Addr low;   // Address of the first row.
+  Dwarf_Addr high;  // Address of the end_sequence row.
+  uint32_t begin;   // Index of the first block of the sequence.
+  uint32_t end;     // Index past the last block of the sequence.
+};
+
+// Rows are encoded in blocks of at most kDwarfLineBlockSize rows.
+constexpr size_t kDwarfLineBlockSize = 16;
+
+struct DwarfLineBlock {
+  Dwarf_Addr addr;  // Address of the first row.
+  uint32_t line;    // Line of the first row.
+  uint32_t offset;  // Offset of the first row in the encoded data.
+};
+
+/**
+ * @brief The line table of a CU, decoded once into a compact form.
+ *
+ * The rows are grouped by sequence and indexed by the address ranges of the
+ * sequences, so a pc is resolved with a binary search over the sequences
+ * instead of a walk over the `Dwarf_Line`s of libdwarf. Sequences may
+ * overlap, e.g. the ones of the functions discarded by the linker all start
+ * at 0.
+ *
+ * The rows of a sequence are delta encoded in small blocks, a block is found
+ * with a binary search over the sparse block index, then only its rows are
+ * decoded. A row takes 3 bytes or so instead of a whole `DwarfLineEntry`.
+ */
+class DwarfLineTable {
+ public:
+  DwarfLineTable() {}
+  ~DwarfLineTable() {}
+
+  /**
+   * @brief decode the line table of the CU
+   *
+   * @return DW_DLV_OK, DW_DLV_NO_ENTRY if the CU has no line table, or
+   *         DW_DLV_ERROR
+   */
+  int load(Dwarf_Debug dbg, Dwarf_Die cu_die, Dwarf_Error* errp);
+
+  /**
+   * @brief build the table from the rows of getLineRows()
+   */
+  void build(const std::vector<DwarfLineRow>& rows,
+             const std::vector<std::string>& files);
+
+  /**
+   * @brief find the row which covers the pc
+   *
+   * When several rows share the address, the last one which is a recommended
+   * breakpoint location (is_stmt) wins.
+   *
+   * @return false if no sequence contains the pc
+   */
+  bool find(Dwarf_Addr pc, DwarfLineEntry* out_entry) const;
+
+  // Called with every row and the end of the addresses it covers.
+  using RowVisitor =
+      std::function<void(const DwarfLineEntry& row, Dwarf_Addr end)>;
+
+  /**
+   * @brief decode all the rows, in the order of the sequences
+   */
+  void forEachRow(const RowVisitor& visitor) const;
+
+  /**
+   * @brief the id of a file number of the CU, e.g. DW_AT_decl_file
+   *
+   * @return kDwarfNoFileId if it is out of the file table
+   */
+  DwarfFileId fileId(Dwarf_Unsigned file_num) const;
+
+  const std::vector<DwarfLineSequence>& sequences() const {
+    return sequences_;
+  }
+  // The ids of the files of the CU, in the order of the line table header.
+  const std::vector<DwarfFileId>& files() const { return files_; }
+
+  size_t memoryUsage() const;
+
+ private:
+  void encodeSequence(const DwarfLineRow* rows, size_t count);
+  void startBlock(size_t block, const uint8_t** out_ptr,
+                  const uint8_t** out_end, DwarfLineEntry* out_row) const;
+  void decodeRow(const uint8_t** ptr, DwarfLineEntry* row) const;
+  bool findInSequence(const DwarfLineSequence& seq, Dwarf_Addr pc,
+                      DwarfLineEntry* out_entry) const;
+
+  std::vector<DwarfLineSequence> sequences_;  // sorted by low
+  // max_high_[i] is the max high of sequences_[0..i], it bounds the
+  // backward scan for the sequences which contain a pc.
+  std::vector<Dwarf_Addr> max_high_;
+  std::vector<DwarfLineBlock> blocks_;
+  std::vector<uint8_t> data_;  // the encoded rows of all the blocks
+  std::vector<DwarfFileId> files_;
+  // The file numbers are 1-based before DWARF5, and 0-based since DWARF5.
+  Dwarf_Unsigned file_base_ = 1;
+};  // class DwarfLineTable
+
+}  // namespace dwarfexpr
+
+#endif  // DWARFEXPR_DWARF_LINES_H
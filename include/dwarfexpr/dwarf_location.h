@@ -16,10 +16,27 @@ namespace dwarfexpr {
 // DW_AT_frame_base
 class DwarfLocation {
  public:
+  // A location of a single common op, evaluated without the interpreter.
+  struct SimpleLocation {
+    enum class Kind : uint8_t {
+      kNone = 0,  // not simple, evaluate the expression
+      kFbreg,     // DW_OP_fbreg: frame base + `value`
+      kBreg,      // DW_OP_breg*, DW_OP_bregx: `reg` + `value`
+      kReg,       // DW_OP_reg*, DW_OP_regx: in `reg`
+      kAddr,      // DW_OP_addr: at `value`
+    };
+
+    Kind kind;
+    Dwarf_Small opcode;
+    uint32_t reg;
+    Dwarf_Unsigned value;  // offset or address
+  };
+
   struct LocationExpression {
     Dwarf_Addr lowAddr;   // Lowest address of active range.
     Dwarf_Addr highAddr;  // Highest address of active range.
     DwarfExpression expr;
+    SimpleLocation simple;
   };
 
   DwarfLocation(Dwarf_Debug dbg, Dwarf_Attribute attr, Dwarf_Half addr_size,
@@ -44,7 +61,25 @@ class DwarfLocation {
   DwarfExpression::Result evalValue(const DwarfExpression::Context& context,
                                     Dwarf_Addr pc) const;
 
+  /**
+   * @brief same as evalValue(), with the concrete providers of
+   *        `DwarfExpression::evaluate()`, which also evaluate the frame base
+   *
+   * Defined in dwarf_expression_eval.h.
+   */
+  template <typename Regs, typename Mem, typename Cfa>
+  DwarfExpression::Result evalValue(const DwarfExpression::Context& context,
+                                    const Regs& registers, const Mem& memory,
+                                    const Cfa& cfa, Dwarf_Addr pc) const;
+
  protected:
+  // Classify the expression and add it.
+  void addExpression(LocationExpression&& loc_expr);
+  static SimpleLocation classify(const DwarfExpression& expr);
+  // The expression whose range has the pc, nullptr if none.
+  const LocationExpression* findExpression(
+      const DwarfExpression::Context& context, Dwarf_Addr pc) const;
+
   Dwarf_Debug dbg_;
   Dwarf_Attribute attr_;
   std::vector<LocationExpression> exprs_;
@@ -53,6 +88,12 @@ class DwarfLocation {
   Dwarf_Half version_;
 };  // class DwarfLocation
 
+extern template DwarfExpression::Result DwarfLocation::evalValue(
+    const DwarfExpression::Context& context,
+    const DwarfExpression::RegisterProvider& registers,
+    const DwarfExpression::MemoryProvider& memory,
+    const DwarfExpression::CfaProvider& cfa, Dwarf_Addr pc) const;
+
 }  // namespace dwarfexpr
 
 #endif  // DWARFEXPR_DWARF_LOCATION_H
@@ -0,0 +1,115 @@
+#ifndef DWARFEXPR_DWARF_RANGES_H
+#define DWARFEXPR_DWARF_RANGES_H
+
+#include <libdwarf/dwarf.h>
+#include <libdwarf/libdwarf.h>
+
+#include <vector>
+
+namespace dwarfexpr {
+
+struct DwarfAddrRange {
+  Dwarf_Addr low;    // Lowest address of the range.
+  Dwarf_Addr high;   // First address past the end of the range.
+  Dwarf_Off offset;  // Offset of the DIE which owns the range.
+};
+
+/**
+ * @brief A flat table of address ranges, sorted by address.
+ *
+ * Ranges are collected with `add()`, then `finalize()` sorts them and clips
+ * the overlaps (the first added range wins), so that `find()` can answer a
+ * lookup with a single binary search.
+ */
+class DwarfRangeTable {
+ public:
+  DwarfRangeTable() {}
+  ~DwarfRangeTable() {}
+
+  void add(Dwarf_Addr low, Dwarf_Addr high, Dwarf_Off offset);
+  void finalize();
+  void clear() { ranges_.clear(); }
+
+  bool find(Dwarf_Addr pc, Dwarf_Off* out_offset) const;
+
+  bool empty() const { return ranges_.empty(); }
+  std::size_t size() const { return ranges_.size(); }
+  const std::vector<DwarfAddrRange>& ranges() const { return ranges_; }
+
+ private:
+  std::vector<DwarfAddrRange> ranges_;
+};  // class DwarfRangeTable
+
+struct DwarfFuncRange {
+  Dwarf_Addr low;            // Lowest address of the range.
+  Dwarf_Addr high;           // First address past the end of the range.
+  Dwarf_Off die_offset;      // Offset of the subprogram/inlined_subroutine DIE.
+  int depth;                 // Nesting depth, 0 for the outermost subprogram.
+  Dwarf_Unsigned call_file;  // DW_AT_call_file of an inlined subroutine.
+  Dwarf_Unsigned call_line;  // DW_AT_call_line of an inlined subroutine.
+};
+
+/**
+ * @brief Address ranges of all the subprograms and inlined subroutines of a
+ *        CU.
+ *
+ * The ranges are sorted by (depth, low), the ranges in the same depth do not
+ * overlap each other, so the function at any depth can be found with a
+ * single binary search.
+ *
+ * `finalize()` also cuts the addresses into the pieces of their innermost
+ * functions and links every range to the one of its enclosing function, so
+ * the whole chain of a pc is one binary search and a walk up the parents.
+ */
+class DwarfFuncTable {
+ public:
+  DwarfFuncTable() {}
+  ~DwarfFuncTable() {}
+
+  void add(const DwarfFuncRange& range);
+  void finalize();
+
+  const DwarfFuncRange* find(Dwarf_Addr pc, int depth) const;
+
+  /**
+   * @brief find the innermost function which contains the pc
+   */
+  const DwarfFuncRange* findInnermost(Dwarf_Addr pc) const;
+
+  /**
+   * @brief find the outermost function which contains the pc, it is not at
+   *        depth 0 for a pc in a nested subprogram, e.g. a GCC nested
+   *        function, whose code is out of the ranges of its parent.
+   */
+  const DwarfFuncRange* findOutermost(Dwarf_Addr pc) const;
+
+  /**
+   * @brief the range of the enclosing function, at the depth above, which
+   *        contains the start of the range
+   *
+   * @return nullptr if there is none
+   */
+  const DwarfFuncRange* parent(const DwarfFuncRange* range) const;
+
+  int maxDepth() const { return static_cast<int>(depth_begin_.size()) - 1; }
+  std::size_t size() const { return ranges_.size(); }
+  const std::vector<DwarfFuncRange>& ranges() const { return ranges_; }
+  std::size_t memoryUsage() const;
+
+ private:
+  // A piece of the addresses, all in the same innermost function.
+  struct Leaf {
+    Dwarf_Addr low;
+    Dwarf_Addr high;
+    std::size_t index;  // of the innermost range
+  };
+
+  std::vector<DwarfFuncRange> ranges_;
+  std::vector<std::size_t> depth_begin_;  // index of the first range of depth
+  std::vector<std::size_t> parents_;      // index of the parent of each range
+  std::vector<Leaf> leaves_;              // sorted by address
+};  // class DwarfFuncTable
+
+}  // namespace dwarfexpr
+
+#endif  // DWARFEXPR_DWARF_RANGES_H
@@ -4,7 +4,15 @@
 #include <libdwarf/dwarf.h>
 #include <libdwarf/libdwarf.h>
 
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dwarfexpr/dwarf_call_sites.h"
+#include "dwarfexpr/dwarf_files.h"
+#include "dwarfexpr/dwarf_lines.h"
+#include "dwarfexpr/dwarf_ranges.h"
 
 namespace dwarfexpr {
 
@@ -51,6 +59,24 @@ class DwarfCUContext {
   Dwarf_Sig8 signature = {0};
 };
 
+struct DwarfInlineFrame {
+  Dwarf_Off die_offset;  // Offset of the subprogram/inlined_subroutine DIE.
+  // Call site of this function in its caller, 0 for the outermost subprogram.
+  Dwarf_Unsigned call_file;
+  Dwarf_Unsigned call_line;
+};
+
+struct DwarfFunctionResult {
+  bool found;             // Whether the function of the pc is found.
+  Dwarf_Off cu_offset;    // Offset of the CU DIE.
+  Dwarf_Off func_offset;  // Offset of the outermost subprogram DIE.
+  DwarfFileId file;       // Source file of the pc, in DwarfFilePool.
+  // Source line of the pc, MAX_DWARF_UNSIGNED if unknown.
+  Dwarf_Unsigned line_number;
+  Dwarf_Unsigned column;         // 0 if unknown.
+  Dwarf_Unsigned discriminator;  // 0 if none.
+};
+
 class DwarfSearcher {
  public:
   DwarfSearcher(Dwarf_Debug dbg);
@@ -59,15 +85,148 @@ class DwarfSearcher {
   bool searchFunction(Dwarf_Addr pc, Dwarf_Die* out_cu_die,
                       Dwarf_Die* out_func_die, Dwarf_Error* errp);
 
+  /**
+   * @brief find the functions and the source lines of a batch of pcs
+   *
+   * The pcs are sorted and grouped by CU, so that each CU is visited once and
+   * its line table is decoded once and cached for all the pcs in it.
+   *
+   * @param pcs the target pc addresses
+   * @return the results in the same order as `pcs`
+   */
+  std::vector<DwarfFunctionResult> searchFunctions(
+      const std::vector<Dwarf_Addr>& pcs, Dwarf_Error* errp);
+
+  /**
+   * @brief find the CU which contains the pc
+   *
+   * @param pc the target pc address
+   * @param out_cu_offset the offset of the CU DIE
+   * @return true if found
+   */
+  bool searchCU(Dwarf_Addr pc, Dwarf_Off* out_cu_offset, Dwarf_Error* errp);
+
+  /**
+   * @brief list the offsets of all the CU DIEs in `.debug_info`
+   */
+  bool listCUs(std::vector<Dwarf_Off>* out_cu_offsets, Dwarf_Error* errp);
+
+  /**
+   * @brief find all the nested functions which contain the pc
+   *
+   * @param pc the target pc address
+   * @param out_cu_offset the offset of the CU DIE
+   * @param out_frames the outermost subprogram first, through the innermost
+   *        inlined subroutine
+   * @return true if found
+   */
+  bool searchInlineChain(Dwarf_Addr pc, Dwarf_Off* out_cu_offset,
+                         std::vector<DwarfInlineFrame>* out_frames,
+                         Dwarf_Error* errp);
+
+  /**
+   * @brief get the function table of a CU, it is built on the first call and
+   *        cached for the following lookups.
+   */
+  const DwarfFuncTable* getFuncTable(Dwarf_Off cu_offset, Dwarf_Error* errp);
+
+  /**
+   * @brief get the decoded line table of a CU, it is built on the first call
+   *        and cached for the following lookups.
+   *
+   * @return nullptr if the CU has no line table
+   */
+  const DwarfLineTable* getLineTable(Dwarf_Off cu_offset, Dwarf_Error* errp);
+
+  /**
+   * @brief get the id of a file number of a CU, e.g. DW_AT_call_file, from
+   *        the cached line table of the CU.
+   *
+   * @return kDwarfNoFileId if unknown
+   */
+  DwarfFileId getFileId(Dwarf_Off cu_offset, Dwarf_Unsigned file_num,
+                        Dwarf_Error* errp);
+
+  /**
+   * @brief get the id of the DW_AT_decl_file of a DIE of the CU, from the
+   *        cached line table of the CU. The path is only materialized by
+   *        `DwarfFilePool::path()` when it is printed.
+   *
+   * @return kDwarfNoFileId if unknown
+   */
+  DwarfFileId getDeclFileId(Dwarf_Off cu_offset, Dwarf_Die die,
+                            Dwarf_Error* errp);
+
+  /**
+   * @brief find the call site of a return address, for DW_OP_entry_value
+   *
+   * The call site table of the caller is built on its first search, then
+   * the call site is cached by the return address.
+   *
+   * @param return_pc the return address, i.e. the pc of the caller frame
+   * @return nullptr if the caller does not describe the parameters of the
+   *         call
+   */
+  const DwarfCallSite* searchCallSite(Dwarf_Addr return_pc, Dwarf_Error* errp);
+
+  /**
+   * @brief get the encoding and size of a DW_TAG_base_type DIE, for the
+   *        typed ops, e.g. DW_OP_convert. It is cached by DIE offset.
+   *
+   * @param cu_offset the offset of the CU DIE, e.g. from searchCU()
+   * @param type_offset the operand of the op, relative to the CU header
+   * @return false if it is not a base type of at most 16 bytes
+   */
+  bool getBaseType(Dwarf_Off cu_offset, Dwarf_Off type_offset,
+                   DwarfBaseType* out_type, Dwarf_Error* errp);
+
+  /**
+   * @brief approximate bytes held by the cached indexes, they grow as more
+   *        CUs are searched.
+   */
+  std::size_t memoryUsage() const;
+
  private:
-  int searchInDieTree(DwarfCUContext* ctx, Dwarf_Die in_die, Dwarf_Error* errp);
-  int searchInDie(DwarfCUContext* ctx, Dwarf_Die in_die, Dwarf_Error* errp);
-  int matchFuncDie(DwarfCUContext* ctx, Dwarf_Die in_die, Dwarf_Error* errp);
-  int matchCUDie(DwarfCUContext* ctx, Dwarf_Die in_die, Dwarf_Error* errp);
+  void collectFuncRanges(Dwarf_Die in_die, Dwarf_Addr cu_base, int depth,
+                         DwarfFuncTable* table, Dwarf_Error* errp);
+
+  bool loadAranges(Dwarf_Error* errp);
+  bool loadCURanges(Dwarf_Error* errp);
 
  private:
   Dwarf_Debug m_dbg;
 
+  // Address ranges from `.debug_aranges`, consulted first.
+  bool m_aranges_loaded;
+  DwarfRangeTable m_aranges;
+  std::vector<Dwarf_Off> m_aranges_cus;  // sorted CU offsets in m_aranges
+
+  // Address ranges of the CUs missing from `.debug_aranges`, built once on
+  // the first search which can not be answered by `m_aranges`.
+  bool m_cu_ranges_loaded;
+  DwarfRangeTable m_cu_ranges;
+
+  // Function tables of the CUs which have been searched, by CU offset.
+  std::unordered_map<Dwarf_Off, DwarfFuncTable> m_func_tables;
+
+  // Line tables of the CUs which have been searched, by CU offset, null if
+  // the CU has none.
+  std::unordered_map<Dwarf_Off, std::unique_ptr<DwarfLineTable>>
+      m_line_tables;
+
+  // Call site tables of the callers which have been searched, by the offset
+  // of their subprogram DIEs.
+  std::unordered_map<Dwarf_Off, DwarfCallSiteTable> m_call_site_tables;
+
+  // Call sites by return address, null if not found.
+  std::unordered_map<Dwarf_Addr, const DwarfCallSite*> m_call_sites;
+
+  // CU header offsets by CU DIE offset, the base of the typed ops operands.
+  std::unordered_map<Dwarf_Off, Dwarf_Off> m_cu_headers;
+
+  // Base types by DIE offset, of size 0 if the DIE is not a base type.
+  std::unordered_map<Dwarf_Off, DwarfBaseType> m_base_types;
+
 };  // class DwarfSearcher
 
 }  // namespace dwarfexpr
@@ -0,0 +1,168 @@
+#ifndef DWARFEXPR_DWARF_SYMCACHE_H
+#define DWARFEXPR_DWARF_SYMCACHE_H
+
+#include <libdwarf/dwarf.h>
+#include <libdwarf/libdwarf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dwarfexpr {
+
+/*
+ * Symcache file layout, all the integers are in host byte order, and every
+ * section starts at an 8-byte aligned offset:
+ *
+ *   DwarfSymcacheHeader
+ *   uint32_t depth_begin[depth_count + 1]  index of the first range of depth
+ *   DwarfSymcacheRange ranges[range_count] sorted by (depth, low)
+ *   DwarfSymcacheLine lines[line_count]    sorted by addr
+ *   uint32_t files[file_count]             offsets in the string table
+ *   char strings[strings_size]             NUL-terminated strings
+ *
+ * The ranges in the same depth do not overlap, just like `DwarfFuncTable`, so
+ * the inline chain of a pc is found with one binary search per depth.
+ */
+
+constexpr char kDwarfSymcacheMagic[4] = {'D', 'W', 'S', 'C'};
+constexpr uint32_t kDwarfSymcacheVersion = 1;
+constexpr uint32_t kDwarfSymcacheNone = 0xffffffff;
+constexpr size_t kDwarfSymcacheMaxBuildId = 64;
+
+struct DwarfSymcacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t build_id_size;
+  uint8_t build_id[kDwarfSymcacheMaxBuildId];
+
+  uint32_t depth_count;
+  uint32_t range_count;
+  uint32_t line_count;
+  uint32_t file_count;
+
+  uint64_t depth_offset;
+  uint64_t range_offset;
+  uint64_t line_offset;
+  uint64_t file_offset;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+};
+
+struct DwarfSymcacheRange {
+  uint64_t low;        // Lowest address of the range.
+  uint64_t high;       // First address past the end of the range.
+  uint32_t name;       // Offset of the demangled name in the string table.
+  uint32_t call_file;  // Index in the file table, kDwarfSymcacheNone if none.
+  uint32_t call_line;  // 0 for the outermost subprogram.
+  uint32_t depth;      // Nesting depth, 0 for the outermost subprogram.
+};
+
+struct DwarfSymcacheLine {
+  uint64_t addr;
+  uint32_t file;  // Index in the file table, kDwarfSymcacheNone if the row
+                  // ends a sequence.
+  uint32_t line;
+};
+
+static_assert(sizeof(DwarfSymcacheHeader) % 8 == 0, "unaligned header");
+static_assert(sizeof(DwarfSymcacheRange) == 32, "unexpected padding");
+static_assert(sizeof(DwarfSymcacheLine) == 16, "unexpected padding");
+
+/**
+ * @brief Build a symcache from the DWARF of a module.
+ */
+class DwarfSymcacheBuilder {
+ public:
+  DwarfSymcacheBuilder(Dwarf_Debug dbg) : dbg_(dbg) {}
+  ~DwarfSymcacheBuilder() {}
+
+  /**
+   * @brief collect the functions, inline trees and line tables of all CUs
+   */
+  bool build(Dwarf_Error* errp);
+
+  /**
+   * @brief write the symcache file
+   *
+   * @param build_id build-id of the module, the lookup side uses it to check
+   *        the symcache matches the module
+   */
+  bool write(const std::string& path, const std::vector<uint8_t>& build_id);
+
+ private:
+  uint32_t internString(const std::string& str);
+  uint32_t internFile(const std::string& file);
+
+  Dwarf_Debug dbg_;
+
+  std::vector<uint32_t> depth_begin_;
+  std::vector<DwarfSymcacheRange> ranges_;
+  std::vector<DwarfSymcacheLine> lines_;
+  std::vector<uint32_t> files_;
+  std::string strings_;
+
+  std::unordered_map<std::string, uint32_t> string_index_;
+  std::unordered_map<std::string, uint32_t> file_index_;
+};  // class DwarfSymcacheBuilder
+
+struct DwarfSymcacheFrame {
+  const char* name;
+  // Call site of this function in its caller, null for the outermost one.
+  const char* call_file;
+  uint32_t call_line;
+};
+
+/**
+ * @brief A read-only symcache mapped in memory, lookups do not need libdwarf.
+ */
+class DwarfSymcache {
+ public:
+  DwarfSymcache() {}
+  ~DwarfSymcache() { close(); }
+
+  DwarfSymcache(const DwarfSymcache&) = delete;
+  DwarfSymcache& operator=(const DwarfSymcache&) = delete;
+
+  bool open(const std::string& path);
+  void close();
+
+  std::vector<uint8_t> buildId() const;
+
+  /**
+   * @brief find all the nested functions which contain the pc
+   *
+   * @param out_frames the outermost subprogram first, through the innermost
+   *        inlined subroutine
+   * @return true if found
+   */
+  bool lookupFunctions(uint64_t pc,
+                       std::vector<DwarfSymcacheFrame>* out_frames) const;
+
+  /**
+   * @brief find the source file and line of the pc
+   */
+  bool lookupLine(uint64_t pc, const char** out_file,
+                  uint32_t* out_line) const;
+
+ private:
+  const char* stringAt(uint32_t offset) const;
+  const char* fileAt(uint32_t index) const;
+
+  void* data_ = nullptr;
+  size_t size_ = 0;
+
+  const DwarfSymcacheHeader* header_ = nullptr;
+  const uint32_t* depth_begin_ = nullptr;
+  const DwarfSymcacheRange* ranges_ = nullptr;
+  const DwarfSymcacheLine* lines_ = nullptr;
+  const uint32_t* files_ = nullptr;
+  const char* strings_ = nullptr;
+};  // class DwarfSymcache
+
+}  // namespace dwarfexpr
+
+#endif  // DWARFEXPR_DWARF_SYMCACHE_H
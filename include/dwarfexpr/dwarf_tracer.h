@@ -0,0 +1,129 @@
+#ifndef DWARFEXPR_DWARF_TRACER_H
+#define DWARFEXPR_DWARF_TRACER_H
+
+#include <libdwarf/dwarf.h>
+#include <libdwarf/libdwarf.h>
+
+#include <cstdint>
+#include <cstdio>
+
+// Define DWARFEXPR_NO_TRACE to compile the tracing out of the evaluation.
+#ifdef DWARFEXPR_NO_TRACE
+#define DWARFEXPR_TRACING(tracer) false
+#else
+#define DWARFEXPR_TRACING(tracer) ((tracer) != nullptr)
+#endif
+
+namespace dwarfexpr {
+
+/**
+ * @brief An event of the evaluation of a location or a CFI rule.
+ *
+ * Only the fields named in the comment of the type are set.
+ */
+struct DwarfTraceEvent {
+  enum class Type {
+    kRegister,            // DW_OP_reg*: `reg` holds `value`
+    kRegisterOffset,      // DW_OP_breg*: `reg` + `offset` = `value`
+    kNotImplemented,      // `opcode` is not supported
+    kExpressionRange,     // the expression of [`low`, `high`) is evaluated
+    kNoExpression,        // no expression of the location covers `pc`
+    kFde,                 // the FDE of [`low`, `high`) covers `pc`
+    kRegisterRule,        // the `value_type` rule of column `reg` with
+                          // `base_reg` and `offset` gives `value`, read at
+                          // `addr` if not 0
+    kRegisterRuleFailed,  // the same rule can not be evaluated
+    kMemoryInvalid,       // `value` bytes at `addr` can not be read
+    kExpressionFailed,    // the expression of column `reg` fails with the
+                          // error code `value` at the op offset `addr`
+  };
+
+  Type type;
+  Dwarf_Addr pc;
+  Dwarf_Small opcode;
+  Dwarf_Small value_type;  // DW_EXPR_*
+  Dwarf_Unsigned reg;
+  Dwarf_Unsigned base_reg;
+  Dwarf_Signed offset;
+  Dwarf_Addr low;
+  Dwarf_Addr high;
+  Dwarf_Addr addr;
+  uint64_t value;
+
+  static DwarfTraceEvent Register(Dwarf_Addr pc, Dwarf_Small opcode,
+                                  Dwarf_Unsigned reg, uint64_t value) {
+    DwarfTraceEvent event = Make(Type::kRegister, pc);
+    event.opcode = opcode;
+    event.reg = reg;
+    event.value = value;
+    return event;
+  }
+
+  static DwarfTraceEvent RegisterOffset(Dwarf_Addr pc, Dwarf_Small opcode,
+                                        Dwarf_Unsigned reg,
+                                        Dwarf_Signed offset, uint64_t value) {
+    DwarfTraceEvent event = Make(Type::kRegisterOffset, pc);
+    event.opcode = opcode;
+    event.reg = reg;
+    event.offset = offset;
+    event.value = value;
+    return event;
+  }
+
+  static DwarfTraceEvent NotImplemented(Dwarf_Addr pc, Dwarf_Small opcode) {
+    DwarfTraceEvent event = Make(Type::kNotImplemented, pc);
+    event.opcode = opcode;
+    return event;
+  }
+
+  static DwarfTraceEvent MemoryInvalid(Dwarf_Addr pc, Dwarf_Addr addr,
+                                       uint64_t size) {
+    DwarfTraceEvent event = Make(Type::kMemoryInvalid, pc);
+    event.addr = addr;
+    event.value = size;
+    return event;
+  }
+
+  static DwarfTraceEvent Range(Type type, Dwarf_Addr pc, Dwarf_Addr low,
+                               Dwarf_Addr high) {
+    DwarfTraceEvent event = Make(type, pc);
+    event.low = low;
+    event.high = high;
+    return event;
+  }
+
+  static DwarfTraceEvent Make(Type type, Dwarf_Addr pc) {
+    DwarfTraceEvent event = {};
+    event.type = type;
+    event.pc = pc;
+    return event;
+  }
+};
+
+/**
+ * @brief Receive the events of the evaluations, see `DWARFEXPR_TRACING`.
+ *
+ * The tracer of a `DwarfExpression::Context` is null by default, then
+ * nothing is traced.
+ */
+class DwarfTracer {
+ public:
+  virtual ~DwarfTracer() {}
+  virtual void onEvent(const DwarfTraceEvent& event) = 0;
+};
+
+/**
+ * @brief Print the events as text, for debugging.
+ */
+class DwarfPrintTracer : public DwarfTracer {
+ public:
+  explicit DwarfPrintTracer(FILE* out) : out_(out) {}
+  void onEvent(const DwarfTraceEvent& event) override;
+
+ private:
+  FILE* out_;
+};
+
+}  // namespace dwarfexpr
+
+#endif  // DWARFEXPR_DWARF_TRACER_H
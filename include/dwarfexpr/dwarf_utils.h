@@ -9,6 +9,7 @@
 #include <string>
 #include <type_traits>
 #include <utility>  // std::pair
+#include <vector>
 
 namespace dwarfexpr {
 
@@ -78,16 +79,39 @@ int getLowAndHighPc(Dwarf_Debug dbg, Dwarf_Die die, bool* have_pc_range,
                     Dwarf_Error* error);
 int getRnglistsBase(Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Off* base_out,
                     Dwarf_Error* error);
+int getDieRanges(Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Addr base_addr,
+                 std::vector<std::pair<Dwarf_Addr, Dwarf_Addr>>* ranges_out,
+                 Dwarf_Error* error);
 
 std::string getFunctionName(Dwarf_Debug dbg, Dwarf_Die func_die, bool demangle,
                             std::string def_val);
-std::string getDeclFile(Dwarf_Debug dbg, Dwarf_Die cu_die, Dwarf_Die func_die,
-                        std::string def_val);
+std::string getSrcFileName(Dwarf_Debug dbg, Dwarf_Die cu_die,
+                           Dwarf_Unsigned file_num, std::string def_val);
 Dwarf_Unsigned getDeclLine(Dwarf_Debug dbg, Dwarf_Die func_die,
                            Dwarf_Unsigned def_val);
 std::pair<std::string, Dwarf_Unsigned> getFileNameAndLineNumber(
     Dwarf_Debug dbg, Dwarf_Die cu_die, Dwarf_Addr pc, std::string def_val1,
     Dwarf_Unsigned def_val2);
+// Same as getFileNameAndLineNumber(), but resolve all the pcs of a CU with a
+// single decode of its line table, results are in the same order as `pcs`.
+std::vector<std::pair<std::string, Dwarf_Unsigned>> getFileNameAndLineNumbers(
+    Dwarf_Debug dbg, Dwarf_Die cu_die, const std::vector<Dwarf_Addr>& pcs,
+    std::string def_val1, Dwarf_Unsigned def_val2);
+
+struct DwarfLineRow {
+  Dwarf_Addr addr;
+  Dwarf_Unsigned file;  // Index of the file in the `files` of getLineRows().
+  Dwarf_Unsigned line;
+  bool end_sequence;  // The first address past the end of a sequence.
+  Dwarf_Unsigned column;
+  bool is_stmt;
+  Dwarf_Unsigned discriminator;
+};
+// Read all the rows of the line table of a CU in the order of the table, the
+// file indexes are normalized to 0-based indexes of `files_out`.
+int getLineRows(Dwarf_Debug dbg, Dwarf_Die cu_die,
+                std::vector<DwarfLineRow>* rows_out,
+                std::vector<std::string>* files_out, Dwarf_Error* error);
 
 std::string demangleName(const std::string& mangled);
 
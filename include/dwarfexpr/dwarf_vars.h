@@ -44,8 +44,12 @@ class DwarfVar : public DwarfTag {
 
  private:
   DwarfValue evalValueAtLoc(DwarfType* type, Dwarf_Addr addr,
-                            DwarfExpression::MemoryProvider memory) const;
+                            const DwarfExpression::Context& context,
+                            Dwarf_Addr pc) const;
   DwarfValue formatValue(DwarfType* type, char* buf, size_t buf_size) const;
+  // Assemble the value from the pieces of a composite location.
+  DwarfValue evalComposite(DwarfType* type, const DwarfPieces& pieces,
+                           const DwarfExpression::Context& context) const;
 
   DwarfType* loadType();
   DwarfLocation* loadLocation();
@@ -0,0 +1,38 @@
+#ifndef DWARFEXPR_ELF_UTILS_H
+#define DWARFEXPR_ELF_UTILS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dwarfexpr {
+
+/**
+ * @brief read the GNU build-id (the `NT_GNU_BUILD_ID` note) of an ELF file
+ *
+ * This only parses the ELF headers and note sections, libdwarf is not used,
+ * so it is cheap enough to be called on every run.
+ *
+ * @param path path of the ELF file
+ * @param out_build_id the raw bytes of the build-id
+ * @return true if found
+ */
+bool readElfBuildId(const std::string& path,
+                    std::vector<uint8_t>* out_build_id);
+
+/**
+ * @brief read the machine (`e_machine`) of an ELF file, e.g. 62 for x86_64
+ */
+bool readElfMachine(const std::string& path, uint16_t* out_machine);
+
+std::string buildIdToHex(const std::vector<uint8_t>& build_id);
+
+/**
+ * @brief parse a build-id printed by `buildIdToHex()`
+ */
+bool buildIdFromHex(const std::string& hex,
+                    std::vector<uint8_t>* out_build_id);
+
+}  // namespace dwarfexpr
+
+#endif  // DWARFEXPR_ELF_UTILS_H
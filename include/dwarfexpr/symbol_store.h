@@ -0,0 +1,99 @@
+#ifndef DWARFEXPR_SYMBOL_STORE_H
+#define DWARFEXPR_SYMBOL_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dwarfexpr {
+
+/*
+ * Index of a Breakpad-style symbol store (`<store>/<name>/<id>/<file>`), all
+ * the integers are in host byte order:
+ *
+ *   SymbolStoreHeader
+ *   SymbolStoreEntry entries[entry_count]  sorted by build-id
+ *   char strings[strings_size]             NUL-terminated paths, relative to
+ *                                          the store directory
+ *
+ * The store is walked once when the index is built, then a module is resolved
+ * with one binary search over the mapped entries.
+ */
+
+constexpr char kSymbolStoreMagic[4] = {'D', 'W', 'S', 'I'};
+constexpr uint32_t kSymbolStoreVersion = 1;
+constexpr size_t kSymbolStoreMaxBuildId = 32;
+
+struct SymbolStoreHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t entry_count;
+  uint64_t entries_offset;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+};
+
+struct SymbolStoreEntry {
+  uint8_t build_id[kSymbolStoreMaxBuildId];  // zero padded
+  uint32_t build_id_size;
+  uint32_t path;  // Offset of the path in the string table.
+};
+
+static_assert(sizeof(SymbolStoreHeader) % 8 == 0, "unaligned header");
+static_assert(sizeof(SymbolStoreEntry) == 40, "unexpected padding");
+
+/**
+ * @brief A read-only index of a symbol store mapped in memory.
+ */
+class SymbolStore {
+ public:
+  SymbolStore() {}
+  ~SymbolStore() { close(); }
+
+  SymbolStore(const SymbolStore&) = delete;
+  SymbolStore& operator=(const SymbolStore&) = delete;
+
+  /**
+   * @brief walk the store and write the index of all the ELF files with a
+   *        build-id found in it, the index file can live anywhere.
+   *
+   * @return the number of indexed files, -1 on error
+   */
+  static int buildIndex(const std::string& store_dir,
+                        const std::string& index_path);
+
+  /**
+   * @brief map the index of a store
+   *
+   * @param store_dir the directory the paths of the index are relative to
+   */
+  bool open(const std::string& store_dir, const std::string& index_path);
+  void close();
+
+  size_t size() const;
+
+  /**
+   * @brief find the debug file of a build-id
+   *
+   * @param out_path the path of the file in the store
+   * @return true if found
+   */
+  bool lookup(const std::vector<uint8_t>& build_id,
+              std::string* out_path) const;
+
+ private:
+  std::string store_dir_;
+
+  void* data_ = nullptr;
+  size_t size_ = 0;
+
+  const SymbolStoreHeader* header_ = nullptr;
+  const SymbolStoreEntry* entries_ = nullptr;
+  const char* strings_ = nullptr;
+};  // class SymbolStore
+
+}  // namespace dwarfexpr
+
+#endif  // DWARFEXPR_SYMBOL_STORE_H
@@ -1,22 +1,33 @@
 #include <inttypes.h>
 #include <string.h>
+#include <unistd.h>  // access
 
+#include <algorithm>  // std::max
 #include <cinttypes>
 #include <cstdint>
 #include <functional>  // std::bind
 #include <iostream>
 #include <limits>  // numeric_limits
+#include <memory>
 #include <sstream>
 #include <string>
 #include <utility>  // std::make_pair
 
 #include "dwarf_context.h"
+#include "module_manager.h"
+#include "server.h"
+#include "symbolizer_pool.h"
 #include "dwarfexpr/dwarf_attrs.h"
+#include "dwarfexpr/dwarf_files.h"
 #include "dwarfexpr/dwarf_frames.h"
+#include "dwarfexpr/dwarf_line_index.h"
 #include "dwarfexpr/dwarf_searcher.h"
+#include "dwarfexpr/dwarf_symcache.h"
 #include "dwarfexpr/dwarf_types.h"
 #include "dwarfexpr/dwarf_utils.h"
 #include "dwarfexpr/dwarf_vars.h"
+#include "dwarfexpr/elf_utils.h"
+#include "dwarfexpr/symbol_store.h"
 
 using namespace dwarfexpr;
 using namespace dwarf2line;
@@ -27,27 +38,55 @@ const char USAGE[] =
     "  -e --exe <executable>   Set the input filename\n"
     "  -f --functions          Show function names\n"
     "  -C --demangle           Demangle function names\n"
+    "  -i --inlines            Unwind inlined functions\n"
     "\n"
     "  -F --frames             Show Call Frame Infomation\n"
     "  -l --locals             Show local variables\n"
     "  -p --params             Show function params\n"
     "  -c --context            Set the dwarf context file\n"
+    "  -j --jobs <n>           Symbolize with n threads\n"
+    "     --build-symcache <file>  Write the symcache of the executable\n"
+    "     --symcache <file>    Symbolize from a symcache (no DWARF reading)\n"
+    "     --serve              Serve `<module> <address>[ <context>]`\n"
+    "                          requests from stdin, one per line\n"
+    "     --socket <path>      Serve the requests on a Unix domain socket\n"
+    "     --lookup-line <file:line>\n"
+    "                          Print the address ranges of a source line,\n"
+    "                          the file may be a path suffix, e.g. foo.cpp\n"
+    "     --symbol-store <dir> Resolve the modules given as hex build-ids in\n"
+    "                          a `<name>/<id>/<file>` store\n"
+    "     --store-index <file> Index of the store, built by walking the store\n"
+    "                          if missing (default: <dir>/dwarf2line.index)\n"
+    "     --build-store-index  Rebuild the index of the store\n"
+    "     --memory-budget <mb> Close the least recently used modules of\n"
+    "                          `--serve` above this memory, 0 for no limit\n"
     "  -v --verbose            Show debug log\n";
 
 static DwarfContext* gDwarfContext = nullptr;
 
-DwarfContextFrame* getFirstThreadFrame(DwarfContext* context) {
+// The return addresses of the context frames are only known for AArch64,
+// by the DWARF numbers of its link register and pc.
+static const uint16_t kEmAarch64 = 183;
+static const int kArm64LrRegister = 30;
+static const int kArm64PcRegister = 32;
+
+DwarfContextFrame* getThreadFrame(DwarfContext* context, size_t index) {
   if (context != nullptr && context->header.threads_size > 0) {
     DwarfContextThread& thread = context->threads[0];
-    if (thread.header.frames_size > 0) {
-      return &thread.frames[0];
+    if (index < thread.frames.size()) {
+      return &thread.frames[index];
     }
   }
   return nullptr;
 }
 
-bool register_provider(int reg_num, uint64_t* reg_val) {
-  DwarfContextFrame* frame = getFirstThreadFrame(gDwarfContext);
+DwarfContextFrame* getFirstThreadFrame(DwarfContext* context) {
+  return getThreadFrame(context, 0);
+}
+
+bool frame_register_provider(size_t frame_index, int reg_num,
+                             uint64_t* reg_val) {
+  DwarfContextFrame* frame = getThreadFrame(gDwarfContext, frame_index);
   if (frame == nullptr) {
     return false;
   }
@@ -63,15 +102,19 @@ bool register_provider(int reg_num, uint64_t* reg_val) {
   return false; // FIXME
 }
 
-bool memory_provider(uint64_t addr, size_t size, char** out_buf,
-                     size_t* out_buf_size) {
+bool register_provider(int reg_num, uint64_t* reg_val) {
+  return frame_register_provider(0, reg_num, reg_val);
+}
+
+bool frame_memory_provider(size_t frame_index, uint64_t addr, size_t size,
+                           char** out_buf, size_t* out_buf_size) {
   *out_buf = nullptr;
   *out_buf_size = 0;
 
   uint64_t stack_memory_base_addr = 0;
   uint32_t stack_memory_size = 0;
   unsigned char* stack_memory = nullptr;
-  DwarfContextFrame* frame = getFirstThreadFrame(gDwarfContext);
+  DwarfContextFrame* frame = getThreadFrame(gDwarfContext, frame_index);
   if (frame != nullptr) {
     stack_memory_base_addr = frame->stack_memory_base_addr;
     stack_memory_size = frame->stack_memory.size();
@@ -90,35 +133,523 @@ bool memory_provider(uint64_t addr, size_t size, char** out_buf,
     return true;
   }
 
-  printf("Error: Memory address of range: [0x%" PRIx64 " - 0x%" PRIx64
-         "] addr=0x%" PRIx64 ", size=%zu\n",
-         start_addr, end_addr, addr, size);
+  fprintf(stderr,
+          "Error: Memory address of range: [0x%" PRIx64 " - 0x%" PRIx64
+          "] addr=0x%" PRIx64 ", size=%zu\n",
+          start_addr, end_addr, addr, size);
   return false;
 }
 
-void print_var(const DwarfExpression::Context& expr_ctx, const DwarfVar* var,
-               Dwarf_Addr pc, bool debug) {
+bool memory_provider(uint64_t addr, size_t size, char** out_buf,
+                     size_t* out_buf_size) {
+  return frame_memory_provider(0, addr, size, out_buf, out_buf_size);
+}
+
+/**
+ * @brief the value of a register at the entry of the function of the frame 0,
+ *        for DW_OP_entry_value
+ *
+ * The caller describes the parameters of the call at its return address, the
+ * pc of the frame 1, their values are evaluated in the frame 1.
+ *
+ * @param machine the ELF machine of the module, only AArch64 is supported
+ * @param pc the pc of the frame 0 in the module, the registers of the context
+ *        hold the addresses in the process
+ */
+bool entry_value_provider(Dwarf_Debug dbg, DwarfSearcher* searcher,
+                          const DwarfFrames& frames, DwarfTracer* tracer,
+                          uint16_t machine, Dwarf_Addr pc, uint32_t reg,
+                          uint64_t* value) {
+  if (machine != kEmAarch64) {
+    return false;
+  }
+  DwarfContextFrame* frame = getThreadFrame(gDwarfContext, 0);
+  DwarfContextFrame* caller_frame = getThreadFrame(gDwarfContext, 1);
+  if (frame == nullptr) {
+    return false;
+  }
+  // The load bias of the module, if the pc of the frame 0 is known.
+  uint64_t bias = 0;
+  if (frame->regs.size() > kArm64PcRegister) {
+    bias = frame->regs[kArm64PcRegister] - pc;
+  }
+  uint64_t return_addr = 0;
+  if (caller_frame != nullptr &&
+      caller_frame->regs.size() > kArm64PcRegister) {
+    return_addr = caller_frame->regs[kArm64PcRegister];
+  } else if (frame->regs.size() > kArm64LrRegister) {
+    return_addr = frame->regs[kArm64LrRegister];
+  } else {
+    return false;
+  }
+  Dwarf_Addr return_pc = return_addr - bias;
+
+  const DwarfCallSite* site = searcher->searchCallSite(return_pc, nullptr);
+  if (site == nullptr) {
+    return false;
+  }
+
+  Dwarf_Die cu_die = nullptr;
+  Dwarf_Die func_die = nullptr;
+  if (!getDieFromOffset(dbg, site->cu_offset, cu_die)) {
+    return false;
+  }
+  auto cu_die_guard =
+      make_scope_exit([&]() { dwarf_dealloc(dbg, cu_die, DW_DLA_DIE); });
+  if (!getDieFromOffset(dbg, site->func_offset, func_die)) {
+    return false;
+  }
+  std::unique_ptr<DwarfLocation> frame_base(
+      DwarfLocation::loadFromDieAttr(dbg, func_die, DW_AT_frame_base));
+  dwarf_dealloc(dbg, func_die, DW_DLA_DIE);
+
+  using namespace std::placeholders;
+  DwarfExpression::Context caller_ctx = {
+      .cuLowAddr = getAttrValueAddr(dbg, cu_die, DW_AT_low_pc, 0),
+      .cuHighAddr = getAttrValueAddr(dbg, cu_die, DW_AT_high_pc, 0),
+      .frameBaseLoc = frame_base.get(),
+      .registers = std::bind(frame_register_provider, 1, _1, _2),
+      .memory = std::bind(frame_memory_provider, 1, _1, _2, _3, _4),
+      .cfa = nullptr,
+      .tracer = tracer,
+      .entryValue = nullptr,  // the frame 1 is not resolved further
+      .baseType = [=](Dwarf_Off offset, DwarfBaseType* type) {
+        return searcher->getBaseType(site->cu_offset, offset, type, nullptr);
+      }};
+  DwarfExpression::CfaProvider cfa_provider =
+      std::bind(&DwarfFrames::GetCfa, &frames, caller_ctx, _1);
+  caller_ctx.cfa = cfa_provider;
+  return site->entryValue(reg, caller_ctx, return_pc, value);
+}
+
+void print_var(FILE* out, const DwarfExpression::Context& expr_ctx,
+               const DwarfVar* var, Dwarf_Addr pc, bool debug) {
   if (debug) {
     var->dump();
   }
   DwarfType* type = var->type();
   DwarfVar::DwarfValue value =
       gDwarfContext != nullptr ? var->evalValue(expr_ctx, pc) : "..";
-  printf("  %s %s (%zu bytes) = %s\n", type->name().c_str(),
-         var->name().c_str(), type->size(), value.c_str());
+  fprintf(out, "  %s %s (%zu bytes) = %s\n", type->name().c_str(),
+          var->name().c_str(), type->size(), value.c_str());
 }
 
-int main(int argc, char** argv) {
-  // parse args
-  std::string input;
-  std::string ctx_file;
-  bool eval_value = false;
+void print_file_line(FILE* out, const std::string& file_name,
+                     Dwarf_Unsigned line_number,
+                     Dwarf_Unsigned discriminator = 0) {
+  if (line_number == MAX_DWARF_UNSIGNED) {
+    fprintf(out, "%s:?\n", file_name.c_str());
+  } else if (discriminator != 0) {
+    // Same as addr2line
+    fprintf(out, "%s:%llu (discriminator %llu)\n", file_name.c_str(),
+            line_number, discriminator);
+  } else {
+    fprintf(out, "%s:%llu\n", file_name.c_str(), line_number);
+  }
+}
+
+/**
+ * @brief print the inlined functions of the pc like `addr2line -i`, from the
+ *        innermost to the outermost, the location of an outer function is the
+ *        call site of the inner one.
+ */
+void print_inline_chain(FILE* out, Dwarf_Debug dbg,
+                        const std::vector<InlineFrame>& frames,
+                        const DwarfFunctionResult& result,
+                        bool print_func_name, bool demangle) {
+  DwarfFileId file = result.file;
+  Dwarf_Unsigned line_number = result.line_number;
+  Dwarf_Unsigned discriminator = result.discriminator;
+  for (size_t i = frames.size(); i-- > 0;) {
+    if (print_func_name) {
+      std::string function_name = "?";
+      Dwarf_Die die = nullptr;
+      if (getDieFromOffset(dbg, frames[i].die_offset, die)) {
+        function_name = getFunctionName(dbg, die, demangle, "?");
+        dwarf_dealloc(dbg, die, DW_DLA_DIE);
+      }
+      fprintf(out, "%s\n", function_name.c_str());
+    }
+    print_file_line(out, DwarfFilePool::global()->path(file, "?"), line_number,
+                    discriminator);
+
+    // The caller of this level is shown at the call site.
+    file = frames[i].call_file;
+    line_number = frames[i].call_line;
+    discriminator = 0;
+  }
+}
+
+struct Options {
   bool print_func_name = false;
   bool demangle = false;
+  bool show_inlines = false;
   bool show_locals = false;
   bool show_params = false;
   bool print_cfi = false;
   bool debug = false;
+};
+
+/**
+ * @brief print everything asked by the options about one address
+ *
+ * @param machine the ELF machine of the module
+ * @param inlines the inline chain of the address if it is already known,
+ *        e.g. from the workers, otherwise it is searched for `-i`
+ */
+void symbolize_address(FILE* out, Dwarf_Debug dbg, uint16_t machine,
+                       DwarfSearcher* searcher, uint64_t address,
+                       const DwarfFunctionResult& result, const Options& opts,
+                       const std::vector<InlineFrame>* inlines = nullptr) {
+  Dwarf_Die cu_die = nullptr;
+  Dwarf_Die func_die = nullptr;
+  Dwarf_Error* errp = nullptr;
+  bool found = result.found &&
+               getDieFromOffset(dbg, result.cu_offset, cu_die) &&
+               getDieFromOffset(dbg, result.func_offset, func_die);
+  auto die_guard = make_scope_exit([&]() {
+    if (cu_die != nullptr) {
+      dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
+    }
+    if (func_die != nullptr) {
+      dwarf_dealloc(dbg, func_die, DW_DLA_DIE);
+    }
+  });
+  if (!found) {
+    fprintf(out, "Not found.\n");
+    return;
+  }
+
+  if (opts.debug) {
+    dumpDIE(dbg, cu_die);
+    dumpDIE(dbg, func_die);
+  }
+
+  if (opts.show_inlines) {
+    std::vector<InlineFrame> frames;
+    if (inlines == nullptr) {
+      searchInlineFrames(searcher, address, &frames);
+      inlines = &frames;
+    }
+    print_inline_chain(out, dbg, *inlines, result, opts.print_func_name,
+                       opts.demangle);
+  } else {
+    if (opts.print_func_name) {
+      std::string function_name =
+          getFunctionName(dbg, func_die, opts.demangle, "?");
+      fprintf(out, "%s\n", function_name.c_str());
+    }
+    print_file_line(out, DwarfFilePool::global()->path(result.file, "?"),
+                    result.line_number, result.discriminator);
+  }
+
+  if (!opts.show_locals && !opts.show_params && !opts.print_cfi) {
+    return;
+  }
+
+  // Get address size
+  Dwarf_Half addr_size = 0;
+  if (dwarf_get_die_address_size(func_die, &addr_size, errp) != DW_DLV_OK) {
+    fprintf(out, "Error: can not get address_size.\n");
+    return;
+  }
+
+  // Get offset size and version
+  Dwarf_Half offset_size = 0;
+  Dwarf_Half version = 2;
+  if (dwarf_get_version_of_die(func_die, &version, &offset_size) !=
+      DW_DLV_OK) {
+    fprintf(out, "Error: can not get version and offset_size.\n");
+    return;
+  }
+
+  DwarfFrames debug_frame(dbg, addr_size, offset_size, version);
+  DwarfPrintTracer tracer(stderr);
+  DwarfExpression::Context expr_ctx = {
+      .cuLowAddr = getAttrValueAddr(dbg, cu_die, DW_AT_low_pc, 0),
+      .cuHighAddr = getAttrValueAddr(dbg, cu_die, DW_AT_high_pc, 0),
+      .frameBaseLoc =
+          DwarfLocation::loadFromDieAttr(dbg, func_die, DW_AT_frame_base),
+      .registers = register_provider,
+      .memory = memory_provider,
+      .cfa = nullptr,
+      .tracer = opts.debug ? &tracer : nullptr,
+      .entryValue = nullptr,
+      .baseType = [&](Dwarf_Off offset, DwarfBaseType* type) {
+        return searcher->getBaseType(result.cu_offset, offset, type, nullptr);
+      }};
+  DwarfExpression::CfaProvider cfa_provider = std::bind(
+      &DwarfFrames::GetCfa, &debug_frame, expr_ctx, std::placeholders::_1);
+  expr_ctx.cfa = cfa_provider;
+  expr_ctx.entryValue = [&](uint32_t reg, uint64_t* value) {
+    return entry_value_provider(dbg, searcher, debug_frame, expr_ctx.tracer,
+                                machine, address, reg, value);
+  };
+
+  if (opts.show_locals || opts.show_params) {
+    void* ctx = nullptr;
+    std::vector<DwarfVar*> locals;
+    std::vector<DwarfVar*> params;
+
+    walkDIE(dbg, cu_die, func_die, 0, 1, ctx,
+            [&](Dwarf_Debug dbg, Dwarf_Die parent_die, Dwarf_Die child_die,
+                int cur_lv, int max_lv, void* ctxt) {
+              Dwarf_Error err = nullptr;
+              Dwarf_Half tag = 0;
+              if (dwarf_tag(child_die, &tag, &err) == DW_DLV_OK) {
+                if (tag == DW_TAG_variable || tag == DW_TAG_constant ||
+                    tag == DW_TAG_formal_parameter) {
+                  Dwarf_Off tag_offset;
+                  dwarf_dieoffset(child_die, &tag_offset, &err);
+
+                  const char* tag_name;
+                  dwarf_get_TAG_name(tag, &tag_name);
+
+                  DwarfVar* var = new DwarfVar(dbg, tag_offset);
+                  if (!var->load()) {
+                    fprintf(out, "Error: can not load var 0x%llx %s\n",
+                            tag_offset, tag_name);
+                    delete var;
+                    return;
+                  }
+
+                  if (tag == DW_TAG_formal_parameter) {
+                    params.emplace_back(var);
+                  } else {
+                    locals.emplace_back(var);
+                  }
+                }
+              }
+            });  // end walkDIE
+
+    fprintf(out, "params:\n");
+    for (const DwarfVar* var : params) {
+      print_var(out, expr_ctx, var, address, opts.debug);
+      delete var;
+      fprintf(out, "\n");
+    }
+
+    fprintf(out, "locals:\n");
+    for (const DwarfVar* var : locals) {
+      print_var(out, expr_ctx, var, address, opts.debug);
+      delete var;
+      fprintf(out, "\n");
+    }
+  }
+
+  if (opts.print_cfi) {
+    Dwarf_Addr cfa = debug_frame.GetCfa(expr_ctx, address);
+    fprintf(out, "cfa: 0x%llx\n", cfa);
+  }
+}
+
+/**
+ * @brief load the dwarf context file into `gDwarfContext`
+ */
+bool load_context(const std::string& ctx_file, bool dump) {
+  delete gDwarfContext;
+  gDwarfContext = new DwarfContext();
+  if (!load_dwarf_context_file(ctx_file.c_str(), gDwarfContext)) {
+    fprintf(stderr, "Error: can not load dwarf contxt file: %s\n",
+            ctx_file.c_str());
+    delete gDwarfContext;
+    gDwarfContext = nullptr;
+    return false;
+  }
+  if (dump) {
+    dump_dwarf_context(gDwarfContext);
+  }
+  return true;
+}
+
+/**
+ * @brief map the index of the store, build it first if needed
+ */
+bool open_symbol_store(SymbolStore* store, const std::string& store_dir,
+                       std::string index_path, bool rebuild) {
+  if (index_path.empty()) {
+    index_path = store_dir + "/dwarf2line.index";
+  }
+  if (rebuild || access(index_path.c_str(), F_OK) != 0) {
+    int count = SymbolStore::buildIndex(store_dir, index_path);
+    if (count < 0) {
+      printf("Error: can not index the symbol store %s\n", store_dir.c_str());
+      return false;
+    }
+    fprintf(stderr, "Indexed %d files of %s\n", count, store_dir.c_str());
+  }
+  if (!store->open(store_dir, index_path)) {
+    printf("Error: can not open the symbol store index %s\n",
+           index_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief get the file of a module, which is either a path or the hex build-id
+ *        of a file in the symbol store.
+ */
+std::string resolve_module(const SymbolStore& store, const std::string& name) {
+  std::vector<uint8_t> build_id;
+  std::string path;
+  if (store.size() > 0 && access(name.c_str(), F_OK) != 0 &&
+      buildIdFromHex(name, &build_id) && store.lookup(build_id, &path)) {
+    return path;
+  }
+  return name;
+}
+
+/**
+ * @brief answer the requests of `--serve`, the modules stay open between the
+ *        requests.
+ */
+void handle_serve_request(ModuleManager* modules, const SymbolStore& store,
+                          const Options& opts, const ServeRequest& request,
+                          FILE* out) {
+  Module* module = modules->get(resolve_module(store, request.module));
+  if (module == nullptr) {
+    fprintf(out, "Error: can not open module %s\n", request.module.c_str());
+    return;
+  }
+
+  Options request_opts = opts;
+  if (!request.ctx_file.empty()) {
+    if (!load_context(request.ctx_file, false /* dump */)) {
+      fprintf(out, "Error: can not load dwarf context file: %s\n",
+              request.ctx_file.c_str());
+      return;
+    }
+    request_opts.show_locals = true;
+    request_opts.show_params = true;
+  }
+
+  std::vector<DwarfFunctionResult> results =
+      module->searcher->searchFunctions({request.address}, nullptr);
+  symbolize_address(out, module->dbg, module->machine, module->searcher.get(),
+                    request.address, results.front(), request_opts);
+
+  // The context belongs to this request only.
+  delete gDwarfContext;
+  gDwarfContext = nullptr;
+}
+
+/**
+ * @brief print the address ranges of `<file>:<line>` queries, from an index
+ *        of all the line tables built with `jobs` threads.
+ */
+bool lookup_source_lines(const std::string& input, int jobs,
+                         const std::vector<std::string>& queries) {
+  SymbolizerPool pool(input, jobs);
+  DwarfLineIndex index;
+  if (!pool.init() || !pool.buildLineIndex(&index)) {
+    printf("Error: can not index the line tables of %s\n", input.c_str());
+    return false;
+  }
+
+  std::vector<DwarfLineAddrRange> ranges;
+  for (const std::string& query : queries) {
+    size_t colon = query.rfind(':');
+    char* end = nullptr;
+    unsigned long line =
+        colon != std::string::npos ? strtoul(&query[colon + 1], &end, 10) : 0;
+    if (colon == std::string::npos || end == &query[colon + 1] || *end) {
+      printf("Error: expect `<file>:<line>`: %s\n", query.c_str());
+      continue;
+    }
+
+    bool found = false;
+    for (DwarfFileId file : index.findFiles(query.substr(0, colon))) {
+      if (!index.find(file, static_cast<uint32_t>(line), &ranges)) {
+        continue;
+      }
+      found = true;
+      printf("%s:%lu\n", DwarfFilePool::global()->path(file, "?").c_str(),
+             line);
+      for (const DwarfLineAddrRange& range : ranges) {
+        printf("  0x%llx-0x%llx\n", range.low, range.high);
+      }
+    }
+    if (!found) {
+      printf("Not found.\n");
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief symbolize the addresses from a symcache file, libdwarf is not used.
+ */
+bool symbolize_with_symcache(const std::string& symcache_file,
+                             const std::string& input,
+                             const std::vector<uint64_t>& addresses,
+                             bool print_func_name, bool show_inlines) {
+  DwarfSymcache symcache;
+  if (!symcache.open(symcache_file)) {
+    printf("Error: can not load symcache file: %s\n", symcache_file.c_str());
+    return false;
+  }
+  if (!input.empty()) {
+    std::vector<uint8_t> build_id;
+    readElfBuildId(input, &build_id);
+    if (build_id != symcache.buildId()) {
+      printf("Error: build-id mismatch, %s: %s, %s: %s\n", input.c_str(),
+             buildIdToHex(build_id).c_str(), symcache_file.c_str(),
+             buildIdToHex(symcache.buildId()).c_str());
+      return false;
+    }
+  }
+
+  std::vector<DwarfSymcacheFrame> frames;
+  for (uint64_t address : addresses) {
+    if (!symcache.lookupFunctions(address, &frames)) {
+      printf("Not found.\n");
+      continue;
+    }
+    const char* file = "?";
+    uint32_t line = 0;
+    Dwarf_Unsigned line_number = MAX_DWARF_UNSIGNED;
+    if (symcache.lookupLine(address, &file, &line)) {
+      line_number = line;
+    }
+
+    if (!show_inlines) {
+      if (print_func_name) {
+        printf("%s\n", frames.front().name);
+      }
+      print_file_line(stdout, file, line_number);
+      continue;
+    }
+    // Like print_inline_chain(), from the innermost to the outermost.
+    std::string file_name = file;
+    for (size_t i = frames.size(); i-- > 0;) {
+      if (print_func_name) {
+        printf("%s\n", frames[i].name);
+      }
+      print_file_line(stdout, file_name, line_number);
+      file_name = frames[i].call_file != nullptr ? frames[i].call_file : "?";
+      line_number = frames[i].call_line;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  // parse args
+  std::string input;
+  std::string ctx_file;
+  bool eval_value = false;
+  Options opts;
+  int jobs = 1;
+  std::string build_symcache_file;
+  std::string symcache_file;
+  bool serve = false;
+  std::string socket_path;
+  size_t memory_budget_mb = 0;
+  std::vector<std::string> lookup_lines;
+  std::string store_dir;
+  std::string store_index;
+  bool rebuild_store_index = false;
   std::vector<uint64_t> addresses;
   for (int i = 1; i < argc; ++i) {
     if (!strcmp(argv[i], "-e") || !strcmp(argv[i], "--exe")) {
@@ -134,20 +665,91 @@ int main(int argc, char** argv) {
       }
       ctx_file = argv[i];
       eval_value = true;
-      show_locals = true;
-      show_params = true;
+      opts.show_locals = true;
+      opts.show_params = true;
+    } else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+      ++i;
+      if (i >= argc) {
+        printf("Error: missing the value of `-j` arg.\n");
+        printf("%s", USAGE);
+        return -1;
+      }
+      jobs = std::max(1, atoi(argv[i]));
+    } else if (!strcmp(argv[i], "--build-symcache")) {
+      ++i;
+      if (i >= argc) {
+        printf("Error: missing the value of `--build-symcache` arg.\n");
+        printf("%s", USAGE);
+        return -1;
+      }
+      build_symcache_file = argv[i];
+    } else if (!strcmp(argv[i], "--symcache")) {
+      ++i;
+      if (i >= argc) {
+        printf("Error: missing the value of `--symcache` arg.\n");
+        printf("%s", USAGE);
+        return -1;
+      }
+      symcache_file = argv[i];
+    } else if (!strcmp(argv[i], "--serve")) {
+      serve = true;
+    } else if (!strcmp(argv[i], "--socket")) {
+      ++i;
+      if (i >= argc) {
+        printf("Error: missing the value of `--socket` arg.\n");
+        printf("%s", USAGE);
+        return -1;
+      }
+      socket_path = argv[i];
+      serve = true;
+    } else if (!strcmp(argv[i], "--lookup-line")) {
+      ++i;
+      if (i >= argc) {
+        printf("Error: missing the value of `--lookup-line` arg.\n");
+        printf("%s", USAGE);
+        return -1;
+      }
+      lookup_lines.emplace_back(argv[i]);
+    } else if (!strcmp(argv[i], "--symbol-store")) {
+      ++i;
+      if (i >= argc) {
+        printf("Error: missing the value of `--symbol-store` arg.\n");
+        printf("%s", USAGE);
+        return -1;
+      }
+      store_dir = argv[i];
+    } else if (!strcmp(argv[i], "--store-index")) {
+      ++i;
+      if (i >= argc) {
+        printf("Error: missing the value of `--store-index` arg.\n");
+        printf("%s", USAGE);
+        return -1;
+      }
+      store_index = argv[i];
+    } else if (!strcmp(argv[i], "--build-store-index")) {
+      rebuild_store_index = true;
+    } else if (!strcmp(argv[i], "--memory-budget")) {
+      ++i;
+      if (i >= argc) {
+        printf("Error: missing the value of `--memory-budget` arg.\n");
+        printf("%s", USAGE);
+        return -1;
+      }
+      memory_budget_mb = strtoul(argv[i], nullptr, 10);
     } else if (!strcmp(argv[i], "-F") || !strcmp(argv[i], "--frames")) {
-      print_cfi = true;
+      opts.print_cfi = true;
     } else if (!strcmp(argv[i], "-l") || !strcmp(argv[i], "--locals")) {
-      show_locals = true;
+      opts.show_locals = true;
     } else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--params")) {
-      show_params = true;
+      opts.show_params = true;
     } else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--functions")) {
-      print_func_name = true;
+      opts.print_func_name = true;
     } else if (!strcmp(argv[i], "-C") || !strcmp(argv[i], "--demangle")) {
-      demangle = true;
+      opts.demangle = true;
+    } else if (!strcmp(argv[i], "-i") || !strcmp(argv[i], "--inlines")) {
+      opts.show_inlines = true;
     } else if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--verbose")) {
-      debug = true;
+      opts.debug = true;
     } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
       printf("%s", USAGE);
       return 0;
@@ -158,17 +760,52 @@ int main(int argc, char** argv) {
       addresses.emplace_back(addr);
     }
   }
-  if (input.empty()) {
+
+  SymbolStore store;
+  if (!store_dir.empty()) {
+    if (!open_symbol_store(&store, store_dir, store_index,
+                           rebuild_store_index)) {
+      return -1;
+    }
+    if (!input.empty()) {
+      input = resolve_module(store, input);
+    } else if (rebuild_store_index && !serve) {
+      return 0;  // only index the store
+    }
+  }
+
+  if (serve) {
+    // The module of each request is given in the request itself.
+    ModuleManager modules(memory_budget_mb << 20);
+    ServeHandler handler = [&](const ServeRequest& request, FILE* out) {
+      handle_serve_request(&modules, store, opts, request, out);
+    };
+    if (socket_path.empty()) {
+      serve_stream(stdin, stdout, handler);
+      return 0;
+    }
+    return serve_unix_socket(socket_path, handler) ? 0 : -1;
+  }
+
+  if (input.empty() && symcache_file.empty()) {
     printf("Error: missing the input `-e` arg.\n");
     printf("%s", USAGE);
     return -1;
   }
-  if (addresses.empty()) {
+  if (addresses.empty() && build_symcache_file.empty() &&
+      lookup_lines.empty()) {
     printf("Error: missing address arg.\n");
     printf("%s", USAGE);
     return -1;
   }
 
+  if (!symcache_file.empty()) {
+    return symbolize_with_symcache(symcache_file, input, addresses,
+                                   opts.print_func_name, opts.show_inlines)
+               ? 0
+               : -1;
+  }
+
   Dwarf_Debug dbg = nullptr;
 #define PATH_LEN 2000
   char real_path[PATH_LEN];
@@ -193,139 +830,58 @@ int main(int argc, char** argv) {
     exit(EXIT_FAILURE);
   }
 
-  if (eval_value) {
-    gDwarfContext = new DwarfContext();
-    if (!load_dwarf_context_file(ctx_file.c_str(), gDwarfContext)) {
-      printf("Error: can not load dwarf contxt file: %s\n", ctx_file.c_str());
-      delete gDwarfContext;
-      gDwarfContext = nullptr;
-      // DO NOT return, keep going
+  if (!build_symcache_file.empty()) {
+    std::vector<uint8_t> build_id;
+    if (!readElfBuildId(input, &build_id)) {
+      printf("Warning: no build-id in %s\n", input.c_str());
     }
-    if (gDwarfContext) {
-      dump_dwarf_context(gDwarfContext);
+    DwarfSymcacheBuilder builder(dbg);
+    bool ok = builder.build(nullptr) &&
+              builder.write(build_symcache_file, build_id);
+    if (!ok) {
+      printf("Error: can not build symcache %s\n", build_symcache_file.c_str());
     }
+    dwarf_finish(dbg);
+    return ok ? 0 : -1;
   }
 
-  DwarfSearcher searcher(dbg);
-  for (uint64_t address : addresses) {
-    Dwarf_Die cu_die;
-    Dwarf_Die func_die;
-    Dwarf_Error* errp = nullptr;
-    bool found = searcher.searchFunction(address, &cu_die, &func_die, errp);
-    if (found) {
-      if (debug) {
-        dumpDIE(dbg, cu_die);
-        dumpDIE(dbg, func_die);
-      }
-
-      if (print_func_name) {
-        std::string function_name =
-            getFunctionName(dbg, func_die, demangle, "?");
-        printf("%s\n", function_name.c_str());
-      }
-
-      std::pair<std::string, Dwarf_Unsigned> file_line =
-          getFileNameAndLineNumber(dbg, cu_die, address, "?",
-                                   MAX_DWARF_UNSIGNED);
-      std::string file_name = file_line.first;
-      Dwarf_Unsigned line_number = file_line.second;
-      if (line_number != MAX_DWARF_UNSIGNED) {
-        printf("%s:%llu\n", file_name.c_str(), line_number);
-      } else {
-        printf("%s:?\n", file_name.c_str());
-      }
-
-      // Get address size
-      Dwarf_Half addr_size = 0;
-      if (dwarf_get_die_address_size(func_die, &addr_size, errp) != DW_DLV_OK) {
-        printf("Error: can not get address_size.\n");
-        continue;
-      }
-
-      // Get offset size and version
-      Dwarf_Half offset_size = 0;
-      Dwarf_Half version = 2;
-      if (dwarf_get_version_of_die(func_die, &version, &offset_size) !=
-          DW_DLV_OK) {
-        printf("Error: can not get version and offset_size.\n");
-        continue;
-      }
+  if (!lookup_lines.empty()) {
+    bool ok = lookup_source_lines(input, jobs, lookup_lines);
+    if (addresses.empty()) {
+      dwarf_finish(dbg);
+      return ok ? 0 : -1;
+    }
+  }
 
-      DwarfFrames debug_frame(dbg, addr_size, offset_size, version);
-      DwarfExpression::Context expr_ctx = {
-          .cuLowAddr = getAttrValueAddr(dbg, cu_die, DW_AT_low_pc, 0),
-          .cuHighAddr = getAttrValueAddr(dbg, cu_die, DW_AT_high_pc, 0),
-          .frameBaseLoc =
-              DwarfLocation::loadFromDieAttr(dbg, func_die, DW_AT_frame_base),
-          .registers = register_provider,
-          .memory = memory_provider,
-          .cfa = nullptr};
-      DwarfExpression::CfaProvider cfa_provider = std::bind(
-          &DwarfFrames::GetCfa, &debug_frame, expr_ctx, std::placeholders::_1);
-      expr_ctx.cfa = cfa_provider;
-
-      if (show_locals || show_params) {
-        void* ctx = nullptr;
-        std::vector<DwarfVar*> locals;
-        std::vector<DwarfVar*> params;
-
-        walkDIE(dbg, cu_die, func_die, 0, 1, ctx,
-                [&](Dwarf_Debug dbg, Dwarf_Die parent_die, Dwarf_Die child_die,
-                    int cur_lv, int max_lv, void* ctxt) {
-                  Dwarf_Error err = nullptr;
-                  Dwarf_Half tag = 0;
-                  if (dwarf_tag(child_die, &tag, &err) == DW_DLV_OK) {
-                    if (tag == DW_TAG_variable || tag == DW_TAG_constant ||
-                        tag == DW_TAG_formal_parameter) {
-                      Dwarf_Off tag_offset;
-                      dwarf_dieoffset(child_die, &tag_offset, &error);
-
-                      const char* tag_name;
-                      dwarf_get_TAG_name(tag, &tag_name);
-
-                      DwarfVar* var = new DwarfVar(dbg, tag_offset);
-                      if (!var->load()) {
-                        printf("Error: can not load var 0x%llx %s\n",
-                               tag_offset, tag_name);
-                        delete var;
-                        return;
-                      }
-
-                      if (tag == DW_TAG_formal_parameter) {
-                        params.emplace_back(var);
-                      } else {
-                        locals.emplace_back(var);
-                      }
-                    }
-                  }
-                });  // end walkDIE
-
-        printf("params:\n");
-        for (const DwarfVar* var : params) {
-          print_var(expr_ctx, var, address, debug);
-          delete var;
-          printf("\n");
-        }
-
-        printf("locals:\n");
-        for (const DwarfVar* var : locals) {
-          print_var(expr_ctx, var, address, debug);
-          delete var;
-          printf("\n");
-        }
-      }
+  if (eval_value) {
+    // DO NOT return if failed, keep going
+    load_context(ctx_file, true /* dump */);
+  }
 
-      if (print_cfi) {
-        Dwarf_Addr cfa = debug_frame.GetCfa(expr_ctx, address);
-        printf("cfa: 0x%llx\n", cfa);
-      }
+  uint16_t machine = 0;
+  readElfMachine(input, &machine);
 
-      dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
-      dwarf_dealloc(dbg, func_die, DW_DLA_DIE);
-    } else {
-      printf("Not found.\n");
+  DwarfSearcher searcher(dbg);
+  std::vector<Dwarf_Addr> pcs(addresses.begin(), addresses.end());
+  std::vector<DwarfFunctionResult> results;
+  std::vector<std::vector<InlineFrame>> inlines;
+  if (jobs > 1) {
+    // Every worker has its own Dwarf_Debug, the results are DIE offsets and
+    // file ids which are valid for `dbg` too. The workers also search the
+    // inline chains, which load the function and line tables of the CUs.
+    SymbolizerPool pool(input, jobs);
+    if (pool.init()) {
+      results = pool.symbolize(pcs, opts.show_inlines ? &inlines : nullptr);
     }
   }
+  if (results.empty()) {
+    results = searcher.searchFunctions(pcs, nullptr);
+  }
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    symbolize_address(stdout, dbg, machine, &searcher, addresses[i],
+                      results[i], opts,
+                      inlines.empty() ? nullptr : &inlines[i]);
+  }
 
   if (gDwarfContext) {
     delete gDwarfContext;
@@ -335,4 +891,4 @@ int main(int argc, char** argv) {
     printf("dwarf_finish failed!\n");
   }
   return 0;
-}
\ No newline at end of file
+}
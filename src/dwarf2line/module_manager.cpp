@@ -0,0 +1,120 @@
+#include "module_manager.h"
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <vector>
+
+#include "dwarfexpr/elf_utils.h"
+
+using namespace dwarfexpr;
+
+namespace dwarf2line {
+
+ModuleManager::~ModuleManager() {
+  for (auto& module : lru_) {
+    close(module.get());
+  }
+}
+
+void ModuleManager::close(Module* module) {
+  module->searcher.reset();  // must be freed before the dbg
+  if (module->dbg != nullptr) {
+    dwarf_finish(module->dbg);
+    module->dbg = nullptr;
+  }
+}
+
+std::unique_ptr<Module> ModuleManager::open(const std::string& path,
+                                            const std::string& key) {
+#define PATH_LEN 2000
+  char real_path[PATH_LEN];
+  std::unique_ptr<Module> module(new Module());
+  Dwarf_Error error = nullptr;
+  int res = dwarf_init_path(path.c_str(), real_path, PATH_LEN,
+                            DW_GROUPNUMBER_ANY, nullptr, nullptr, &module->dbg,
+                            &error);
+#undef PATH_LEN
+  if (res != DW_DLV_OK) {
+    if (res == DW_DLV_ERROR) {
+      fprintf(stderr, "Error: can not open %s: %s\n", path.c_str(),
+              dwarf_errmsg(error));
+      dwarf_dealloc_error(module->dbg, error);
+    }
+    return nullptr;
+  }
+  module->path = path;
+  module->key = key;
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0) {
+    module->file_size = static_cast<size_t>(st.st_size);
+  }
+  readElfMachine(path, &module->machine);
+  module->searcher.reset(new DwarfSearcher(module->dbg));
+  return module;
+}
+
+void ModuleManager::evict(const Module* keep) {
+  if (memory_budget_ == 0) {
+    return;
+  }
+  // The indexes grow while the modules are used, so the usage is summed up
+  // again every time.
+  size_t total = 0;
+  for (const auto& module : lru_) {
+    total += module->memoryUsage();
+  }
+  auto it = lru_.end();
+  while (total > memory_budget_ && it != lru_.begin()) {
+    --it;
+    if (it->get() == keep) {
+      continue;
+    }
+    total -= (*it)->memoryUsage();
+    close(it->get());
+    // Forget the paths of the module too, the files may be replaced before
+    // they are requested again.
+    for (auto key_it = keys_.begin(); key_it != keys_.end();) {
+      if (key_it->second == (*it)->key) {
+        key_it = keys_.erase(key_it);
+      } else {
+        ++key_it;
+      }
+    }
+    modules_.erase((*it)->key);
+    it = lru_.erase(it);
+  }
+}
+
+Module* ModuleManager::get(const std::string& path) {
+  auto key_it = keys_.find(path);
+  if (key_it == keys_.end()) {
+    std::vector<uint8_t> build_id;
+    std::string key = readElfBuildId(path, &build_id)
+                          ? buildIdToHex(build_id)
+                          : "path:" + path;
+    key_it = keys_.emplace(path, key).first;
+  }
+  const std::string& key = key_it->second;
+
+  Module* module = nullptr;
+  auto it = modules_.find(key);
+  if (it != modules_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);  // mark as recently used
+    module = lru_.front().get();
+  } else {
+    std::unique_ptr<Module> opened = open(path, key);
+    if (opened == nullptr) {
+      keys_.erase(key_it);
+      return nullptr;
+    }
+    lru_.emplace_front(std::move(opened));
+    modules_.emplace(key, lru_.begin());
+    module = lru_.front().get();
+  }
+
+  evict(module);
+  return module;
+}
+
+}  // namespace dwarf2line
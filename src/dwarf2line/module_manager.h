@@ -0,0 +1,79 @@
+#ifndef DWARF2LINE_MODULE_MANAGER_H
+#define DWARF2LINE_MODULE_MANAGER_H
+
+#include <libdwarf/dwarf.h>
+#include <libdwarf/libdwarf.h>
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "dwarfexpr/dwarf_searcher.h"
+
+namespace dwarf2line {
+
+struct Module {
+  std::string path;
+  std::string key;       // hex build-id, or the path if there is none
+  size_t file_size = 0;  // bytes of the ELF file, libdwarf loads its sections
+  uint16_t machine = 0;  // e_machine of the ELF file, 0 if unknown
+  Dwarf_Debug dbg = nullptr;
+  std::unique_ptr<dwarfexpr::DwarfSearcher> searcher;
+
+  // Approximate memory held by the module.
+  size_t memoryUsage() const {
+    return file_size + (searcher ? searcher->memoryUsage() : 0);
+  }
+};
+
+/**
+ * @brief Keep the modules opened on demand, so the `Dwarf_Debug` handles and
+ *        the indexes of the `DwarfSearcher` stay warm between requests.
+ *
+ * The modules are keyed by GNU build-id, so the same library reached through
+ * different paths is opened once. The least recently used modules are closed
+ * when the memory of the open ones exceeds the budget.
+ */
+class ModuleManager {
+ public:
+  /**
+   * @param memory_budget max bytes of the open modules, 0 for no limit. The
+   *        module in use is never evicted, even if it alone exceeds it.
+   */
+  explicit ModuleManager(size_t memory_budget = 0)
+      : memory_budget_(memory_budget) {}
+  ~ModuleManager();
+
+  ModuleManager(const ModuleManager&) = delete;
+  ModuleManager& operator=(const ModuleManager&) = delete;
+
+  /**
+   * @brief get the module of the file, open it on the first call
+   *
+   * The returned module stays valid until the next call.
+   *
+   * @return nullptr if the file can not be opened
+   */
+  Module* get(const std::string& path);
+
+  size_t size() const { return lru_.size(); }
+
+ private:
+  using ModuleList = std::list<std::unique_ptr<Module>>;
+
+  std::unique_ptr<Module> open(const std::string& path,
+                               const std::string& key);
+  void evict(const Module* keep);
+  static void close(Module* module);
+
+  size_t memory_budget_;
+  ModuleList lru_;  // the most recently used first
+  std::unordered_map<std::string, ModuleList::iterator> modules_;  // by key
+  std::unordered_map<std::string, std::string> keys_;  // key of each path
+};  // class ModuleManager
+
+}  // namespace dwarf2line
+
+#endif  // DWARF2LINE_MODULE_MANAGER_H
@@ -0,0 +1,115 @@
+#include "server.h"
+
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>  // strtoull
+#include <sstream>
+
+namespace dwarf2line {
+
+bool parse_serve_request(const std::string& line, ServeRequest* request,
+                         std::string* error) {
+  std::istringstream iss(line);
+  std::string address;
+  if (!(iss >> request->module >> address)) {
+    *error = "expect `<module> <address>[ <context file>]`";
+    return false;
+  }
+  char* end = nullptr;
+  request->address = strtoull(address.c_str(), &end, 16);
+  if (end == address.c_str() || *end != '\0') {
+    *error = "invalid address: " + address;
+    return false;
+  }
+  request->ctx_file.clear();
+  iss >> request->ctx_file;
+  return true;
+}
+
+void serve_stream(FILE* in, FILE* out, const ServeHandler& handler) {
+  char* line = nullptr;
+  size_t line_cap = 0;
+  ssize_t line_len = 0;
+  while ((line_len = getline(&line, &line_cap, in)) >= 0) {
+    std::string text(line, line_len);
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+      text.pop_back();
+    }
+    if (text.empty()) {
+      continue;
+    }
+
+    ServeRequest request;
+    std::string error;
+    if (parse_serve_request(text, &request, &error)) {
+      handler(request, out);
+    } else {
+      fprintf(out, "Error: %s\n", error.c_str());
+    }
+    fprintf(out, "\n");  // end of the response
+    fflush(out);
+  }
+  free(line);
+}
+
+bool serve_unix_socket(const std::string& path, const ServeHandler& handler) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Error: socket path is too long: %s\n", path.c_str());
+    return false;
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server_fd < 0) {
+    perror("socket");
+    return false;
+  }
+  unlink(path.c_str());  // remove the stale socket file
+  if (bind(server_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(server_fd, 16) != 0) {
+    perror("bind");
+    close(server_fd);
+    return false;
+  }
+  // A client closing its connection early must not kill the server.
+  signal(SIGPIPE, SIG_IGN);
+
+  // The modules are not thread-safe, serve the clients one at a time.
+  while (true) {
+    int client_fd = accept(server_fd, nullptr, nullptr);
+    if (client_fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("accept");
+      break;
+    }
+    FILE* in = fdopen(client_fd, "r");
+    FILE* out = fdopen(dup(client_fd), "w");
+    if (in != nullptr && out != nullptr) {
+      serve_stream(in, out, handler);
+    }
+    if (out != nullptr) {
+      fclose(out);
+    }
+    if (in != nullptr) {
+      fclose(in);
+    } else {
+      close(client_fd);
+    }
+  }
+
+  close(server_fd);
+  unlink(path.c_str());
+  return true;
+}
+
+}  // namespace dwarf2line
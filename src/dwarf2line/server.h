@@ -0,0 +1,42 @@
+#ifndef DWARF2LINE_SERVER_H
+#define DWARF2LINE_SERVER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+namespace dwarf2line {
+
+// One request per line: `<module> <address>[ <context file>]`
+struct ServeRequest {
+  std::string module;
+  uint64_t address;
+  std::string ctx_file;  // optional
+};
+
+// Write the response of the request to `out`.
+using ServeHandler =
+    std::function<void(const ServeRequest& request, FILE* out)>;
+
+bool parse_serve_request(const std::string& line, ServeRequest* request,
+                         std::string* error);
+
+/**
+ * @brief serve the requests read from `in` until EOF
+ *
+ * Every response ends with an empty line, so that the client knows where it
+ * stops, like llvm-symbolizer.
+ */
+void serve_stream(FILE* in, FILE* out, const ServeHandler& handler);
+
+/**
+ * @brief listen on a Unix domain socket and serve the connections one by one
+ *
+ * @return false if the socket can not be created
+ */
+bool serve_unix_socket(const std::string& path, const ServeHandler& handler);
+
+}  // namespace dwarf2line
+
+#endif  // DWARF2LINE_SERVER_H
@@ -0,0 +1,221 @@
+#include "symbolizer_pool.h"
+
+#include <algorithm>  // std::stable_sort
+#include <cstdio>
+#include <functional>  // std::cref
+#include <thread>
+
+#include "dwarfexpr/dwarf_utils.h"  // MAX_DWARF_UNSIGNED
+
+using namespace dwarfexpr;
+
+namespace dwarf2line {
+
+bool searchInlineFrames(DwarfSearcher* searcher, Dwarf_Addr pc,
+                        std::vector<InlineFrame>* out_frames) {
+  out_frames->clear();
+  Dwarf_Off cu_offset = 0;
+  std::vector<DwarfInlineFrame> frames;
+  if (!searcher->searchInlineChain(pc, &cu_offset, &frames, nullptr)) {
+    return false;
+  }
+  for (size_t i = 0; i < frames.size(); ++i) {
+    // The outermost subprogram is not called from this CU.
+    DwarfFileId call_file =
+        i == 0 ? kDwarfNoFileId
+               : searcher->getFileId(cu_offset, frames[i].call_file, nullptr);
+    out_frames->push_back(
+        {frames[i].die_offset, call_file, frames[i].call_line});
+  }
+  return true;
+}
+
+SymbolizerPool::SymbolizerPool(const std::string& path, int num_workers,
+                               size_t batch_size)
+    : path_(path),
+      num_workers_(num_workers > 0 ? num_workers : 1),
+      batch_size_(batch_size > 0 ? batch_size : 1) {}
+
+SymbolizerPool::~SymbolizerPool() {
+  for (auto& worker : workers_) {
+    worker->searcher.reset();  // must be freed before the dbg
+    if (worker->dbg != nullptr) {
+      dwarf_finish(worker->dbg);
+    }
+  }
+}
+
+bool SymbolizerPool::init() {
+#define PATH_LEN 2000
+  char real_path[PATH_LEN];
+  for (int i = 0; i < num_workers_; ++i) {
+    std::unique_ptr<Worker> worker(new Worker());
+    Dwarf_Error error = nullptr;
+    int res = dwarf_init_path(path_.c_str(), real_path, PATH_LEN,
+                              DW_GROUPNUMBER_ANY, nullptr, nullptr,
+                              &worker->dbg, &error);
+    if (res != DW_DLV_OK) {
+      if (res == DW_DLV_ERROR) {
+        printf("Error: worker %d can not open %s: %s\n", i, path_.c_str(),
+               dwarf_errmsg(error));
+        dwarf_dealloc_error(worker->dbg, error);
+      }
+      return false;
+    }
+    worker->searcher.reset(new DwarfSearcher(worker->dbg));
+    workers_.emplace_back(std::move(worker));
+  }
+#undef PATH_LEN
+  return true;
+}
+
+bool SymbolizerPool::popBatch(int worker_id, Batch* out_batch) {
+  Worker& worker = *workers_[worker_id];
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  if (worker.queue.empty()) {
+    return false;
+  }
+  *out_batch = worker.queue.front();
+  worker.queue.pop_front();
+  return true;
+}
+
+bool SymbolizerPool::stealBatch(int worker_id, Batch* out_batch) {
+  int n = static_cast<int>(workers_.size());
+  for (int i = 1; i < n; ++i) {
+    Worker& victim = *workers_[(worker_id + i) % n];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.queue.empty()) {
+      // Steal from the back, far from where the owner is working.
+      *out_batch = victim.queue.back();
+      victim.queue.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void SymbolizerPool::runWorker(int worker_id,
+                               const std::vector<Dwarf_Addr>& pcs,
+                               const std::vector<size_t>& order,
+                               std::vector<DwarfFunctionResult>* results,
+                               std::vector<std::vector<InlineFrame>>* inlines) {
+  Worker& worker = *workers_[worker_id];
+  std::vector<Dwarf_Addr> batch_pcs;
+  Batch batch;
+  // All the batches are queued before the workers start, so the work is done
+  // once every queue is empty.
+  while (popBatch(worker_id, &batch) || stealBatch(worker_id, &batch)) {
+    batch_pcs.clear();
+    for (size_t i = batch.begin; i < batch.end; ++i) {
+      batch_pcs.push_back(pcs[order[i]]);
+    }
+    std::vector<DwarfFunctionResult> batch_results =
+        worker.searcher->searchFunctions(batch_pcs, nullptr);
+    // Each index belongs to exactly one batch, no lock is needed.
+    for (size_t i = batch.begin; i < batch.end; ++i) {
+      (*results)[order[i]] = std::move(batch_results[i - batch.begin]);
+      if (inlines != nullptr) {
+        searchInlineFrames(worker.searcher.get(), pcs[order[i]],
+                           &(*inlines)[order[i]]);
+      }
+    }
+  }
+}
+
+std::vector<DwarfFunctionResult> SymbolizerPool::symbolize(
+    const std::vector<Dwarf_Addr>& pcs,
+    std::vector<std::vector<InlineFrame>>* out_inlines) {
+  std::vector<DwarfFunctionResult> results(
+      pcs.size(), {false, 0, 0, kDwarfNoFileId, MAX_DWARF_UNSIGNED, 0, 0});
+  if (out_inlines != nullptr) {
+    out_inlines->assign(pcs.size(), std::vector<InlineFrame>());
+  }
+  if (pcs.empty() || workers_.empty()) {
+    return results;
+  }
+
+  // Sort the pcs, so that a batch covers as few CUs as possible.
+  std::vector<size_t> order(pcs.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return pcs[a] < pcs[b]; });
+
+  // Give each worker a contiguous run of batches.
+  size_t num_batches = (pcs.size() + batch_size_ - 1) / batch_size_;
+  size_t n = workers_.size();
+  for (size_t b = 0; b < num_batches; ++b) {
+    size_t begin = b * batch_size_;
+    Batch batch = {begin, std::min(pcs.size(), begin + batch_size_)};
+    workers_[b * n / num_batches]->queue.push_back(batch);
+  }
+
+  if (n == 1) {
+    runWorker(0, pcs, order, &results, out_inlines);
+    return results;
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    threads.emplace_back(&SymbolizerPool::runWorker, this, static_cast<int>(i),
+                         std::cref(pcs), std::cref(order), &results,
+                         out_inlines);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return results;
+}
+
+void SymbolizerPool::indexLines(int worker_id,
+                                const std::vector<Dwarf_Off>& cu_offsets,
+                                std::atomic<size_t>* next_cu,
+                                DwarfLineIndex* out_index) {
+  Worker& worker = *workers_[worker_id];
+  // The CUs are claimed one by one, a big CU does not hold back the others.
+  for (size_t i = (*next_cu)++; i < cu_offsets.size(); i = (*next_cu)++) {
+    Dwarf_Die cu_die = nullptr;
+    if (dwarf_offdie_b(worker.dbg, cu_offsets[i], 1 /* is_info */, &cu_die,
+                       nullptr) != DW_DLV_OK) {
+      continue;
+    }
+    DwarfLineTable table;
+    if (table.load(worker.dbg, cu_die, nullptr) == DW_DLV_OK) {
+      out_index->addTable(table);
+    }
+    dwarf_dealloc(worker.dbg, cu_die, DW_DLA_DIE);
+  }
+}
+
+bool SymbolizerPool::buildLineIndex(DwarfLineIndex* out_index) {
+  std::vector<Dwarf_Off> cu_offsets;
+  if (workers_.empty() ||
+      !workers_[0]->searcher->listCUs(&cu_offsets, nullptr)) {
+    return false;
+  }
+
+  size_t n = workers_.size();
+  std::atomic<size_t> next_cu(0);
+  std::vector<DwarfLineIndex> indexes(n);
+  std::vector<std::thread> threads;
+  threads.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    threads.emplace_back(&SymbolizerPool::indexLines, this,
+                         static_cast<int>(i), std::cref(cu_offsets), &next_cu,
+                         &indexes[i]);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (DwarfLineIndex& index : indexes) {
+    out_index->merge(&index);
+  }
+  out_index->finalize();
+  return true;
+}
+
+}  // namespace dwarf2line
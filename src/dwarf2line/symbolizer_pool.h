@@ -0,0 +1,111 @@
+#ifndef DWARF2LINE_SYMBOLIZER_POOL_H
+#define DWARF2LINE_SYMBOLIZER_POOL_H
+
+#include <libdwarf/dwarf.h>
+#include <libdwarf/libdwarf.h>
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "dwarfexpr/dwarf_line_index.h"
+#include "dwarfexpr/dwarf_searcher.h"
+
+namespace dwarf2line {
+
+// A level of the inline chain of a pc, the call site file is an id of the
+// process-wide `DwarfFilePool` so that it is valid for any handle.
+struct InlineFrame {
+  Dwarf_Off die_offset;  // subprogram or inlined_subroutine DIE
+  dwarfexpr::DwarfFileId call_file;  // kDwarfNoFileId for the outermost
+  Dwarf_Unsigned call_line;
+};
+
+/**
+ * @brief find the inline chain of the pc, from the outermost subprogram to
+ *        the innermost inlined subroutine, with the call files resolved
+ */
+bool searchInlineFrames(dwarfexpr::DwarfSearcher* searcher, Dwarf_Addr pc,
+                        std::vector<InlineFrame>* out_frames);
+
+/**
+ * @brief A pool of workers which symbolize addresses in parallel.
+ *
+ * libdwarf handles are not thread-safe, so every worker opens its own
+ * `Dwarf_Debug` on the same file and keeps its own `DwarfSearcher`. The
+ * results only contain DIE offsets and ids of the process-wide
+ * `DwarfFilePool`, which are valid for any handle opened on the same file.
+ *
+ * The sorted addresses are cut into batches, each worker gets a contiguous
+ * run of batches (so it touches as few CUs as possible), pops them from the
+ * front of its own queue and steals from the back of the others when its
+ * queue is empty.
+ */
+class SymbolizerPool {
+ public:
+  SymbolizerPool(const std::string& path, int num_workers,
+                 size_t batch_size = 64);
+  ~SymbolizerPool();
+
+  /**
+   * @brief open a `Dwarf_Debug` for every worker
+   *
+   * @return false if the file can not be opened
+   */
+  bool init();
+
+  /**
+   * @brief symbolize the pcs with all the workers
+   *
+   * @param out_inlines if not null, also the inline chains of the pcs
+   * @return the results in the same order as `pcs`
+   */
+  std::vector<dwarfexpr::DwarfFunctionResult> symbolize(
+      const std::vector<Dwarf_Addr>& pcs,
+      std::vector<std::vector<InlineFrame>>* out_inlines = nullptr);
+
+  /**
+   * @brief build the file:line to address index of all the CUs, every worker
+   *        decodes the line tables of the CUs it claims into its own index.
+   */
+  bool buildLineIndex(dwarfexpr::DwarfLineIndex* out_index);
+
+  int numWorkers() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  struct Batch {
+    size_t begin;  // range of the sorted index
+    size_t end;
+  };
+
+  struct Worker {
+    Dwarf_Debug dbg = nullptr;
+    std::unique_ptr<dwarfexpr::DwarfSearcher> searcher;
+
+    std::mutex mutex;  // guards `queue`
+    std::deque<Batch> queue;
+  };
+
+  bool popBatch(int worker_id, Batch* out_batch);
+  bool stealBatch(int worker_id, Batch* out_batch);
+  void runWorker(int worker_id, const std::vector<Dwarf_Addr>& pcs,
+                 const std::vector<size_t>& order,
+                 std::vector<dwarfexpr::DwarfFunctionResult>* results,
+                 std::vector<std::vector<InlineFrame>>* inlines);
+  void indexLines(int worker_id, const std::vector<Dwarf_Off>& cu_offsets,
+                  std::atomic<size_t>* next_cu,
+                  dwarfexpr::DwarfLineIndex* out_index);
+
+  std::string path_;
+  int num_workers_;
+  size_t batch_size_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+};  // class SymbolizerPool
+
+}  // namespace dwarf2line
+
+#endif  // DWARF2LINE_SYMBOLIZER_POOL_H
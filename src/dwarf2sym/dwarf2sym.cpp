@@ -0,0 +1,75 @@
+#include <string.h>
+
+#include <algorithm>  // std::max
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "sym_dumper.h"
+
+using namespace dwarf2sym;
+
+const char USAGE[] =
+    "USAGE: dwarf2sym [options] <executable>\n"
+    " Dump the DWARF of an ELF file as a Breakpad symbol file.\n"
+    " Options:\n"
+    "  -o --output <file>      Write to the file instead of stdout\n"
+    "  -j --jobs <n>           Process the CUs with n threads\n"
+    "     --no-cfi             Do not dump STACK CFI records\n";
+
+int main(int argc, char** argv) {
+  std::string input;
+  std::string output;
+  int jobs = std::max(1u, std::thread::hardware_concurrency());
+  bool with_cfi = true;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
+      ++i;
+      if (i >= argc) {
+        printf("Error: missing the value of `-o` arg.\n");
+        return -1;
+      }
+      output = argv[i];
+    } else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+      ++i;
+      if (i >= argc) {
+        printf("Error: missing the value of `-j` arg.\n");
+        return -1;
+      }
+      jobs = std::max(1, atoi(argv[i]));
+    } else if (!strcmp(argv[i], "--no-cfi")) {
+      with_cfi = false;
+    } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+      printf("%s", USAGE);
+      return 0;
+    } else {
+      input = argv[i];
+    }
+  }
+  if (input.empty()) {
+    printf("Error: missing the input executable.\n");
+    printf("%s", USAGE);
+    return -1;
+  }
+
+  FILE* out = stdout;
+  if (!output.empty()) {
+    out = fopen(output.c_str(), "w");
+    if (out == nullptr) {
+      printf("Error: can not open %s\n", output.c_str());
+      return -1;
+    }
+  }
+
+  bool ok = false;
+  {
+    SymDumper dumper(input, jobs, out);
+    ok = dumper.init() && dumper.dump(with_cfi);
+  }
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,454 @@
+#include "sym_dumper.h"
+
+#include <inttypes.h>
+
+#include <algorithm>  // std::sort, std::upper_bound
+#include <cctype>     // ::toupper
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "dwarfexpr/dwarf_ranges.h"
+#include "dwarfexpr/dwarf_utils.h"
+#include "dwarfexpr/elf_utils.h"
+
+using namespace dwarfexpr;
+
+namespace dwarf2sym {
+
+namespace {
+
+// How many CUs the workers may run ahead of the writer, bounds the memory
+// used by the CUs waiting to be written.
+constexpr size_t kMaxPendingCUs = 256;
+
+constexpr uint16_t kEm386 = 3;
+constexpr uint16_t kEmArm = 40;
+constexpr uint16_t kEmX86_64 = 62;
+constexpr uint16_t kEmAarch64 = 183;
+
+const char* archName(uint16_t machine) {
+  switch (machine) {
+    case kEm386:
+      return "x86";
+    case kEmArm:
+      return "arm";
+    case kEmX86_64:
+      return "x86_64";
+    case kEmAarch64:
+      return "arm64";
+    default:
+      return "unknown";
+  }
+}
+
+// DWARF register numbers to Breakpad register names.
+std::vector<std::string> registerNames(uint16_t machine) {
+  std::vector<std::string> names;
+  switch (machine) {
+    case kEm386:
+      names = {"$eax", "$ecx", "$edx", "$ebx", "$esp",
+               "$ebp", "$esi", "$edi", "$eip"};
+      break;
+    case kEmX86_64:
+      names = {"$rax", "$rdx", "$rcx", "$rbx", "$rsi", "$rdi",
+               "$rbp", "$rsp", "$r8",  "$r9",  "$r10", "$r11",
+               "$r12", "$r13", "$r14", "$r15", "$rip"};
+      break;
+    case kEmArm:
+      for (int i = 0; i <= 12; ++i) {
+        names.push_back("r" + std::to_string(i));
+      }
+      names.insert(names.end(), {"sp", "lr", "pc"});
+      break;
+    case kEmAarch64:
+      for (int i = 0; i <= 30; ++i) {
+        names.push_back("x" + std::to_string(i));
+      }
+      names.push_back("sp");
+      break;
+    default:
+      break;
+  }
+  return names;
+}
+
+// Breakpad module id: the first 16 bytes of the build-id as a GUID (the first
+// three fields are little endian), plus an age of 0.
+std::string breakpadId(std::vector<uint8_t> build_id) {
+  build_id.resize(16, 0);
+  std::swap(build_id[0], build_id[3]);
+  std::swap(build_id[1], build_id[2]);
+  std::swap(build_id[4], build_id[5]);
+  std::swap(build_id[6], build_id[7]);
+  std::string id = buildIdToHex(build_id);
+  std::transform(id.begin(), id.end(), id.begin(), ::toupper);
+  return id + "0";
+}
+
+std::string baseName(const std::string& path) {
+  size_t pos = path.find_last_of('/');
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+}  // namespace
+
+SymDumper::SymDumper(const std::string& path, int num_workers, FILE* out)
+    : path_(path),
+      num_workers_(num_workers > 0 ? num_workers : 1),
+      out_(out) {}
+
+SymDumper::~SymDumper() {
+  for (auto& worker : workers_) {
+    closeDebug(worker.get());
+  }
+  closeDebug(&main_);
+}
+
+bool SymDumper::openDebug(Worker* worker) {
+#define PATH_LEN 2000
+  char real_path[PATH_LEN];
+  Dwarf_Error error = nullptr;
+  int res = dwarf_init_path(path_.c_str(), real_path, PATH_LEN,
+                            DW_GROUPNUMBER_ANY, nullptr, nullptr, &worker->dbg,
+                            &error);
+#undef PATH_LEN
+  if (res != DW_DLV_OK) {
+    if (res == DW_DLV_ERROR) {
+      fprintf(stderr, "Error: can not open %s: %s\n", path_.c_str(),
+              dwarf_errmsg(error));
+      dwarf_dealloc_error(worker->dbg, error);
+    } else {
+      fprintf(stderr, "Error: no DWARF in %s\n", path_.c_str());
+    }
+    worker->dbg = nullptr;
+    return false;
+  }
+  worker->searcher.reset(new DwarfSearcher(worker->dbg));
+  return true;
+}
+
+void SymDumper::closeDebug(Worker* worker) {
+  worker->searcher.reset();  // must be freed before the dbg
+  if (worker->dbg != nullptr) {
+    dwarf_finish(worker->dbg);
+    worker->dbg = nullptr;
+  }
+}
+
+bool SymDumper::init() {
+  if (!readElfMachine(path_, &machine_)) {
+    fprintf(stderr, "Error: %s is not an ELF file\n", path_.c_str());
+    return false;
+  }
+  if (!openDebug(&main_)) {
+    return false;
+  }
+  // The main thread works too when there is only one worker.
+  for (int i = 0; num_workers_ > 1 && i < num_workers_; ++i) {
+    std::unique_ptr<Worker> worker(new Worker());
+    if (!openDebug(worker.get())) {
+      return false;
+    }
+    workers_.emplace_back(std::move(worker));
+  }
+  return true;
+}
+
+void SymDumper::collectCU(Worker* worker, Dwarf_Off cu_offset,
+                          CuSymbols* out) {
+  Dwarf_Debug dbg = worker->dbg;
+  Dwarf_Die cu_die = nullptr;
+  if (dwarf_offdie_b(dbg, cu_offset, 1 /* is_info */, &cu_die, nullptr) !=
+      DW_DLV_OK) {
+    return;
+  }
+  auto cu_die_guard =
+      make_scope_exit([&]() { dwarf_dealloc(dbg, cu_die, DW_DLA_DIE); });
+
+  // Line ranges of the CU, a row covers the addresses up to the next row.
+  std::vector<DwarfLineRow> rows;
+  std::vector<SymLine> lines;
+  if (getLineRows(dbg, cu_die, &rows, &out->files, nullptr) == DW_DLV_OK) {
+    for (size_t i = 0; i + 1 < rows.size(); ++i) {
+      const DwarfLineRow& row = rows[i];
+      if (row.end_sequence || row.file == MAX_DWARF_UNSIGNED ||
+          rows[i + 1].addr <= row.addr) {
+        continue;
+      }
+      lines.push_back({row.addr, rows[i + 1].addr - row.addr, row.line,
+                       static_cast<uint32_t>(row.file)});
+    }
+    std::sort(
+        lines.begin(), lines.end(),
+        [](const SymLine& a, const SymLine& b) { return a.addr < b.addr; });
+  }
+
+  const DwarfFuncTable* table =
+      worker->searcher->getFuncTable(cu_offset, nullptr);
+  if (table == nullptr) {
+    return;
+  }
+  std::unordered_map<Dwarf_Off, std::string> names;
+  for (const DwarfFuncRange& r : table->ranges()) {
+    if (r.depth != 0) {
+      break;  // sorted by depth, only the outermost functions are FUNCs
+    }
+    auto it = names.find(r.die_offset);
+    if (it == names.end()) {
+      std::string name = "<name omitted>";
+      Dwarf_Die die = nullptr;
+      if (getDieFromOffset(dbg, r.die_offset, die)) {
+        name = getFunctionName(dbg, die, true /* demangle */, name);
+        dwarf_dealloc(dbg, die, DW_DLA_DIE);
+      }
+      it = names.emplace(r.die_offset, std::move(name)).first;
+    }
+
+    SymFunc func = {r.low, r.high - r.low, it->second, {}};
+    // The first line range which may overlap the function.
+    auto line_it = std::upper_bound(
+        lines.begin(), lines.end(), r.low,
+        [](Dwarf_Addr addr, const SymLine& l) { return addr < l.addr; });
+    if (line_it != lines.begin()) {
+      --line_it;
+    }
+    for (; line_it != lines.end() && line_it->addr < r.high; ++line_it) {
+      Dwarf_Addr low = std::max(line_it->addr, r.low);
+      Dwarf_Addr high = std::min(line_it->addr + line_it->size, r.high);
+      if (low < high) {
+        func.lines.push_back({low, high - low, line_it->line, line_it->file});
+      }
+    }
+    out->funcs.emplace_back(std::move(func));
+  }
+}
+
+void SymDumper::dumpCUs(const std::vector<Dwarf_Off>& cu_offsets) {
+  std::vector<CuSymbols> cus(cu_offsets.size());
+
+  if (workers_.empty()) {
+    for (size_t i = 0; i < cu_offsets.size(); ++i) {
+      collectCU(&main_, cu_offsets[i], &cus[i]);
+      writeCU(cus[i]);
+      cus[i] = CuSymbols();  // release the memory
+    }
+    return;
+  }
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t next_cu = 0;  // the next CU to collect
+  size_t written = 0;  // the CUs before it are written
+
+  auto run = [&](Worker* worker) {
+    while (true) {
+      size_t idx;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]() {
+          return next_cu >= cus.size() || next_cu < written + kMaxPendingCUs;
+        });
+        if (next_cu >= cus.size()) {
+          return;
+        }
+        idx = next_cu++;
+      }
+      CuSymbols cu;
+      collectCU(worker, cu_offsets[idx], &cu);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        cus[idx] = std::move(cu);
+        cus[idx].done = true;
+      }
+      cond.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (auto& worker : workers_) {
+    threads.emplace_back(run, worker.get());
+  }
+
+  // Write the CUs in order as soon as they are ready.
+  for (size_t i = 0; i < cus.size(); ++i) {
+    CuSymbols cu;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&]() { return cus[i].done; });
+      cu = std::move(cus[i]);
+      cus[i] = CuSymbols();
+    }
+    writeCU(cu);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      written = i + 1;
+    }
+    cond.notify_all();
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+void SymDumper::writeModule() {
+  std::vector<uint8_t> build_id;
+  readElfBuildId(path_, &build_id);
+  std::string code_id = buildIdToHex(build_id);
+  std::transform(code_id.begin(), code_id.end(), code_id.begin(), ::toupper);
+
+  fprintf(out_, "MODULE Linux %s %s %s\n", archName(machine_),
+          breakpadId(build_id).c_str(), baseName(path_).c_str());
+  if (!code_id.empty()) {
+    fprintf(out_, "INFO CODE_ID %s\n", code_id.c_str());
+  }
+}
+
+void SymDumper::writeCU(const CuSymbols& cu) {
+  // FILE records are numbered across the CUs, a new file is written right
+  // before the first FUNC which uses it.
+  std::vector<uint32_t> ids(cu.files.size());
+  for (size_t i = 0; i < cu.files.size(); ++i) {
+    auto it = file_ids_.find(cu.files[i]);
+    if (it == file_ids_.end()) {
+      uint32_t id = static_cast<uint32_t>(file_ids_.size());
+      it = file_ids_.emplace(cu.files[i], id).first;
+      fprintf(out_, "FILE %u %s\n", id, cu.files[i].c_str());
+    }
+    ids[i] = it->second;
+  }
+
+  for (const SymFunc& func : cu.funcs) {
+    fprintf(out_, "FUNC %llx %llx 0 %s\n", func.addr, func.size,
+            func.name.c_str());
+    for (const SymLine& line : func.lines) {
+      fprintf(out_, "%llx %llx %llu %u\n", line.addr, line.size, line.line,
+              ids[line.file]);
+    }
+  }
+}
+
+void SymDumper::writeCfi() {
+  std::vector<std::string> reg_names = registerNames(machine_);
+  if (reg_names.empty()) {
+    fprintf(stderr, "Warning: unsupported machine %u, no STACK CFI\n",
+            machine_);
+    return;
+  }
+
+  // Any CU gives the address/offset size, the CFI does not depend on it.
+  Dwarf_Half addr_size = 8;
+  Dwarf_Half offset_size = 4;
+  Dwarf_Half version = 2;
+  std::vector<Dwarf_Off> cu_offsets;
+  main_.searcher->listCUs(&cu_offsets, nullptr);
+  Dwarf_Die cu_die = nullptr;
+  if (!cu_offsets.empty() &&
+      getDieFromOffset(main_.dbg, cu_offsets.front(), cu_die)) {
+    dwarf_get_die_address_size(cu_die, &addr_size, nullptr);
+    dwarf_get_version_of_die(cu_die, &version, &offset_size);
+    dwarf_dealloc(main_.dbg, cu_die, DW_DLA_DIE);
+  }
+
+  DwarfFrames frames(main_.dbg, addr_size, offset_size, version);
+  std::vector<DwarfFrames::CfiTable> tables;
+  if (!frames.GetAllCfi(static_cast<Dwarf_Half>(reg_names.size()), &tables)) {
+    return;
+  }
+
+  writeCfiTables(machine_, tables, out_);
+}
+
+void SymDumper::writeCfiTables(uint16_t machine,
+                               const std::vector<DwarfFrames::CfiTable>& tables,
+                               FILE* out) {
+  std::vector<std::string> reg_names = registerNames(machine);
+  auto regName = [&](Dwarf_Unsigned reg) -> std::string {
+    return reg < reg_names.size() ? reg_names[reg] : "";
+  };
+  // Breakpad postfix expression of a rule, empty if it can not be expressed.
+  auto ruleText = [&](const DwarfFrames::CfiRule& rule,
+                      Dwarf_Unsigned self) -> std::string {
+    if (rule.reg == DW_FRAME_UNDEFINED_VAL) {
+      return "";
+    }
+    if (rule.reg == DW_FRAME_SAME_VAL) {
+      return regName(self);
+    }
+    std::string offset = std::to_string(rule.offset);
+    switch (rule.value_type) {
+      case DW_EXPR_OFFSET:
+        if (rule.offset_relevant != 0) {
+          return ".cfa " + offset + " + ^";
+        }
+        return regName(rule.reg);
+      case DW_EXPR_VAL_OFFSET:
+        return ".cfa " + offset + " +";
+      default:
+        return "";  // DWARF expressions are not supported
+    }
+  };
+
+  for (const DwarfFrames::CfiTable& table : tables) {
+    if (table.rows.empty()) {
+      continue;
+    }
+    const DwarfFrames::CfiRow* prev = nullptr;
+    for (const DwarfFrames::CfiRow& row : table.rows) {
+      // The CFA must be a register plus an offset.
+      if (row.cfa.value_type != DW_EXPR_OFFSET ||
+          regName(row.cfa.reg).empty()) {
+        break;
+      }
+      std::string rules;
+      if (prev == nullptr || row.cfa != prev->cfa) {
+        rules += " .cfa: " + regName(row.cfa.reg) + " " +
+                 std::to_string(row.cfa.offset) + " +";
+      }
+      for (size_t x = 0; x < row.regs.size(); ++x) {
+        const DwarfFrames::CfiRule& rule = row.regs[x];
+        if (prev != nullptr && rule == prev->regs[x]) {
+          continue;
+        }
+        bool is_ra = x == table.ra_reg;
+        std::string name = is_ra ? ".ra" : regName(x);
+        // Same value is the initial rule of the callee saved registers, but
+        // the return address must always be recovered, e.g. from lr on arm.
+        if (name.empty() ||
+            (rule.reg == DW_FRAME_SAME_VAL && prev == nullptr && !is_ra)) {
+          continue;
+        }
+        std::string text = ruleText(rule, x);
+        if (!text.empty()) {
+          rules += " " + name + ": " + text;
+        }
+      }
+
+      if (prev == nullptr) {
+        fprintf(out, "STACK CFI INIT %llx %llx%s\n", table.low_pc,
+                table.high_pc - table.low_pc, rules.c_str());
+      } else if (!rules.empty()) {
+        fprintf(out, "STACK CFI %llx%s\n", row.pc, rules.c_str());
+      }
+      prev = &row;
+    }
+  }
+}
+
+bool SymDumper::dump(bool with_cfi) {
+  std::vector<Dwarf_Off> cu_offsets;
+  if (!main_.searcher->listCUs(&cu_offsets, nullptr)) {
+    fprintf(stderr, "Error: can not read the CUs of %s\n", path_.c_str());
+    return false;
+  }
+
+  writeModule();
+  dumpCUs(cu_offsets);
+  if (with_cfi) {
+    writeCfi();
+  }
+  return fflush(out_) == 0;
+}
+
+}  // namespace dwarf2sym
@@ -0,0 +1,98 @@
+#ifndef DWARF2SYM_SYM_DUMPER_H
+#define DWARF2SYM_SYM_DUMPER_H
+
+#include <libdwarf/dwarf.h>
+#include <libdwarf/libdwarf.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dwarfexpr/dwarf_frames.h"
+#include "dwarfexpr/dwarf_searcher.h"
+
+namespace dwarf2sym {
+
+/**
+ * @brief Dump the DWARF of an ELF file as a Breakpad symbol file.
+ *
+ * The FUNC and line records of the CUs are collected by a pool of workers,
+ * each one has its own `Dwarf_Debug` since libdwarf handles are not
+ * thread-safe. The records are written in the order of the CUs as soon as a
+ * CU is ready, so the output is streamed and does not depend on the number of
+ * workers. The STACK CFI records are dumped from `.eh_frame`/`.debug_frame`
+ * at the end.
+ */
+class SymDumper {
+ public:
+  SymDumper(const std::string& path, int num_workers, FILE* out);
+  ~SymDumper();
+
+  /**
+   * @brief open the ELF file for the main thread and every worker
+   */
+  bool init();
+
+  bool dump(bool with_cfi);
+
+  /**
+   * @brief write the STACK CFI records of the CFI tables
+   *
+   * @param machine the ELF machine of the tables, gives the register names
+   */
+  static void writeCfiTables(
+      uint16_t machine,
+      const std::vector<dwarfexpr::DwarfFrames::CfiTable>& tables, FILE* out);
+
+ private:
+  struct SymLine {
+    Dwarf_Addr addr;
+    Dwarf_Unsigned size;
+    Dwarf_Unsigned line;
+    uint32_t file;  // index in CuSymbols::files
+  };
+
+  struct SymFunc {
+    Dwarf_Addr addr;
+    Dwarf_Unsigned size;
+    std::string name;
+    std::vector<SymLine> lines;
+  };
+
+  struct CuSymbols {
+    bool done = false;
+    std::vector<std::string> files;
+    std::vector<SymFunc> funcs;
+  };
+
+  struct Worker {
+    Dwarf_Debug dbg = nullptr;
+    std::unique_ptr<dwarfexpr::DwarfSearcher> searcher;
+  };
+
+  bool openDebug(Worker* worker);
+  void closeDebug(Worker* worker);
+  void collectCU(Worker* worker, Dwarf_Off cu_offset, CuSymbols* out);
+  void dumpCUs(const std::vector<Dwarf_Off>& cu_offsets);
+
+  void writeModule();
+  void writeCU(const CuSymbols& cu);
+  void writeCfi();
+
+  std::string path_;
+  int num_workers_;
+  FILE* out_;
+
+  Worker main_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  uint16_t machine_ = 0;
+  std::unordered_map<std::string, uint32_t> file_ids_;  // FILE records
+};  // class SymDumper
+
+}  // namespace dwarf2sym
+
+#endif  // DWARF2SYM_SYM_DUMPER_H
@@ -0,0 +1,198 @@
+#include "dwarfexpr/dwarf_call_sites.h"
+
+#include <algorithm>  // std::sort
+#include <utility>    // std::move
+
+#include "dwarfexpr/dwarf_attrs.h"  // getAttrValueAddr
+#include "dwarfexpr/dwarf_utils.h"
+
+namespace dwarfexpr {
+
+namespace {
+
+// The encoding of the expressions of a CU.
+struct ExprFormat {
+  Dwarf_Half addr_size;
+  Dwarf_Half offset_size;
+  Dwarf_Half version;
+};
+
+// Decode the DW_FORM_exprloc attribute of the DIE.
+bool loadExprloc(Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Half attrnum,
+                 const ExprFormat& format, DwarfExpression* expr,
+                 Dwarf_Error* errp) {
+  Dwarf_Attribute attr = nullptr;
+  if (dwarf_attr(die, attrnum, &attr, errp) != DW_DLV_OK) {
+    return false;
+  }
+  auto attr_guard =
+      make_scope_exit([&]() { dwarf_dealloc(dbg, attr, DW_DLA_ATTR); });
+
+  Dwarf_Unsigned len = 0;
+  Dwarf_Ptr block = nullptr;
+  return dwarf_formexprloc(attr, &len, &block, errp) == DW_DLV_OK &&
+         DwarfExpression::decode(block, len, format.addr_size,
+                                 format.offset_size, format.version, expr);
+}
+
+// The register of a DW_AT_location of a single DW_OP_reg* or DW_OP_regx.
+bool paramRegister(const DwarfExpression& location, uint32_t* reg) {
+  if (location.count() != 1) {
+    return false;
+  }
+  const DwarfOp& op = location.getOp(0);
+  if (DW_OP_reg0 <= op.opcode && op.opcode <= DW_OP_reg31) {
+    *reg = op.opcode - DW_OP_reg0;
+    return true;
+  } else if (op.opcode == DW_OP_regx) {
+    *reg = static_cast<uint32_t>(op.op1);
+    return true;
+  }
+  return false;
+}
+
+// Collect the parameters of the call site whose values are known, the
+// others can not help DW_OP_entry_value.
+void loadParams(Dwarf_Debug dbg, Dwarf_Die site_die, const ExprFormat& format,
+                DwarfCallSite* site, Dwarf_Error* errp) {
+  Dwarf_Die cur_die = nullptr;
+  int res = dwarf_child(site_die, &cur_die, errp);
+  while (res == DW_DLV_OK) {
+    Dwarf_Half tag = 0;
+    if (dwarf_tag(cur_die, &tag, errp) == DW_DLV_OK &&
+        (tag == DW_TAG_call_site_parameter ||
+         tag == DW_TAG_GNU_call_site_parameter)) {
+      DwarfExpression location;
+      DwarfCallSiteParam param = {};
+      if (loadExprloc(dbg, cur_die, DW_AT_location, format, &location,
+                      errp) &&
+          paramRegister(location, &param.reg) &&
+          (loadExprloc(dbg, cur_die, DW_AT_call_value, format, &param.value,
+                       errp) ||
+           loadExprloc(dbg, cur_die, DW_AT_GNU_call_site_value, format,
+                       &param.value, errp))) {
+        site->params.emplace_back(std::move(param));
+      }
+    }
+
+    Dwarf_Die sib_die = nullptr;
+    res = dwarf_siblingof_b(dbg, cur_die, 1 /* is_info */, &sib_die, errp);
+    dwarf_dealloc(dbg, cur_die, DW_DLA_DIE);
+    cur_die = sib_die;
+  }
+}
+
+/*  Recursion, following DIE tree.
+    Collect the call sites below in_die, through the inlined subroutines and
+    the lexical blocks but not the nested subprograms.
+*/
+void collectCallSites(Dwarf_Debug dbg, Dwarf_Die in_die,
+                      const ExprFormat& format, const DwarfCallSite& caller,
+                      std::vector<DwarfCallSite>* sites, Dwarf_Error* errp) {
+  Dwarf_Die cur_die = nullptr;
+  int res = dwarf_child(in_die, &cur_die, errp);
+  while (res == DW_DLV_OK) {
+    Dwarf_Half tag = 0;
+    if (dwarf_tag(cur_die, &tag, errp) == DW_DLV_OK) {
+      if (tag == DW_TAG_call_site || tag == DW_TAG_GNU_call_site) {
+        DwarfCallSite site = caller;
+        site.return_pc = getAttrValueAddr(
+            dbg, cur_die,
+            tag == DW_TAG_call_site ? DW_AT_call_return_pc : DW_AT_low_pc, 0);
+        if (site.return_pc != 0) {
+          loadParams(dbg, cur_die, format, &site, errp);
+        }
+        if (!site.params.empty()) {
+          sites->emplace_back(std::move(site));
+        }
+      } else if (tag != DW_TAG_subprogram) {
+        // Has child -> recursion.
+        collectCallSites(dbg, cur_die, format, caller, sites, errp);
+      }
+    }
+
+    Dwarf_Die sib_die = nullptr;
+    res = dwarf_siblingof_b(dbg, cur_die, 1 /* is_info */, &sib_die, errp);
+    dwarf_dealloc(dbg, cur_die, DW_DLA_DIE);
+    cur_die = sib_die;
+  }
+}
+
+}  // namespace
+
+const DwarfCallSiteParam* DwarfCallSite::findParam(uint32_t reg) const {
+  for (const DwarfCallSiteParam& param : params) {
+    if (param.reg == reg) {
+      return &param;
+    }
+  }
+  return nullptr;
+}
+
+bool DwarfCallSite::entryValue(uint32_t reg,
+                               const DwarfExpression::Context& context,
+                               Dwarf_Addr pc, uint64_t* value) const {
+  const DwarfCallSiteParam* param = findParam(reg);
+  if (param == nullptr) {
+    return false;
+  }
+  // The value is the result of the expression, the top of the stack.
+  DwarfExpression::Result result = param->value.evaluate(context, pc);
+  if (!result.valid() ||
+      result.type == DwarfExpression::Result::Type::kComposite) {
+    return false;
+  }
+  *value = result.value;
+  return true;
+}
+
+bool DwarfCallSiteTable::load(Dwarf_Debug dbg, Dwarf_Off cu_offset,
+                              Dwarf_Die func_die, Dwarf_Error* errp) {
+  sites_.clear();
+
+  ExprFormat format = {0, 0, 2};
+  if (dwarf_get_die_address_size(func_die, &format.addr_size, errp) !=
+          DW_DLV_OK ||
+      dwarf_get_version_of_die(func_die, &format.version,
+                               &format.offset_size) != DW_DLV_OK) {
+    return false;
+  }
+
+  DwarfCallSite caller = {};
+  caller.cu_offset = cu_offset;
+  if (dwarf_dieoffset(func_die, &caller.func_offset, errp) != DW_DLV_OK) {
+    return false;
+  }
+
+  collectCallSites(dbg, func_die, format, caller, &sites_, errp);
+  std::sort(sites_.begin(), sites_.end(),
+            [](const DwarfCallSite& a, const DwarfCallSite& b) {
+              return a.return_pc < b.return_pc;
+            });
+  return true;
+}
+
+const DwarfCallSite* DwarfCallSiteTable::find(Dwarf_Addr return_pc) const {
+  auto it = std::lower_bound(sites_.begin(), sites_.end(), return_pc,
+                             [](const DwarfCallSite& site, Dwarf_Addr pc) {
+                               return site.return_pc < pc;
+                             });
+  if (it != sites_.end() && it->return_pc == return_pc) {
+    return &*it;
+  }
+  return nullptr;
+}
+
+std::size_t DwarfCallSiteTable::memoryUsage() const {
+  std::size_t bytes = sizeof(*this) + sites_.capacity() * sizeof(DwarfCallSite);
+  for (const DwarfCallSite& site : sites_) {
+    bytes += site.params.capacity() * sizeof(DwarfCallSiteParam);
+    for (const DwarfCallSiteParam& param : site.params) {
+      // The ops and their compiled program.
+      bytes += param.value.count() * 2 * sizeof(DwarfOp);
+    }
+  }
+  return bytes;
+}
+
+}  // namespace dwarfexpr
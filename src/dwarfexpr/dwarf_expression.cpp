@@ -1,12 +1,10 @@
 #include "dwarfexpr/dwarf_expression.h"
 
+#include <algorithm>  // std::lower_bound
 #include <cinttypes>
-#include <cstdlib>  // abs
-#include <limits>
 #include <stack>
 
-#include "dwarfexpr/dwarf_location.h"
-#include "dwarfexpr/dwarf_utils.h"
+#include "dwarfexpr/dwarf_expression_eval.h"
 
 namespace dwarfexpr {
 
@@ -71,651 +69,646 @@ bool DwarfExpression::loadExprFromLoclist(Dwarf_Loc_Head_c loclist_head,
       expr->addOp(std::move(a));
     }
   }
+  expr->compile();
 
   return true;
 }
 
-DwarfExpression::Result DwarfExpression::evaluate(
-    const Context& context, Dwarf_Addr pc,
-    std::stack<Dwarf_Signed>* mystack) const {
-  if (count() < 1) {
-    return Result::Error(ErrorCode::kIllegalState, 0);
-  }
+namespace {
 
-  if (mystack == nullptr) {
-    std::stack<Dwarf_Signed> local_stack;
-    mystack = &local_stack;
-  }
+// Bounds-checked reader of the expression bytes, which are little endian.
+class ExprReader {
+ public:
+  ExprReader(const uint8_t* data, size_t size)
+      : begin_(data), ptr_(data), end_(data + size) {}
 
-  Dwarf_Unsigned cur_off;
-  for (size_t i = 0; i < ops_.size(); ++i) {
-    const DwarfOp& a = ops_[i];
-    cur_off = a.off;
+  bool done() const { return ptr_ >= end_; }
+  Dwarf_Unsigned offset() const { return ptr_ - begin_; }
+  const uint8_t* ptr() const { return ptr_; }
 
-    const char* opcode_name;
-    if (dwarf_get_OP_name(a.opcode, &opcode_name) != DW_DLV_OK) {
-      return Result::Error(ErrorCode::kIllegalOp, cur_off);
+  bool skip(Dwarf_Unsigned size) {
+    if (size > static_cast<Dwarf_Unsigned>(end_ - ptr_)) {
+      return false;
     }
+    ptr_ += size;
+    return true;
+  }
 
-    if (DW_OP_reg0 <= a.opcode && a.opcode <= DW_OP_reg31) {
-      if (context.registers == nullptr) {
-        return Result::Error(ErrorCode::kRegisterInvalid, cur_off);
-      }
-
-      Dwarf_Half reg_num = a.opcode - DW_OP_reg0;
-      uint64_t reg_val = 0;
-      if (!context.registers(reg_num, &reg_val)) {
-        return Result::Error(ErrorCode::kRegisterInvalid, cur_off);
-      }
-      printf("op=%s reg%d = 0x%" PRIx64 "\n", opcode_name, reg_num, reg_val);
-      mystack->push(reg_val);
-      return Result::Value(reg_val);
-    } else if (a.opcode == DW_OP_regx) {
-      if (context.registers == nullptr) {
-        return Result::Error(ErrorCode::kRegisterInvalid, cur_off);
-      }
-
-      Dwarf_Half reg_num = ops_[0].op1;
-      uint64_t reg_val = 0;
-      if (!context.registers(reg_num, &reg_val)) {
-        return Result::Error(ErrorCode::kRegisterInvalid, cur_off);
-      }
-      printf("op=%s reg%d = 0x%" PRIx64 "\n", opcode_name, reg_num, reg_val);
-      mystack->push(reg_val);
-      return Result::Value(reg_val);
+  bool readUnsigned(size_t size, Dwarf_Unsigned* value) {
+    if (size > 8 || size > static_cast<size_t>(end_ - ptr_)) {
+      return false;
     }
-    // printf("stack: op=%s, op1=0x%llx, op2=0x%llx, op3=0x%llx, off=0x%llx\n",
-    //       opcode_name, a.op1, a.op2, a.op3, a.off);
-
-    switch (a.opcode) {
-        //
-        // Literal Encodings.
-        // Push a value onto the DWARF stack.
-        //
-
-        // Literals.
-      case DW_OP_lit0:
-      case DW_OP_lit1:
-      case DW_OP_lit2:
-      case DW_OP_lit3:
-      case DW_OP_lit4:
-      case DW_OP_lit5:
-      case DW_OP_lit6:
-      case DW_OP_lit7:
-      case DW_OP_lit8:
-      case DW_OP_lit9:
-      case DW_OP_lit10:
-      case DW_OP_lit11:
-      case DW_OP_lit12:
-      case DW_OP_lit13:
-      case DW_OP_lit14:
-      case DW_OP_lit15:
-      case DW_OP_lit16:
-      case DW_OP_lit17:
-      case DW_OP_lit18:
-      case DW_OP_lit19:
-      case DW_OP_lit20:
-      case DW_OP_lit21:
-      case DW_OP_lit22:
-      case DW_OP_lit23:
-      case DW_OP_lit24:
-      case DW_OP_lit25:
-      case DW_OP_lit26:
-      case DW_OP_lit27:
-      case DW_OP_lit28:
-      case DW_OP_lit29:
-      case DW_OP_lit30:
-      case DW_OP_lit31:
-        mystack->push(a.opcode - DW_OP_lit0);
-        break;
-
-        // First operand pushed to stack.
-        // Signed and unsigned together.
-      case DW_OP_addr:
-      case DW_OP_const1u:
-      case DW_OP_const1s:
-      case DW_OP_const2u:
-      case DW_OP_const2s:
-      case DW_OP_const4u:
-      case DW_OP_const4s:
-      case DW_OP_const8u:
-      case DW_OP_const8s:
-      case DW_OP_constu:
-      case DW_OP_consts:
-        mystack->push(a.op1);
-        break;
-
-        //
-        // Register Based Addressing.
-        // Pushed value is result of adding the contents of a register
-        // with a given signed offset.
-        //
-
-        // Frame base plus signed first operand.
-      case DW_OP_fbreg: {
-        if (context.frameBaseLoc == nullptr) {
-          return Result::Error(ErrorCode::kFrameBaseInvalid, cur_off);
-        }
-
-        Result frameBase = context.frameBaseLoc->evalValue(context, pc);
-        if (!frameBase.valid()) {
-          return Result::Error(ErrorCode::kFrameBaseInvalid, cur_off);
-        }
-        mystack->push(frameBase.value + a.op1);
-        break;
-      }
-
-        // Content of register (address) plus signed first operand.
-      case DW_OP_breg0:
-      case DW_OP_breg1:
-      case DW_OP_breg2:
-      case DW_OP_breg3:
-      case DW_OP_breg4:
-      case DW_OP_breg5:
-      case DW_OP_breg6:
-      case DW_OP_breg7:
-      case DW_OP_breg8:
-      case DW_OP_breg9:
-      case DW_OP_breg10:
-      case DW_OP_breg11:
-      case DW_OP_breg12:
-      case DW_OP_breg13:
-      case DW_OP_breg14:
-      case DW_OP_breg15:
-      case DW_OP_breg16:
-      case DW_OP_breg17:
-      case DW_OP_breg18:
-      case DW_OP_breg19:
-      case DW_OP_breg20:
-      case DW_OP_breg21:
-      case DW_OP_breg22:
-      case DW_OP_breg23:
-      case DW_OP_breg24:
-      case DW_OP_breg25:
-      case DW_OP_breg26:
-      case DW_OP_breg27:
-      case DW_OP_breg28:
-      case DW_OP_breg29:
-      case DW_OP_breg30:
-      case DW_OP_breg31: {
-        if (context.registers == nullptr) {
-          return Result::Error(ErrorCode::kRegisterInvalid, cur_off);
-        }
-        Dwarf_Half reg_num = a.opcode - DW_OP_breg0;
-        uint64_t reg_val = 0;
-        if (!context.registers(reg_num, &reg_val)) {
-          return Result::Error(ErrorCode::kRegisterInvalid, cur_off);
-        }
-        printf("reg%d(0x%" PRIx64 ") + 0x%llx = 0x%llx\n", reg_num, reg_val,
-               a.op1, reg_val + a.op1);
-        mystack->push(reg_val + a.op1);
-        break;
-      }
-      case DW_OP_bregx: {
-        if (context.registers == nullptr) {
-          return Result::Error(ErrorCode::kRegisterInvalid, cur_off);
-        }
-        Dwarf_Half reg_num = a.op1;
-        uint64_t reg_val = 0;
-        if (!context.registers(reg_num, &reg_val)) {
-          return Result::Error(ErrorCode::kRegisterInvalid, cur_off);
-        }
-        printf("reg%d(0x%" PRIx64 ") + 0x%llx = 0x%llx\n", reg_num, reg_val,
-               a.op1, reg_val + a.op1);
-        mystack->push(reg_val + a.op1);
-        break;
-      }
-
-        //
-        // Stack Operations.
-        // Operations manipulate the DWARF stack.
-        //
-
-        // Duplicates the value at the top of the stack.
-      case DW_OP_dup:
-        if (mystack->empty()) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
-        mystack->push(mystack->top());
-        break;
-
-      // Pops the value at the top of the stack
-      case DW_OP_drop:
-        if (mystack->empty()) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
-        mystack->pop();
-        break;
-
-        // Entry with specified index is copied at the top.
-      case DW_OP_pick: {
-        Dwarf_Unsigned idx = a.op1;
-        std::stack<Dwarf_Signed> t;
-        if (mystack->size() < (idx + 1)) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
-
-        for (unsigned i = 0; i < idx; i++) {
-          t.push(mystack->top());
-          mystack->pop();
-        }
-
-        Dwarf_Signed pick = mystack->top();
+    *value = 0;
+    for (size_t i = 0; i < size; ++i) {
+      *value |= static_cast<Dwarf_Unsigned>(ptr_[i]) << (i * 8);
+    }
+    ptr_ += size;
+    return true;
+  }
 
-        for (unsigned i = 0; i < idx; i++) {
-          mystack->push(t.top());
-          t.pop();
-        }
+  // Sign extended to 64 bits, like libdwarf.
+  bool readSigned(size_t size, Dwarf_Unsigned* value) {
+    if (!readUnsigned(size, value)) {
+      return false;
+    }
+    if (size < 8 && (*value >> (size * 8 - 1)) & 1) {
+      *value |= ~static_cast<Dwarf_Unsigned>(0) << (size * 8);
+    }
+    return true;
+  }
 
-        mystack->push(pick);
-        break;
+  bool readULEB128(Dwarf_Unsigned* value) {
+    *value = 0;
+    unsigned shift = 0;
+    while (ptr_ < end_) {
+      uint8_t byte = *ptr_++;
+      if (shift < 64) {
+        *value |= static_cast<Dwarf_Unsigned>(byte & 0x7f) << shift;
       }
-
-        // Duplicates the second entry to the top of the stack.
-      case DW_OP_over: {
-        if (mystack->size() < 2) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
-
-        Dwarf_Signed t = mystack->top();
-        mystack->pop();
-        Dwarf_Signed d = mystack->top();
-
-        mystack->push(t);
-        mystack->push(d);
-        break;
+      shift += 7;
+      if (!(byte & 0x80)) {
+        return true;
       }
+    }
+    return false;
+  }
 
-        // Swaps the top two stack entries.
-      case DW_OP_swap: {
-        if (mystack->size() < 2) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
-
-        Dwarf_Signed e1 = mystack->top();
-        mystack->pop();
-        Dwarf_Signed e2 = mystack->top();
-        mystack->pop();
-
-        mystack->push(e1);
-        mystack->push(e2);
-        break;
+  bool readSLEB128(Dwarf_Unsigned* value) {
+    *value = 0;
+    unsigned shift = 0;
+    while (ptr_ < end_) {
+      uint8_t byte = *ptr_++;
+      if (shift < 64) {
+        *value |= static_cast<Dwarf_Unsigned>(byte & 0x7f) << shift;
       }
-
-        // Rotates the first three stack entries
-      case DW_OP_rot: {
-        if (mystack->size() < 3) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
+      shift += 7;
+      if (!(byte & 0x80)) {
+        if (shift < 64 && (byte & 0x40)) {
+          *value |= ~static_cast<Dwarf_Unsigned>(0) << shift;  // sign extend
         }
-
-        Dwarf_Signed e1 = mystack->top();
-        mystack->pop();
-        Dwarf_Signed e2 = mystack->top();
-        mystack->pop();
-        Dwarf_Signed e3 = mystack->top();
-        mystack->pop();
-
-        mystack->push(e1);
-        mystack->push(e3);
-        mystack->push(e2);
-        break;
+        return true;
       }
+    }
+    return false;
+  }
 
-        // Pops the top stack entry and treats it as an address.
-        // The value retrieved from that address is pushed.
-      case DW_OP_deref: {
-        if (context.memory == nullptr) {
-          return Result::Error(ErrorCode::kMemoryInvalid, cur_off);
-        }
-
-        if (mystack->empty()) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
-
-        Dwarf_Addr adr = mystack->top();
-        mystack->pop();
-
-        Dwarf_Signed defref_val =
-            readMemory<Dwarf_Signed>(context.memory, adr, MAX_DWARF_SIGNED);
-        if (defref_val == MAX_DWARF_SIGNED) {
-          return Result::Error(ErrorCode::kMemoryInvalid, cur_off);
-        }
+ private:
+  const uint8_t* begin_;
+  const uint8_t* ptr_;
+  const uint8_t* end_;
+};
 
-        mystack->push(defref_val);
-        break;
-      }
-
-        // The DW_OP_deref_size operation behaves like the DW_OP_deref
-        // operation: it pops the top stack entry and treats it as an address.
-        // The value retrieved from that address is pushed. In the
-        // DW_OP_deref_size operation, however, the size in bytes of the data
-        // retrieved from the dereferenced address is specified by the single
-        // operand. This operand is a 1-byte unsigned integral constant whose
-        // value may not be larger than the size of an address on the target
-        // machine. The data retrieved is zero extended to the size of an
-        // address on the target machine before being pushed on the expression
-        // stack.
-      case DW_OP_deref_size: {
-        if (context.memory == nullptr) {
-          return Result::Error(ErrorCode::kMemoryInvalid, cur_off);
-        }
+// Read a block of `size` bytes, the operand is its address like libdwarf.
+bool readBlock(ExprReader* reader, Dwarf_Unsigned size, Dwarf_Unsigned* ptr) {
+  *ptr = reinterpret_cast<Dwarf_Unsigned>(reader->ptr());
+  return reader->skip(size);
+}
 
-        if (mystack->empty()) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
+// Decode the operands of the op, as `dwarf_get_location_op_value_c()`.
+bool readOperands(ExprReader* reader, Dwarf_Half addr_size,
+                  Dwarf_Half offset_size, Dwarf_Half version, DwarfOp* op) {
+  Dwarf_Small opcode = op->opcode;
+  if ((DW_OP_lit0 <= opcode && opcode <= DW_OP_lit31) ||
+      (DW_OP_reg0 <= opcode && opcode <= DW_OP_reg31)) {
+    return true;
+  }
+  if (DW_OP_breg0 <= opcode && opcode <= DW_OP_breg31) {
+    return reader->readSLEB128(&op->op1);
+  }
 
-        Dwarf_Unsigned size = a.op1;
-        if (size > sizeof(Dwarf_Signed) || size == 0) {
-          return Result::Error(ErrorCode::kIllegalOpd, cur_off);
-        }
+  switch (opcode) {
+    case DW_OP_deref:
+    case DW_OP_dup:
+    case DW_OP_drop:
+    case DW_OP_over:
+    case DW_OP_swap:
+    case DW_OP_rot:
+    case DW_OP_xderef:
+    case DW_OP_abs:
+    case DW_OP_and:
+    case DW_OP_div:
+    case DW_OP_minus:
+    case DW_OP_mod:
+    case DW_OP_mul:
+    case DW_OP_neg:
+    case DW_OP_not:
+    case DW_OP_or:
+    case DW_OP_plus:
+    case DW_OP_shl:
+    case DW_OP_shr:
+    case DW_OP_shra:
+    case DW_OP_xor:
+    case DW_OP_eq:
+    case DW_OP_ge:
+    case DW_OP_gt:
+    case DW_OP_le:
+    case DW_OP_lt:
+    case DW_OP_ne:
+    case DW_OP_nop:
+    case DW_OP_push_object_address:
+    case DW_OP_form_tls_address:
+    case DW_OP_call_frame_cfa:
+    case DW_OP_stack_value:
+    case DW_OP_GNU_push_tls_address:
+    case DW_OP_GNU_uninit:
+      return true;
+
+    case DW_OP_addr:
+      return reader->readUnsigned(addr_size, &op->op1);
+    case DW_OP_const1u:
+    case DW_OP_pick:
+    case DW_OP_deref_size:
+    case DW_OP_xderef_size:
+      return reader->readUnsigned(1, &op->op1);
+    case DW_OP_const1s:
+      return reader->readSigned(1, &op->op1);
+    case DW_OP_const2u:
+    case DW_OP_call2:
+      return reader->readUnsigned(2, &op->op1);
+    case DW_OP_const2s:
+    case DW_OP_skip:
+    case DW_OP_bra:
+      return reader->readSigned(2, &op->op1);
+    case DW_OP_const4u:
+    case DW_OP_call4:
+    case DW_OP_GNU_parameter_ref:
+      return reader->readUnsigned(4, &op->op1);
+    case DW_OP_const4s:
+      return reader->readSigned(4, &op->op1);
+    case DW_OP_const8u:
+      return reader->readUnsigned(8, &op->op1);
+    case DW_OP_const8s:
+      return reader->readSigned(8, &op->op1);
+    case DW_OP_call_ref:
+    case DW_OP_GNU_variable_value:
+      // An address in DWARF 2.
+      return reader->readUnsigned(version < 3 ? addr_size : offset_size,
+                                  &op->op1);
+
+    case DW_OP_constu:
+    case DW_OP_plus_uconst:
+    case DW_OP_regx:
+    case DW_OP_piece:
+    case DW_OP_addrx:
+    case DW_OP_constx:
+    case DW_OP_convert:
+    case DW_OP_reinterpret:
+    case DW_OP_GNU_convert:
+    case DW_OP_GNU_reinterpret:
+    case DW_OP_GNU_addr_index:
+    case DW_OP_GNU_const_index:
+      return reader->readULEB128(&op->op1);
+    case DW_OP_consts:
+    case DW_OP_fbreg:
+      return reader->readSLEB128(&op->op1);
+    case DW_OP_bregx:
+      return reader->readULEB128(&op->op1) && reader->readSLEB128(&op->op2);
+    case DW_OP_bit_piece:
+    case DW_OP_regval_type:
+    case DW_OP_GNU_regval_type:
+      return reader->readULEB128(&op->op1) && reader->readULEB128(&op->op2);
+    case DW_OP_deref_type:
+    case DW_OP_xderef_type:
+    case DW_OP_GNU_deref_type:
+      return reader->readUnsigned(1, &op->op1) &&
+             reader->readULEB128(&op->op2);
+    case DW_OP_implicit_pointer:
+    case DW_OP_GNU_implicit_pointer:
+      return reader->readUnsigned(version < 3 ? addr_size : offset_size,
+                                  &op->op1) &&
+             reader->readSLEB128(&op->op2);
+
+    // The operand is the length of the block, then its address.
+    case DW_OP_implicit_value:
+    case DW_OP_entry_value:
+    case DW_OP_GNU_entry_value:
+      return reader->readULEB128(&op->op1) &&
+             readBlock(reader, op->op1, &op->op2);
+    case DW_OP_const_type:
+    case DW_OP_GNU_const_type:
+      return reader->readULEB128(&op->op1) &&
+             reader->readUnsigned(1, &op->op2) &&
+             readBlock(reader, op->op2, &op->op3);
+
+    default:
+      return false;  // unknown size, e.g. DW_OP_GNU_encoded_addr
+  }
+}
 
-        Dwarf_Addr adr = mystack->top();
-        mystack->pop();
+}  // namespace
 
-        char* buf = nullptr;
-        size_t buf_size = 0;
-        if (!context.memory(adr, size, &buf, &buf_size)) {
-          return Result::Error(ErrorCode::kMemoryInvalid, cur_off);
-        }
+// static
+bool DwarfExpression::decode(const void* data, Dwarf_Unsigned size,
+                             Dwarf_Half addr_size, Dwarf_Half offset_size,
+                             Dwarf_Half version, DwarfExpression* expr) {
+  expr->clear();
+  ExprReader reader(static_cast<const uint8_t*>(data), size);
+  while (!reader.done()) {
+    DwarfOp op = {0, 0, 0, 0, reader.offset()};
+    Dwarf_Unsigned opcode = 0;
+    reader.readUnsigned(1, &opcode);
+    op.opcode = static_cast<Dwarf_Small>(opcode);
+    if (!readOperands(&reader, addr_size, offset_size, version, &op)) {
+      expr->clear();
+      return false;
+    }
+    expr->ops_.emplace_back(op);
+  }
+  expr->size_ = size;
+  expr->compile();
+  return true;
+}
 
-        Dwarf_Signed deref_val = 0;
-        char* defref_val_ptr = reinterpret_cast<char*>(&deref_val);
-        for (size_t i = 0; i < sizeof(Dwarf_Signed); i++) {
-          *(defref_val_ptr + i) = i < buf_size ? buf[i] : 0;
-        }
-        mystack->push(deref_val);
-        break;
-      }
+namespace {
 
-        // TODO: case DW_OP_xderef: NOT_IMPLEMENTED
-        // TODO: case DW_OP_xderef_size: NOT_IMPLEMENTED
-        // TODO: case DW_OP_push_object_address: NOT_IMPLEMENTED
-        // TODO: case DW_OP_form_tls_address: NOT_IMPLEMENTED
+using namespace internal;  // the handlers
 
-        // The DW_OP_call_frame_cfa operation pushes the value of the CFA,
-        // obtained from the Call Frame Information (see Section 6.4).
-      case DW_OP_call_frame_cfa: {
-        if (context.cfa == nullptr) {
-          return Result::Error(ErrorCode::kCfaInvalid, cur_off);
-        }
-        Dwarf_Addr addr = context.cfa(pc);
-        mystack->push(addr);
-        break;
-      }
+// The limits of the operands of the typed ops.
+const Dwarf_Unsigned kMaxTypeOffset = std::numeric_limits<uint32_t>::max();
+const Dwarf_Unsigned kMaxTypeSize = 16;
 
-        //
-        // Arithmetic and Logical Operations.
-        // The arithmetic operations perform addressing arithmetic, that is,
-        // unsigned arithmetic that wraps on an address-sized boundary.
-        //
-
-        // Operates on top entry.
-      case DW_OP_abs:
-      case DW_OP_neg:
-      case DW_OP_not:
-      case DW_OP_plus_uconst: {
-        if (mystack->empty()) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
-        Dwarf_Signed top = mystack->top();
-        mystack->pop();
-
-        switch (a.opcode) {
-          // Replace top with it's absolute value.
-          case DW_OP_abs:
-            mystack->push(std::abs(top));
-            break;
-
-          // Negate top.
-          case DW_OP_neg:
-            mystack->push(-top);
-            break;
-
-          // Bitwise complement of the top.
-          case DW_OP_not:
-            mystack->push(~top);
-            break;
-
-          // Top value plus unsigned first operand.
-          case DW_OP_plus_uconst:
-            mystack->push(top + a.op1);
-            break;
-
-          // Should not happen.
-          default:
-            break;
-        }
+// The register of the block of DW_OP_entry_value, only the blocks of a single
+// DW_OP_reg* or DW_OP_regx are supported, as emitted by GCC and Clang.
+bool entryValueRegister(const DwarfOp& a, uint32_t* reg) {
+  // Operand 2 points to the block, like libdwarf.
+  const uint8_t* block = reinterpret_cast<const uint8_t*>(a.op2);
+  if (a.op1 == 0 || block == nullptr) {
+    return false;
+  }
+  ExprReader reader(block, a.op1);
+  Dwarf_Unsigned opcode = 0;
+  Dwarf_Unsigned regx = 0;
+  reader.readUnsigned(1, &opcode);
+  if (DW_OP_reg0 <= opcode && opcode <= DW_OP_reg31) {
+    *reg = static_cast<uint32_t>(opcode - DW_OP_reg0);
+  } else if (opcode == DW_OP_regx && reader.readULEB128(&regx)) {
+    *reg = static_cast<uint32_t>(regx);
+  } else {
+    return false;
+  }
+  return reader.done();
+}
 
-        break;
+uint8_t handlerOf(Dwarf_Small opcode) {
+  if (DW_OP_lit0 <= opcode && opcode <= DW_OP_lit31) {
+    return kPush;
+  }
+  if ((DW_OP_reg0 <= opcode && opcode <= DW_OP_reg31) || opcode == DW_OP_regx) {
+    return kReg;
+  }
+  if ((DW_OP_breg0 <= opcode && opcode <= DW_OP_breg31) ||
+      opcode == DW_OP_bregx) {
+    return kBreg;
+  }
+  switch (opcode) {
+    case DW_OP_addr:
+    case DW_OP_const1u:
+    case DW_OP_const1s:
+    case DW_OP_const2u:
+    case DW_OP_const2s:
+    case DW_OP_const4u:
+    case DW_OP_const4s:
+    case DW_OP_const8u:
+    case DW_OP_const8s:
+    case DW_OP_constu:
+    case DW_OP_consts:
+      return kPush;
+    case DW_OP_fbreg:
+      return kFbreg;
+    case DW_OP_dup:
+      return kDup;
+    case DW_OP_drop:
+      return kDrop;
+    case DW_OP_pick:
+      return kPick;
+    case DW_OP_over:
+      return kOver;
+    case DW_OP_swap:
+      return kSwap;
+    case DW_OP_rot:
+      return kRot;
+    case DW_OP_deref:
+      return kDeref;
+    case DW_OP_deref_size:
+      return kDerefSize;
+    case DW_OP_call_frame_cfa:
+      return kCallFrameCfa;
+    case DW_OP_abs:
+      return kAbs;
+    case DW_OP_neg:
+      return kNeg;
+    case DW_OP_not:
+      return kNot;
+    case DW_OP_plus_uconst:
+      return kPlusUconst;
+    case DW_OP_and:
+      return kAnd;
+    case DW_OP_div:
+      return kDiv;
+    case DW_OP_minus:
+      return kMinus;
+    case DW_OP_mod:
+      return kMod;
+    case DW_OP_mul:
+      return kMul;
+    case DW_OP_or:
+      return kOr;
+    case DW_OP_plus:
+      return kPlus;
+    case DW_OP_shl:
+      return kShl;
+    case DW_OP_shr:
+      return kShr;
+    case DW_OP_shra:
+      return kShra;
+    case DW_OP_xor:
+      return kXor;
+    case DW_OP_le:
+      return kLe;
+    case DW_OP_ge:
+      return kGe;
+    case DW_OP_eq:
+      return kEq;
+    case DW_OP_lt:
+      return kLt;
+    case DW_OP_gt:
+      return kGt;
+    case DW_OP_ne:
+      return kNe;
+    case DW_OP_skip:
+      return kSkip;
+    case DW_OP_bra:
+      return kBra;
+    case DW_OP_nop:
+      return kNop;
+    case DW_OP_stack_value:
+      return kStackValue;
+    case DW_OP_implicit_value:
+      return kImplicitValue;
+    case DW_OP_piece:
+      return kPiece;
+    case DW_OP_bit_piece:
+      return kBitPiece;
+    case DW_OP_entry_value:
+    case DW_OP_GNU_entry_value:
+      return kEntryValue;
+    case DW_OP_const_type:
+    case DW_OP_GNU_const_type:
+      return kConstType;
+    case DW_OP_regval_type:
+    case DW_OP_GNU_regval_type:
+      return kRegvalType;
+    case DW_OP_deref_type:
+    case DW_OP_GNU_deref_type:
+      return kDerefType;
+    case DW_OP_convert:
+    case DW_OP_GNU_convert:
+      return kConvert;
+    case DW_OP_reinterpret:
+    case DW_OP_GNU_reinterpret:
+      return kReinterpret;
+    default: {
+      const char* opcode_name;
+      if (dwarf_get_OP_name(opcode, &opcode_name) != DW_DLV_OK) {
+        return kIllegalOp;
       }
+      // TODO: DW_OP_xderef, DW_OP_xderef_size, DW_OP_xderef_type,
+      // DW_OP_push_object_address,
+      // DW_OP_form_tls_address, DW_OP_call2, DW_OP_call4, DW_OP_call_ref
+      return kNotImplemented;
+    }
+  }
+}
 
-        // Operates on top two entries.
-      case DW_OP_and:
-      case DW_OP_div:
-      case DW_OP_minus:
-      case DW_OP_mod:
-      case DW_OP_mul:
-      case DW_OP_or:
-      case DW_OP_plus:
-      case DW_OP_shl:
-      case DW_OP_shr:
-      case DW_OP_shra:
-      case DW_OP_xor: {
-        if (mystack->size() < 2) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
-        Dwarf_Signed e1 = mystack->top();
-        mystack->pop();
-        Dwarf_Signed e2 = mystack->top();
-        mystack->pop();
-
-        switch (a.opcode) {
-          // Bitwise and on top 2 values.
-          case DW_OP_and:
-            mystack->push(e1 & e2);
-            break;
-
-          // Second div first from top (signed division).
-          case DW_OP_div:
-            mystack->push(e2 / e1);
-            break;
-
-          // Second minus first from top.
-          case DW_OP_minus:
-            mystack->push(e2 - e1);
-            break;
-
-          // Second modulo first from top.
-          case DW_OP_mod:
-            mystack->push(e2 % e1);
-            break;
-
-          // Second times first from top.
-          case DW_OP_mul:
-            mystack->push(e2 * e1);
-            break;
-
-          // Bitwise or of top 2 entries.
-          case DW_OP_or:
-            mystack->push(e2 | e1);
-            break;
-
-          // Adds together top two entries.
-          case DW_OP_plus:
-            mystack->push(e2 + e1);
-            break;
-
-          // Shift second entry to left by first entry.
-          case DW_OP_shl:
-            mystack->push(e2 << e1);
-            break;
-
-          // Shift second entry to right by first entry.
-          case DW_OP_shr:
-            mystack->push(e2 >> e1);
-            break;
-
-          // Shift second entry arithmetically to right by first entry.
-          case DW_OP_shra:
-            mystack->push(e2 >> e1);
-            break;
-
-          // Bitwise XOR on top two entries.
-          case DW_OP_xor:
-            mystack->push(e2 ^ e1);
-            break;
-
-          // Should not happen.
-          default:
-            break;
-        }
-
-        break;
-      }
+// The bytes of an unsigned or signed LEB128, as encoded by the compilers.
+Dwarf_Unsigned uleb128Size(Dwarf_Unsigned value) {
+  Dwarf_Unsigned size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
 
-        //
-        // Control Flow Operations.
-        //
+Dwarf_Unsigned sleb128Size(Dwarf_Unsigned value) {
+  Dwarf_Signed v = static_cast<Dwarf_Signed>(value);
+  Dwarf_Unsigned size = 1;
+  while (v < -0x40 || v >= 0x40) {
+    v >>= 7;
+    ++size;
+  }
+  return size;
+}
 
-      case DW_OP_le: {
-        Dwarf_Signed e1 = mystack->top();
-        mystack->pop();
-        Dwarf_Signed e2 = mystack->top();
-        mystack->pop();
+// The encoded bytes of the op, for the ops of libdwarf whose expression size
+// is not known. Like readOperands(), the addresses are assumed of 8 bytes and
+// the offsets of 4 bytes. 0 if unknown.
+Dwarf_Unsigned encodedSize(const DwarfOp& a) {
+  Dwarf_Small opcode = a.opcode;
+  if ((DW_OP_lit0 <= opcode && opcode <= DW_OP_lit31) ||
+      (DW_OP_reg0 <= opcode && opcode <= DW_OP_reg31)) {
+    return 1;
+  }
+  if (DW_OP_breg0 <= opcode && opcode <= DW_OP_breg31) {
+    return 1 + sleb128Size(a.op1);
+  }
 
-        mystack->push(e2 <= e1);
-        break;
-      }
+  switch (opcode) {
+    case DW_OP_addr:
+      return 1 + 8;
+    case DW_OP_const1u:
+    case DW_OP_const1s:
+    case DW_OP_pick:
+    case DW_OP_deref_size:
+    case DW_OP_xderef_size:
+      return 1 + 1;
+    case DW_OP_const2u:
+    case DW_OP_const2s:
+    case DW_OP_call2:
+    case DW_OP_skip:
+    case DW_OP_bra:
+      return 1 + 2;
+    case DW_OP_const4u:
+    case DW_OP_const4s:
+    case DW_OP_call4:
+    case DW_OP_call_ref:
+    case DW_OP_GNU_parameter_ref:
+    case DW_OP_GNU_variable_value:
+      return 1 + 4;
+    case DW_OP_const8u:
+    case DW_OP_const8s:
+      return 1 + 8;
+    case DW_OP_constu:
+    case DW_OP_plus_uconst:
+    case DW_OP_regx:
+    case DW_OP_piece:
+    case DW_OP_addrx:
+    case DW_OP_constx:
+    case DW_OP_convert:
+    case DW_OP_reinterpret:
+    case DW_OP_GNU_convert:
+    case DW_OP_GNU_reinterpret:
+    case DW_OP_GNU_addr_index:
+    case DW_OP_GNU_const_index:
+      return 1 + uleb128Size(a.op1);
+    case DW_OP_consts:
+    case DW_OP_fbreg:
+      return 1 + sleb128Size(a.op1);
+    case DW_OP_bregx:
+      return 1 + uleb128Size(a.op1) + sleb128Size(a.op2);
+    case DW_OP_bit_piece:
+    case DW_OP_regval_type:
+    case DW_OP_GNU_regval_type:
+      return 1 + uleb128Size(a.op1) + uleb128Size(a.op2);
+    case DW_OP_deref_type:
+    case DW_OP_xderef_type:
+    case DW_OP_GNU_deref_type:
+      return 1 + 1 + uleb128Size(a.op2);
+    case DW_OP_implicit_pointer:
+    case DW_OP_GNU_implicit_pointer:
+      return 1 + 4 + sleb128Size(a.op2);
+    case DW_OP_implicit_value:
+    case DW_OP_entry_value:
+    case DW_OP_GNU_entry_value:
+      return 1 + uleb128Size(a.op1) + a.op1;
+    case DW_OP_const_type:
+    case DW_OP_GNU_const_type:
+      return 1 + uleb128Size(a.op1) + 1 + a.op2;
+    case DW_OP_GNU_encoded_addr:
+      return 0;
+    default:
+      // The ops without operands, an unknown op can not be branched over.
+      return handlerOf(opcode) == kIllegalOp ? 0 : 1;
+  }
+}
 
-      case DW_OP_ge: {
-        Dwarf_Signed e1 = mystack->top();
-        mystack->pop();
-        Dwarf_Signed e2 = mystack->top();
-        mystack->pop();
+}  // namespace
 
-        mystack->push(e2 >= e1);
-        break;
+// static
+void DwarfExpression::compileOps(const std::vector<DwarfOp>& ops,
+                                 Dwarf_Unsigned size, Program* program) {
+  program->clear();
+  program->reserve(ops.size() + 1);
+  // Only the end of the expression, right after its last op, is a branch
+  // target besides the ops.
+  Dwarf_Unsigned end = size;
+  if (end == 0 && !ops.empty()) {
+    Dwarf_Unsigned last_size = encodedSize(ops.back());
+    end = last_size != 0 ? ops.back().off + last_size : 0;
+  }
+  for (const DwarfOp& a : ops) {
+    Insn insn = {handlerOf(a.opcode), a.opcode, 0, 0, a.op1, a.off};
+    if (DW_OP_lit0 <= a.opcode && a.opcode <= DW_OP_lit31) {
+      insn.value = a.opcode - DW_OP_lit0;
+    } else if (DW_OP_reg0 <= a.opcode && a.opcode <= DW_OP_reg31) {
+      insn.arg = a.opcode - DW_OP_reg0;
+    } else if (DW_OP_breg0 <= a.opcode && a.opcode <= DW_OP_breg31) {
+      insn.arg = a.opcode - DW_OP_breg0;
+    } else if (a.opcode == DW_OP_regx) {
+      insn.arg = static_cast<uint32_t>(a.op1);
+    } else if (a.opcode == DW_OP_bregx) {
+      insn.arg = static_cast<uint32_t>(a.op1);
+      insn.value = a.op2;
+    } else if (a.opcode == DW_OP_piece) {
+      insn.value = a.op1 * 8;  // size in bits
+    } else if (a.opcode == DW_OP_bit_piece) {
+      insn.arg = static_cast<uint32_t>(a.op2);  // offset in bits
+    } else if (a.opcode == DW_OP_implicit_value) {
+      // Operand 2 points to the block, like libdwarf.
+      const uint8_t* block = reinterpret_cast<const uint8_t*>(a.op2);
+      if (a.op1 > sizeof(insn.value) || (a.op1 != 0 && block == nullptr)) {
+        insn.handler = internal::kNotImplemented;
+      } else {
+        insn.value = 0;
+        for (Dwarf_Unsigned i = 0; i < a.op1; ++i) {  // little endian
+          insn.value |= static_cast<Dwarf_Unsigned>(block[i]) << (i * 8);
+        }
       }
-
-      case DW_OP_eq: {
-        Dwarf_Signed e1 = mystack->top();
-        mystack->pop();
-        Dwarf_Signed e2 = mystack->top();
-        mystack->pop();
-
-        mystack->push(e2 == e1);
-        break;
+    } else if (a.opcode == DW_OP_entry_value ||
+               a.opcode == DW_OP_GNU_entry_value) {
+      if (!entryValueRegister(a, &insn.arg)) {
+        insn.handler = internal::kNotImplemented;
       }
-
-      case DW_OP_lt: {
-        Dwarf_Signed e1 = mystack->top();
-        mystack->pop();
-        Dwarf_Signed e2 = mystack->top();
-        mystack->pop();
-
-        mystack->push(e2 < e1);
-        break;
+    } else if (insn.handler == internal::kConstType) {
+      // Operand 3 points to the block of operand 2 bytes, like libdwarf.
+      if (a.op1 > kMaxTypeOffset || a.op2 > kMaxTypeSize || a.op3 == 0) {
+        insn.handler = internal::kNotImplemented;
       }
-
-      case DW_OP_gt: {
-        Dwarf_Signed e1 = mystack->top();
-        mystack->pop();
-        Dwarf_Signed e2 = mystack->top();
-        mystack->pop();
-
-        mystack->push(e2 > e1);
-        break;
+      insn.arg = static_cast<uint32_t>(a.op1);
+      insn.size = static_cast<uint16_t>(a.op2);
+      insn.value = a.op3;
+    } else if (insn.handler == internal::kRegvalType) {
+      insn.arg = static_cast<uint32_t>(a.op1);
+      insn.value = a.op2;  // offset of the type
+    } else if (insn.handler == internal::kDerefType) {
+      if (a.op1 > kMaxTypeSize || a.op2 > kMaxTypeOffset) {
+        insn.handler = internal::kNotImplemented;
       }
-
-      case DW_OP_ne: {
-        Dwarf_Signed e1 = mystack->top();
-        mystack->pop();
-        Dwarf_Signed e2 = mystack->top();
-        mystack->pop();
-
-        mystack->push(e2 != e1);
-        break;
+      insn.size = static_cast<uint16_t>(a.op1);
+      insn.arg = static_cast<uint32_t>(a.op2);
+    } else if (insn.handler == internal::kConvert ||
+               insn.handler == internal::kReinterpret) {
+      if (a.op1 > kMaxTypeOffset) {
+        insn.handler = internal::kNotImplemented;
       }
-
-      case DW_OP_skip: {
-        Dwarf_Unsigned offset = a.off + static_cast<int16_t>(a.op1);
-        int64_t idx = findOpIndexByOffset(offset);
-        if (idx != -1) {
-          i = static_cast<size_t>(idx);  // skip to: current offset + offset
+      insn.arg = static_cast<uint32_t>(a.op1);
+    } else if (a.opcode == DW_OP_skip || a.opcode == DW_OP_bra) {
+      // The offset counts from the end of the op: 1 byte of opcode and the
+      // 2-byte constant.
+      Dwarf_Signed target = static_cast<Dwarf_Signed>(a.off) + 3 +
+                            static_cast<int16_t>(a.op1);
+      insn.arg = internal::kNoTarget;
+      if (target >= 0) {
+        Dwarf_Unsigned target_off = static_cast<Dwarf_Unsigned>(target);
+        auto it = std::lower_bound(
+            ops.begin(), ops.end(), target_off,
+            [](const DwarfOp& op, Dwarf_Unsigned off) { return op.off < off; });
+        if (it != ops.end() && it->off == target_off) {
+          insn.arg = static_cast<uint32_t>(it - ops.begin());
+        } else if (it == ops.end() && end != 0 && target_off == end) {
+          insn.arg = static_cast<uint32_t>(ops.size());  // end of expression
         }
-        break;
       }
+    }
+    program->emplace_back(insn);
+  }
+  // The error of an empty stack at the end is reported at the last op.
+  Dwarf_Unsigned last_off = ops.empty() ? 0 : ops.back().off;
+  program->emplace_back(Insn{internal::kEnd, 0, 0, 0, 0, last_off});
+}
 
-      case DW_OP_bra: {
-        // Requires one stack element.
-        if (mystack->empty()) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
-        // Dwarf_Signed e1 = mystack->top();
-        mystack->pop();
-
-        Dwarf_Unsigned offset = a.off + static_cast<int16_t>(a.op1);
-        int64_t idx = findOpIndexByOffset(offset);
-        if (idx != -1) {
-          i = static_cast<size_t>(idx);  // skip to: current offset + offset
-        }
-        break;
-      }
+void DwarfExpression::compile() { compileOps(ops_, size_, &program_); }
 
-        // TODO: case DW_OP_call2: NOT_IMPLEMENTED
-        // TODO: case DW_OP_call4: NOT_IMPLEMENTED
-        // TODO: case DW_OP_call_ref: NOT_IMPLEMENTED
-
-        //
-        // Implicit Location Descriptions.
-        //
-
-        // TODO: case DW_OP_implicit_value: NOT_IMPLEMENTED
-        // TODO: case DW_OP_piece: NOT_IMPLEMENTED
-        // TODO: case DW_OP_bit_piece: NOT_IMPLEMENTED
-
-        //
-        // Special Operations.
-        //
-
-      // This has no effect.
-      case DW_OP_nop:
-        break;
-
-        //
-        // Object does not exist in memory but its value is known and it is at
-        // the top of the DWARF expression stack. DWARF expression represents
-        // actual value of the object, rather then its location.
-        // DW_OP_stack_alue operation terminates the expression.
-        //
-      case DW_OP_stack_value: {
-        if (mystack->empty()) {
-          return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
-        }
-        Dwarf_Addr value = mystack->top();
-        return Result::Value(value);
-      }
+DwarfExpression::Result DwarfExpression::evaluate(
+    const Context& context, Dwarf_Addr pc,
+    std::stack<Dwarf_Signed>* mystack) const {
+  DwarfStack stack;
+  if (mystack != nullptr) {
+    std::vector<Dwarf_Signed> values;
+    for (std::stack<Dwarf_Signed> t = *mystack; !t.empty(); t.pop()) {
+      values.push_back(t.top());
+    }
+    for (auto it = values.rbegin(); it != values.rend(); ++it) {
+      stack.push(*it);
+    }
+  }
 
-        //
-        // Invalid or unrecognized operations.
-        //
-      default: {
-        const char* op_name;
-        if (dwarf_get_OP_name(a.opcode, &op_name) == DW_DLV_OK) {
-          printf("Error: not implemented op: %s\n", op_name);
-        }
-        return Result::Error(ErrorCode::kNotImplemented, cur_off);
-      }
-    }  // switch
-  }    // for
+  Result result = evaluate(context, context.registers, context.memory,
+                           context.cfa, pc, &stack);
 
-  if (mystack->empty()) {
-    return Result::Error(ErrorCode::kStackIndexInvalid, cur_off);
+  if (mystack != nullptr) {
+    *mystack = std::stack<Dwarf_Signed>();
+    for (size_t i = stack.size(); i > 0; --i) {
+      mystack->push(stack.at(i - 1));
+    }
   }
+  return result;
+}
 
-  Dwarf_Addr value = mystack->top();
-  return Result::Address(value);
-}  // end of DwarfExpression::evaluate
+template DwarfExpression::Result DwarfExpression::evaluate(
+    const Context& context, const RegisterProvider& registers,
+    const MemoryProvider& memory, const CfaProvider& cfa, Dwarf_Addr pc,
+    DwarfStack* stack) const;
 
 int64_t DwarfExpression::findOpIndexByOffset(Dwarf_Unsigned off) const {
   for (size_t i = 0; i < ops_.size(); ++i) {
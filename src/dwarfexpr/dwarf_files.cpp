@@ -0,0 +1,33 @@
+#include "dwarfexpr/dwarf_files.h"
+
+namespace dwarfexpr {
+
+DwarfFilePool* DwarfFilePool::global() {
+  static DwarfFilePool pool;
+  return &pool;
+}
+
+DwarfFileId DwarfFilePool::intern(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = ids_.find(&path);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  DwarfFileId id = static_cast<DwarfFileId>(paths_.size());
+  paths_.push_back(path);
+  ids_.emplace(&paths_.back(), id);
+  return id;
+}
+
+const std::string& DwarfFilePool::path(DwarfFileId id,
+                                       const std::string& def_val) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return id < paths_.size() ? paths_[id] : def_val;
+}
+
+size_t DwarfFilePool::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return paths_.size();
+}
+
+}  // namespace dwarfexpr
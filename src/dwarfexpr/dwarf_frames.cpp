@@ -1,7 +1,6 @@
 #include "dwarfexpr/dwarf_frames.h"
 
-#include <cstdlib>  // std::abs
-#include <cinttypes>
+#include <algorithm>  // std::sort
 
 #include "dwarfexpr/dwarf_expression.h"
 #include "dwarfexpr/dwarf_utils.h"
@@ -25,16 +24,12 @@ Dwarf_Addr DwarfFrames::GetCfa(const DwarfExpression::Context& context,
     Dwarf_Error err = nullptr;
     if (dwarf_get_fde_at_pc(fde_list.fde_data, pc, &fde, &low_pc, &high_pc,
                             &err) == DW_DLV_OK) {
-      Dwarf_Off fde_off = 0;
-      Dwarf_Off cie_off = 0;
-      if (dwarf_fde_section_offset(dbg_, fde, &fde_off, &cie_off, &err) ==
-          DW_DLV_OK) {
-        printf("fde_off: 0x%llx [0x%llx - 0x%llx], cie_off: 0x%llx\n", fde_off,
-               low_pc, high_pc, cie_off);
+      if (DWARFEXPR_TRACING(context.tracer)) {
+        context.tracer->onEvent(DwarfTraceEvent::Range(
+            DwarfTraceEvent::Type::kFde, pc, low_pc, high_pc));
       }
       for (Dwarf_Addr p = low_pc; p < high_pc; ++p) {
         // cfa
-        printf("0x%llx: ", p);
         FdeInfo info = {};
         if (dwarf_get_fde_info_for_cfa_reg3_b(
                 fde, p, &info.value_type, &info.offset_relevant, &info.reg,
@@ -42,7 +37,6 @@ Dwarf_Addr DwarfFrames::GetCfa(const DwarfExpression::Context& context,
                 &info.subsequent_pc, &err) == DW_DLV_OK) {
           cfa = GetReg(context, DW_FRAME_CFA_COL, p, info);
           if (cfa == MAX_DWARF_ADDR) {
-            printf("Error: can not get the value for cfa\n");
             continue;
           }
           info.cfa = cfa;
@@ -71,9 +65,7 @@ Dwarf_Addr DwarfFrames::GetCfa(const DwarfExpression::Context& context,
             break;
           }
         }
-        printf("\n");
       }
-      printf("\n");
     }
   }
 
@@ -84,17 +76,106 @@ static inline Dwarf_Signed dwarf_unsigned2signed(Dwarf_Unsigned v) {
   return *reinterpret_cast<Dwarf_Signed*>(&v);
 }
 
-static inline std::string regname(int reg) {  // TODO: arm64 only
-  if (reg == DW_FRAME_CFA_COL) {
-    return "CFA";
-  } else if (reg == 29) {
-    return "W29(FP)";
-  } else if (reg == 30) {
-    return "W30(LR)";
-  } else if (reg == 31) {
-    return "W31(SP)";
+bool DwarfFrames::GetAllCfi(Dwarf_Half reg_count,
+                            std::vector<CfiTable>* tables) const {
+  tables->clear();
+  DwarfFrames::FdeList fde_list;
+  if (!GetAllFde(&fde_list) || fde_list.fde_data == nullptr) {
+    return false;
+  }
+  auto fde_list_guard = make_scope_exit([&]() {
+    dwarf_dealloc_fde_cie_list(dbg_, fde_list.cie_data,
+                               fde_list.cie_element_count, fde_list.fde_data,
+                               fde_list.fde_element_count);
+  });
+
+  Dwarf_Error err = nullptr;
+  std::vector<Dwarf_Regtable_Entry3> rules(reg_count);
+  Dwarf_Regtable3 reg_table = {};
+  reg_table.rt3_rules = rules.data();
+  for (Dwarf_Signed i = 0; i < fde_list.fde_element_count; ++i) {
+    Dwarf_Fde fde = fde_list.fde_data[i];
+    CfiTable table = {};
+    Dwarf_Unsigned func_length = 0;
+    Dwarf_Small* fde_bytes = nullptr;
+    Dwarf_Unsigned fde_byte_length = 0;
+    Dwarf_Off cie_offset = 0;
+    Dwarf_Signed cie_index = 0;
+    Dwarf_Off fde_offset = 0;
+    if (dwarf_get_fde_range(fde, &table.low_pc, &func_length, &fde_bytes,
+                            &fde_byte_length, &cie_offset, &cie_index,
+                            &fde_offset, &err) != DW_DLV_OK ||
+        func_length == 0) {
+      continue;
+    }
+    table.high_pc = table.low_pc + func_length;
+
+    Dwarf_Cie cie = nullptr;
+    Dwarf_Unsigned bytes_in_cie = 0;
+    Dwarf_Small cie_version = 0;
+    char* augmenter = nullptr;
+    Dwarf_Unsigned code_alignment_factor = 0;
+    Dwarf_Signed data_alignment_factor = 0;
+    Dwarf_Small* initial_instructions = nullptr;
+    Dwarf_Unsigned initial_instructions_length = 0;
+    Dwarf_Half cie_offset_size = 0;
+    table.ra_reg = DW_FRAME_UNDEFINED_VAL;
+    if (dwarf_get_cie_of_fde(fde, &cie, &err) == DW_DLV_OK) {
+      dwarf_get_cie_info_b(cie, &bytes_in_cie, &cie_version, &augmenter,
+                           &code_alignment_factor, &data_alignment_factor,
+                           &table.ra_reg, &initial_instructions,
+                           &initial_instructions_length, &cie_offset_size,
+                           &err);
+    }
+
+    // Walk the rows, `subsequent_pc` is the pc of the next row.
+    Dwarf_Addr pc = table.low_pc;
+    while (pc < table.high_pc) {
+      CfiRow row;
+      row.pc = pc;
+      Dwarf_Block block = {};
+      Dwarf_Addr row_pc = 0;
+      Dwarf_Bool has_more_rows = false;
+      Dwarf_Addr subsequent_pc = 0;
+      Dwarf_Unsigned offset = 0;
+      if (dwarf_get_fde_info_for_cfa_reg3_b(
+              fde, pc, &row.cfa.value_type, &row.cfa.offset_relevant,
+              &row.cfa.reg, &offset, &block, &row_pc, &has_more_rows,
+              &subsequent_pc, &err) != DW_DLV_OK) {
+        break;
+      }
+      row.cfa.offset = dwarf_unsigned2signed(offset);
+
+      // The rules of all the registers of the row at once.
+      reg_table.rt3_reg_table_size = reg_count;
+      if (dwarf_get_fde_info_for_all_regs3(fde, pc, &reg_table, &row_pc,
+                                           &err) != DW_DLV_OK) {
+        break;
+      }
+      row.regs.resize(reg_count);
+      for (Dwarf_Half x = 0; x < reg_count; ++x) {
+        const Dwarf_Regtable_Entry3& entry = rules[x];
+        CfiRule& rule = row.regs[x];
+        rule.value_type = entry.dw_value_type;
+        rule.offset_relevant = entry.dw_offset_relevant;
+        rule.reg = entry.dw_regnum;
+        rule.offset = dwarf_unsigned2signed(entry.dw_offset);
+      }
+      table.rows.emplace_back(std::move(row));
+
+      if (!has_more_rows || subsequent_pc <= pc) {
+        break;
+      }
+      pc = subsequent_pc;
+    }
+    tables->emplace_back(std::move(table));
   }
-  return std::string("W") + std::to_string(reg);
+
+  std::sort(tables->begin(), tables->end(),
+            [](const CfiTable& a, const CfiTable& b) {
+              return a.low_pc < b.low_pc;
+            });
+  return true;
 }
 
 Dwarf_Addr DwarfFrames::GetReg(const DwarfExpression::Context& context,
@@ -107,8 +188,8 @@ Dwarf_Addr DwarfFrames::GetReg(const DwarfExpression::Context& context,
     return result;
   }
 
-  printf("%s=", regname(i).c_str());
   Dwarf_Signed offset = dwarf_unsigned2signed(info.offset);
+  Dwarf_Addr addr = 0;  // where the value is read
   switch (info.value_type) {
     case DW_EXPR_OFFSET:
       // src/lib/libdwarf/dwarf_frame.c case DW_CFA_def_cfa:
@@ -116,85 +197,91 @@ Dwarf_Addr DwarfFrames::GetReg(const DwarfExpression::Context& context,
       // 1. DWARF_LOCATION_REGISTER
       // 2. DWARF_LOCATION_VAL_EXPRESSION
       if (info.offset_relevant != 0 && i != DW_FRAME_CFA_COL) {
-        printf("Offset(N): %s%s%lld ", regname(info.reg).c_str(),
-               offset >= 0 ? "+" : "-", std::abs(offset));
-        Dwarf_Addr addr = info.cfa + offset;
-
-        Dwarf_Addr val =
+        addr = info.cfa + offset;
+        result =
             DwarfExpression::readMemory(context.memory, addr, MAX_DWARF_ADDR);
-        if (val == MAX_DWARF_ADDR) {
-          printf("Error: can not read memory at addr 0x%llx\n", addr);
-          break;
-        }
-        result = val;
-        printf("addr=0x%llx, val=0x%llx\n", addr, result);
       } else {
-        printf("register(R): %s%s%lld ", regname(info.reg).c_str(),
-               offset >= 0 ? "+" : "-", std::abs(offset));
         uint64_t reg_val = 0;
-        if (!context.registers(info.reg, &reg_val)) {
-          printf("Error: can not read register, reg_num: %llu\n", info.reg);
-          break;
+        if (context.registers(info.reg, &reg_val)) {
+          result = reg_val + offset;
         }
-        result = reg_val + offset;
-        printf("register=%llu, reg_val=0x%" PRIx64 ", offset=%lld, val=0x%llx\n", info.reg,
-               reg_val, offset, result);
       }
       break;
     case DW_EXPR_VAL_OFFSET: {
-      printf("val_offset(N): %s%s%lld ", regname(info.reg).c_str(),
-             offset >= 0 ? "+" : "-", std::abs(offset));
       result = info.cfa + offset;
       break;
     }
     case DW_EXPR_EXPRESSION: {
-      printf("expression(E): ");
-      Dwarf_Addr addr = EvalExpr(context, i, pc, info);
-      Dwarf_Addr val =
+      addr = EvalExpr(context, i, pc, info);
+      result =
           DwarfExpression::readMemory(context.memory, addr, MAX_DWARF_ADDR);
-      if (val == MAX_DWARF_ADDR) {
-        printf("Error: can not read memory at addr 0x%llx\n", addr);
-        break;
-      }
-      result = val;
       break;
     }
     case DW_EXPR_VAL_EXPRESSION: {
-      printf("val_expression(E): ");
       result = EvalExpr(context, i, pc, info);
       break;
     }
     default:
       break;
   }
+
+  if (DWARFEXPR_TRACING(context.tracer)) {
+    DwarfTraceEvent event = DwarfTraceEvent::Make(
+        result != MAX_DWARF_ADDR ? DwarfTraceEvent::Type::kRegisterRule
+                                 : DwarfTraceEvent::Type::kRegisterRuleFailed,
+        pc);
+    event.reg = i;
+    event.value_type = info.value_type;
+    event.base_reg = info.reg;
+    event.offset = offset;
+    event.addr = addr;
+    event.value = result;
+    context.tracer->onEvent(event);
+  }
   return result;
 }
 
 Dwarf_Addr DwarfFrames::EvalExpr(const DwarfExpression::Context& context,
                                  Dwarf_Half i, Dwarf_Addr pc,
                                  const DwarfFrames::FdeInfo& info) const {
-  Dwarf_Addr result = MAX_DWARF_ADDR;
+  DwarfExpression::Result expr_result = DwarfExpression::Result::Error(
+      DwarfExpression::ErrorCode::kIllegalOp, 0);
 
-  Dwarf_Loc_Head_c head = 0;
-  Dwarf_Unsigned ulistlen = 0;
-  Dwarf_Error err = nullptr;
-  if (dwarf_loclist_from_expr_c(dbg_, info.block.bl_data, info.block.bl_len,
-                                addr_size_, offset_size_, version_, &head,
-                                &ulistlen, &err) == DW_DLV_OK) {
-    auto guard = make_scope_exit([&]() { dwarf_dealloc_loc_head_c(head); });
-
-    DwarfExpression expr;
-    Dwarf_Addr lowAddr = 0;
-    Dwarf_Addr highAddr = 0;
-    if (DwarfExpression::loadExprFromLoclist(head, 0, &expr, &lowAddr,
-                                             &highAddr)) {
-      DwarfExpression::Result expr_result = expr.evaluate(context, pc);
-      if (expr_result.valid()) {
-        result = expr_result.value;
-      }  // TODO: print error
+  DwarfExpression expr;
+  if (DwarfExpression::decode(info.block.bl_data, info.block.bl_len,
+                              addr_size_, offset_size_, version_, &expr)) {
+    expr_result = expr.evaluate(context, pc);
+  } else {
+    // An op unknown to the decoder, let libdwarf do it.
+    Dwarf_Loc_Head_c head = 0;
+    Dwarf_Unsigned ulistlen = 0;
+    Dwarf_Error err = nullptr;
+    if (dwarf_loclist_from_expr_c(dbg_, info.block.bl_data, info.block.bl_len,
+                                  addr_size_, offset_size_, version_, &head,
+                                  &ulistlen, &err) == DW_DLV_OK) {
+      auto guard = make_scope_exit([&]() { dwarf_dealloc_loc_head_c(head); });
+
+      Dwarf_Addr lowAddr = 0;
+      Dwarf_Addr highAddr = 0;
+      if (DwarfExpression::loadExprFromLoclist(head, 0, &expr, &lowAddr,
+                                               &highAddr)) {
+        expr_result = expr.evaluate(context, pc);
+      }
     }
   }
-  return result;
+
+  if (expr_result.valid()) {
+    return expr_result.value;
+  }
+  if (DWARFEXPR_TRACING(context.tracer)) {
+    DwarfTraceEvent event =
+        DwarfTraceEvent::Make(DwarfTraceEvent::Type::kExpressionFailed, pc);
+    event.reg = i;
+    event.addr = expr_result.error_addr;
+    event.value = static_cast<uint64_t>(expr_result.error_code);
+    context.tracer->onEvent(event);
+  }
+  return MAX_DWARF_ADDR;
 }
 
 bool DwarfFrames::GetAllFde(DwarfFrames::FdeList* fde_list) const {
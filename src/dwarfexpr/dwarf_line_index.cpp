@@ -0,0 +1,89 @@
+#include "dwarfexpr/dwarf_line_index.h"
+
+#include <algorithm>  // std::max, std::sort, std::lower_bound
+#include <iterator>   // std::make_move_iterator
+
+namespace dwarfexpr {
+
+bool DwarfLineIndex::entryLess(const Entry& a, const Entry& b) {
+  if (a.file != b.file) {
+    return a.file < b.file;
+  }
+  if (a.line != b.line) {
+    return a.line < b.line;
+  }
+  return a.low < b.low;
+}
+
+void DwarfLineIndex::addTable(const DwarfLineTable& table) {
+  table.forEachRow([&](const DwarfLineEntry& row, Dwarf_Addr end) {
+    if (row.file != kDwarfNoFileId && row.line != 0 && row.addr < end) {
+      entries_.push_back({row.file, row.line, row.addr, end});
+    }
+  });
+}
+
+void DwarfLineIndex::merge(DwarfLineIndex* other) {
+  entries_.insert(entries_.end(),
+                  std::make_move_iterator(other->entries_.begin()),
+                  std::make_move_iterator(other->entries_.end()));
+  other->entries_.clear();
+  other->files_.clear();
+}
+
+void DwarfLineIndex::finalize() {
+  std::sort(entries_.begin(), entries_.end(), entryLess);
+
+  // Join the adjacent and overlapped ranges of the same line.
+  std::vector<Entry> joined;
+  joined.reserve(entries_.size());
+  for (const Entry& e : entries_) {
+    if (!joined.empty()) {
+      Entry& last = joined.back();
+      if (last.file == e.file && last.line == e.line && e.low <= last.high) {
+        last.high = std::max(last.high, e.high);
+        continue;
+      }
+    }
+    joined.push_back(e);
+  }
+  joined.shrink_to_fit();
+  entries_.swap(joined);
+
+  files_.clear();
+  for (const Entry& e : entries_) {
+    if (files_.empty() || files_.back() != e.file) {
+      files_.push_back(e.file);
+    }
+  }
+}
+
+bool DwarfLineIndex::find(DwarfFileId file, uint32_t line,
+                          std::vector<DwarfLineAddrRange>* out_ranges) const {
+  out_ranges->clear();
+  Entry key = {file, line, 0, 0};
+  auto it = std::lower_bound(entries_.begin(), entries_.end(), key, entryLess);
+  for (; it != entries_.end() && it->file == file && it->line == line; ++it) {
+    out_ranges->push_back({it->low, it->high});
+  }
+  return !out_ranges->empty();
+}
+
+std::vector<DwarfFileId> DwarfLineIndex::findFiles(
+    const std::string& name) const {
+  std::vector<DwarfFileId> result;
+  const DwarfFilePool* pool = DwarfFilePool::global();
+  static const std::string kNone;
+  for (DwarfFileId file : files_) {
+    const std::string& path = pool->path(file, kNone);
+    if (path == name ||
+        (path.size() > name.size() &&
+         path.compare(path.size() - name.size(), name.size(), name) == 0 &&
+         path[path.size() - name.size() - 1] == '/')) {
+      result.push_back(file);
+    }
+  }
+  return result;
+}
+
+}  // namespace dwarfexpr
@@ -0,0 +1,301 @@
+#include "dwarfexpr/dwarf_lines.h"
+
+#include <algorithm>  // std::max, std::stable_sort, std::upper_bound
+
+namespace dwarfexpr {
+
+int DwarfLineTable::load(Dwarf_Debug dbg, Dwarf_Die cu_die,
+                         Dwarf_Error* errp) {
+  std::vector<DwarfLineRow> rows;
+  std::vector<std::string> files;
+  int res = getLineRows(dbg, cu_die, &rows, &files, errp);
+  if (res != DW_DLV_OK) {
+    return res;
+  }
+  build(rows, files);
+
+  Dwarf_Half version = 2;
+  Dwarf_Half offset_size = 0;
+  if (dwarf_get_version_of_die(cu_die, &version, &offset_size) == DW_DLV_OK) {
+    file_base_ = version >= 5 ? 0 : 1;
+  }
+  return DW_DLV_OK;
+}
+
+namespace {
+
+// Flags of the first byte of an encoded row.
+enum : uint8_t {
+  kRowIsStmt = 1 << 0,
+  kRowHasFile = 1 << 1,  // the file differs from the previous row
+  kRowHasColumn = 1 << 2,
+  kRowHasDiscriminator = 1 << 3,
+};
+
+void putULEB128(std::vector<uint8_t>* out, uint64_t value) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    out->push_back(value != 0 ? (byte | 0x80) : byte);
+  } while (value != 0);
+}
+
+void putSLEB128(std::vector<uint8_t>* out, int64_t value) {
+  bool more = true;
+  while (more) {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;  // arithmetic shift
+    more = !((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40)));
+    out->push_back(more ? (byte | 0x80) : byte);
+  }
+}
+
+uint64_t getULEB128(const uint8_t** ptr) {
+  uint64_t value = 0;
+  unsigned shift = 0;
+  uint8_t byte = 0;
+  do {
+    byte = *(*ptr)++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+int64_t getSLEB128(const uint8_t** ptr) {
+  int64_t value = 0;
+  unsigned shift = 0;
+  uint8_t byte = 0;
+  do {
+    byte = *(*ptr)++;
+    value |= static_cast<int64_t>(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  if (shift < 64 && (byte & 0x40)) {
+    value |= -(static_cast<int64_t>(1) << shift);  // sign extend
+  }
+  return value;
+}
+
+}  // namespace
+
+void DwarfLineTable::build(const std::vector<DwarfLineRow>& rows,
+                           const std::vector<std::string>& files) {
+  sequences_.clear();
+  max_high_.clear();
+  blocks_.clear();
+  data_.clear();
+  files_.clear();
+  files_.reserve(files.size());
+  for (const std::string& file : files) {
+    files_.push_back(DwarfFilePool::global()->intern(file));
+  }
+
+  // Split the rows by sequence, a sequence ends with its end_sequence row.
+  struct RowRange {
+    size_t begin;
+    size_t end;  // index of the end_sequence row
+  };
+  std::vector<RowRange> ranges;
+  size_t begin = 0;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    if (rows[i].end_sequence) {
+      if (i > begin && rows[begin].addr < rows[i].addr) {
+        ranges.push_back({begin, i});
+      }
+      begin = i + 1;
+    }
+  }
+  // stable sort: keep the order of the table for the same start address.
+  std::stable_sort(ranges.begin(), ranges.end(),
+                   [&](const RowRange& a, const RowRange& b) {
+                     return rows[a.begin].addr < rows[b.begin].addr;
+                   });
+
+  sequences_.reserve(ranges.size());
+  max_high_.reserve(ranges.size());
+  for (const RowRange& range : ranges) {
+    DwarfLineSequence seq;
+    seq.low = rows[range.begin].addr;
+    seq.high = rows[range.end].addr;
+    seq.begin = static_cast<uint32_t>(blocks_.size());
+    encodeSequence(&rows[range.begin], range.end - range.begin);
+    seq.end = static_cast<uint32_t>(blocks_.size());
+    sequences_.push_back(seq);
+    max_high_.push_back(max_high_.empty()
+                            ? seq.high
+                            : std::max(max_high_.back(), seq.high));
+  }
+  blocks_.shrink_to_fit();
+  data_.shrink_to_fit();
+}
+
+void DwarfLineTable::encodeSequence(const DwarfLineRow* rows, size_t count) {
+  size_t block_rows = 0;
+  const DwarfLineRow* prev = nullptr;
+  for (size_t i = 0; i < count; ++i) {
+    const DwarfLineRow& row = rows[i];
+    // The rows of the same address stay in one block, so that the is_stmt
+    // row among them can be picked by decoding a single block.
+    bool new_block = prev == nullptr || (block_rows >= kDwarfLineBlockSize &&
+                                         row.addr != prev->addr);
+    if (new_block) {
+      blocks_.push_back({row.addr, static_cast<uint32_t>(row.line),
+                         static_cast<uint32_t>(data_.size())});
+      block_rows = 0;
+    }
+    Dwarf_Addr prev_addr = new_block ? row.addr : prev->addr;
+    uint32_t prev_line =
+        static_cast<uint32_t>(new_block ? row.line : prev->line);
+
+    uint8_t flags = row.is_stmt ? kRowIsStmt : 0;
+    if (new_block || row.file != prev->file) {
+      flags |= kRowHasFile;
+    }
+    if (row.column != 0) {
+      flags |= kRowHasColumn;
+    }
+    if (row.discriminator != 0) {
+      flags |= kRowHasDiscriminator;
+    }
+    data_.push_back(flags);
+    putULEB128(&data_, row.addr - prev_addr);
+    putSLEB128(&data_, static_cast<int64_t>(static_cast<uint32_t>(row.line)) -
+                           static_cast<int64_t>(prev_line));
+    if (flags & kRowHasFile) {
+      // 0 for an unknown file
+      putULEB128(&data_, row.file < files_.size() ? row.file + 1 : 0);
+    }
+    if (flags & kRowHasColumn) {
+      putULEB128(&data_, row.column);
+    }
+    if (flags & kRowHasDiscriminator) {
+      putULEB128(&data_, row.discriminator);
+    }
+    prev = &row;
+    ++block_rows;
+  }
+}
+
+bool DwarfLineTable::find(Dwarf_Addr pc, DwarfLineEntry* out_entry) const {
+  // The candidates are the sequences starting at or before the pc, scanned
+  // backward until none of the remaining ones can reach the pc.
+  auto it = std::upper_bound(
+      sequences_.begin(), sequences_.end(), pc,
+      [](Dwarf_Addr pc, const DwarfLineSequence& s) { return pc < s.low; });
+  for (size_t i = it - sequences_.begin(); i-- > 0 && max_high_[i] > pc;) {
+    if (pc < sequences_[i].high) {
+      return findInSequence(sequences_[i], pc, out_entry);
+    }
+  }
+  return false;
+}
+
+void DwarfLineTable::startBlock(size_t block, const uint8_t** out_ptr,
+                                const uint8_t** out_end,
+                                DwarfLineEntry* out_row) const {
+  *out_ptr = data_.data() + blocks_[block].offset;
+  *out_end = block + 1 < blocks_.size()
+                 ? data_.data() + blocks_[block + 1].offset
+                 : data_.data() + data_.size();
+  *out_row = {blocks_[block].addr, kDwarfNoFileId, blocks_[block].line, 0, 0,
+              0};
+}
+
+void DwarfLineTable::decodeRow(const uint8_t** ptr,
+                               DwarfLineEntry* row) const {
+  uint8_t flags = *(*ptr)++;
+  row->addr += getULEB128(ptr);
+  row->line += static_cast<uint32_t>(getSLEB128(ptr));
+  if (flags & kRowHasFile) {
+    uint64_t file = getULEB128(ptr);
+    row->file = file != 0 && file <= files_.size() ? files_[file - 1]
+                                                   : kDwarfNoFileId;
+  }
+  row->column =
+      flags & kRowHasColumn ? static_cast<uint16_t>(getULEB128(ptr)) : 0;
+  row->discriminator = flags & kRowHasDiscriminator
+                           ? static_cast<uint32_t>(getULEB128(ptr))
+                           : 0;
+  row->flags = flags & kRowIsStmt ? kDwarfLineIsStmt : 0;
+}
+
+void DwarfLineTable::forEachRow(const RowVisitor& visitor) const {
+  for (const DwarfLineSequence& seq : sequences_) {
+    // A row covers the addresses up to the next row of its sequence.
+    DwarfLineEntry row;
+    bool has_row = false;
+    for (size_t block = seq.begin; block < seq.end; ++block) {
+      const uint8_t* ptr = nullptr;
+      const uint8_t* end = nullptr;
+      DwarfLineEntry next;
+      startBlock(block, &ptr, &end, &next);
+      while (ptr < end) {
+        decodeRow(&ptr, &next);
+        if (has_row) {
+          visitor(row, next.addr);
+        }
+        row = next;
+        has_row = true;
+      }
+    }
+    if (has_row) {
+      visitor(row, seq.high);
+    }
+  }
+}
+
+bool DwarfLineTable::findInSequence(const DwarfLineSequence& seq,
+                                    Dwarf_Addr pc,
+                                    DwarfLineEntry* out_entry) const {
+  // The block of a pc is the last block whose address is not greater than
+  // it, the first block of the sequence is at `seq.low <= pc`.
+  auto first = blocks_.begin() + seq.begin;
+  auto last = blocks_.begin() + seq.end;
+  auto pc_less = [](Dwarf_Addr pc, const DwarfLineBlock& b) {
+    return pc < b.addr;
+  };
+  size_t block =
+      seq.begin + (std::upper_bound(first, last, pc, pc_less) - first) - 1;
+  const uint8_t* ptr = nullptr;
+  const uint8_t* end = nullptr;
+  DwarfLineEntry row;
+  startBlock(block, &ptr, &end, &row);
+
+  // The row of a pc is the last row whose address is not greater than it,
+  // or the last is_stmt one of the rows at that address.
+  bool found = false;
+  while (ptr < end) {
+    decodeRow(&ptr, &row);
+    if (row.addr > pc) {
+      break;
+    }
+    if (!found || row.addr != out_entry->addr ||
+        (row.flags & kDwarfLineIsStmt) ||
+        !(out_entry->flags & kDwarfLineIsStmt)) {
+      *out_entry = row;
+      found = true;
+    }
+  }
+  return found;
+}
+
+DwarfFileId DwarfLineTable::fileId(Dwarf_Unsigned file_num) const {
+  if (file_num < file_base_ || file_num - file_base_ >= files_.size()) {
+    return kDwarfNoFileId;
+  }
+  return files_[file_num - file_base_];
+}
+
+size_t DwarfLineTable::memoryUsage() const {
+  size_t bytes = sizeof(*this) +
+                 sequences_.capacity() * sizeof(DwarfLineSequence) +
+                 max_high_.capacity() * sizeof(Dwarf_Addr) +
+                 blocks_.capacity() * sizeof(DwarfLineBlock) +
+                 data_.capacity();
+  // The paths are in the DwarfFilePool, shared by all the tables.
+  bytes += files_.capacity() * sizeof(DwarfFileId);
+  return bytes;
+}
+
+}  // namespace dwarfexpr
@@ -4,6 +4,7 @@
 #include <stack>
 #include <utility>  // std::move
 
+#include "dwarfexpr/dwarf_expression_eval.h"
 #include "dwarfexpr/dwarf_utils.h"
 
 namespace dwarfexpr {
@@ -83,6 +84,14 @@ bool DwarfLocation::load() {
       return false;
     }
 
+    LocationExpression loc_expr = {};  // the range is unlimited
+    if (DwarfExpression::decode(blockPtr, retExprLen, addr_size_,
+                                offset_size_, version_, &loc_expr.expr)) {
+      addExpression(std::move(loc_expr));
+      return true;
+    }
+
+    // An op unknown to the decoder, let libdwarf do it.
     Dwarf_Unsigned cnt;  // number of list records
     Dwarf_Loc_Head_c loclist_head = nullptr;
     if (dwarf_loclist_from_expr_c(dbg_, blockPtr, retExprLen, addr_size_,
@@ -95,11 +104,10 @@ bool DwarfLocation::load() {
         make_scope_exit([&]() { dwarf_dealloc_loc_head_c(loclist_head); });
 
     if (cnt > 0) {
-      LocationExpression loc_expr = {};
       if (DwarfExpression::loadExprFromLoclist(loclist_head, 0, &loc_expr.expr,
                                                &loc_expr.lowAddr,
                                                &loc_expr.highAddr)) {
-        exprs_.emplace_back(loc_expr);
+        addExpression(std::move(loc_expr));
       }
     }
     return true;
@@ -119,7 +127,7 @@ bool DwarfLocation::load() {
       if (DwarfExpression::loadExprFromLoclist(loclist_head, i, &loc_expr.expr,
                                                &loc_expr.lowAddr,
                                                &loc_expr.highAddr)) {
-        exprs_.emplace_back(loc_expr);
+        addExpression(std::move(loc_expr));
       }
     }
     return true;
@@ -130,12 +138,12 @@ bool DwarfLocation::load() {
   return true;
 }
 
-DwarfExpression::Result DwarfLocation::evalValue(
+const DwarfLocation::LocationExpression* DwarfLocation::findExpression(
     const DwarfExpression::Context& context, Dwarf_Addr pc) const {
   for (const LocationExpression& e : exprs_) {
     // Expression range is unlimited -> evaluate.
     if (e.lowAddr == 0 && (e.highAddr == 0 || e.highAddr == MAX_DWARF_UNSIGNED)) {
-      return e.expr.evaluate(context, pc);
+      return &e;
     } else {
       // We have got program counter, check if it is in range of the expression.
       // CUs lowpc is base for expression's range.
@@ -143,17 +151,69 @@ DwarfExpression::Result DwarfLocation::evalValue(
       Dwarf_Addr high = e.highAddr + context.cuHighAddr;
 
       if ((pc >= low) && (pc < high)) {
-        printf("evaluateExpression [0x%llx - 0x%llx] pc=0x%llx\n", low, high,
-               pc);
-        return e.expr.evaluate(context, pc);
+        if (DWARFEXPR_TRACING(context.tracer)) {
+          context.tracer->onEvent(DwarfTraceEvent::Range(
+              DwarfTraceEvent::Type::kExpressionRange, pc, low, high));
+        }
+        return &e;
       }
     }
   }
-  printf(
-      "Error: unable to find the target pc in the address range, pc=0x%llx\n",
-      pc);
-  return DwarfExpression::Result::Error(
-      DwarfExpression::ErrorCode::kAddressInvalid, 0);
+  if (DWARFEXPR_TRACING(context.tracer)) {
+    context.tracer->onEvent(
+        DwarfTraceEvent::Make(DwarfTraceEvent::Type::kNoExpression, pc));
+  }
+  return nullptr;
+}
+
+DwarfExpression::Result DwarfLocation::evalValue(
+    const DwarfExpression::Context& context, Dwarf_Addr pc) const {
+  return evalValue(context, context.registers, context.memory, context.cfa,
+                   pc);
+}
+
+template DwarfExpression::Result DwarfLocation::evalValue(
+    const DwarfExpression::Context& context,
+    const DwarfExpression::RegisterProvider& registers,
+    const DwarfExpression::MemoryProvider& memory,
+    const DwarfExpression::CfaProvider& cfa, Dwarf_Addr pc) const;
+
+void DwarfLocation::addExpression(LocationExpression&& loc_expr) {
+  loc_expr.simple = classify(loc_expr.expr);
+  exprs_.emplace_back(std::move(loc_expr));
+}
+
+// static
+DwarfLocation::SimpleLocation DwarfLocation::classify(
+    const DwarfExpression& expr) {
+  SimpleLocation simple = {};
+  if (expr.count() != 1) {
+    return simple;
+  }
+  const DwarfOp& op = expr.getOp(0);
+  simple.opcode = op.opcode;
+  if (op.opcode == DW_OP_fbreg) {
+    simple.kind = SimpleLocation::Kind::kFbreg;
+    simple.value = op.op1;
+  } else if (DW_OP_breg0 <= op.opcode && op.opcode <= DW_OP_breg31) {
+    simple.kind = SimpleLocation::Kind::kBreg;
+    simple.reg = op.opcode - DW_OP_breg0;
+    simple.value = op.op1;
+  } else if (op.opcode == DW_OP_bregx) {
+    simple.kind = SimpleLocation::Kind::kBreg;
+    simple.reg = static_cast<uint32_t>(op.op1);
+    simple.value = op.op2;
+  } else if (DW_OP_reg0 <= op.opcode && op.opcode <= DW_OP_reg31) {
+    simple.kind = SimpleLocation::Kind::kReg;
+    simple.reg = op.opcode - DW_OP_reg0;
+  } else if (op.opcode == DW_OP_regx) {
+    simple.kind = SimpleLocation::Kind::kReg;
+    simple.reg = static_cast<uint32_t>(op.op1);
+  } else if (op.opcode == DW_OP_addr) {
+    simple.kind = SimpleLocation::Kind::kAddr;
+    simple.value = op.op1;
+  }
+  return simple;
 }
 
 void DwarfLocation::dump() const {
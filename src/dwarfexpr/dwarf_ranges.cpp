@@ -0,0 +1,200 @@
+#include "dwarfexpr/dwarf_ranges.h"
+
+#include <algorithm>  // std::stable_sort, std::upper_bound
+#include <map>
+
+namespace dwarfexpr {
+
+namespace {
+
+// The range has no enclosing function.
+const std::size_t kNoParent = static_cast<std::size_t>(-1);
+
+}  // namespace
+
+void DwarfRangeTable::add(Dwarf_Addr low, Dwarf_Addr high, Dwarf_Off offset) {
+  if (low >= high) {
+    return;  // empty range
+  }
+  ranges_.push_back({low, high, offset});
+}
+
+void DwarfRangeTable::finalize() {
+  // stable sort: keep the order of insertion for the same start address.
+  std::stable_sort(ranges_.begin(), ranges_.end(),
+                   [](const DwarfAddrRange& a, const DwarfAddrRange& b) {
+                     return a.low < b.low;
+                   });
+
+  std::vector<DwarfAddrRange> flat;
+  flat.reserve(ranges_.size());
+  for (DwarfAddrRange r : ranges_) {
+    if (!flat.empty()) {
+      DwarfAddrRange& last = flat.back();
+      if (r.low < last.high) {
+        // Overlapped, the range which comes first wins.
+        if (r.high <= last.high) {
+          continue;
+        }
+        r.low = last.high;
+      }
+      if (r.low == last.high && r.offset == last.offset) {
+        last.high = r.high;  // merge the adjacent ranges
+        continue;
+      }
+    }
+    flat.push_back(r);
+  }
+  flat.shrink_to_fit();
+  ranges_.swap(flat);
+}
+
+bool DwarfRangeTable::find(Dwarf_Addr pc, Dwarf_Off* out_offset) const {
+  // Find the first range which starts after the pc, the previous one is the
+  // only candidate.
+  auto it = std::upper_bound(
+      ranges_.begin(), ranges_.end(), pc,
+      [](Dwarf_Addr addr, const DwarfAddrRange& r) { return addr < r.low; });
+  if (it == ranges_.begin()) {
+    return false;
+  }
+  --it;
+  if (pc >= it->high) {
+    return false;
+  }
+  *out_offset = it->offset;
+  return true;
+}
+
+void DwarfFuncTable::add(const DwarfFuncRange& range) {
+  if (range.low >= range.high) {
+    return;  // empty range
+  }
+  ranges_.push_back(range);
+}
+
+void DwarfFuncTable::finalize() {
+  std::stable_sort(ranges_.begin(), ranges_.end(),
+                   [](const DwarfFuncRange& a, const DwarfFuncRange& b) {
+                     if (a.depth != b.depth) {
+                       return a.depth < b.depth;
+                     }
+                     return a.low < b.low;
+                   });
+
+  std::vector<DwarfFuncRange> flat;
+  flat.reserve(ranges_.size());
+  depth_begin_.clear();
+  for (DwarfFuncRange r : ranges_) {
+    if (!flat.empty() && flat.back().depth == r.depth) {
+      DwarfFuncRange& last = flat.back();
+      if (r.low < last.high) {
+        // Overlapped, the range which comes first wins.
+        if (r.high <= last.high) {
+          continue;
+        }
+        r.low = last.high;
+      }
+    }
+    while (static_cast<int>(depth_begin_.size()) <= r.depth) {
+      depth_begin_.push_back(flat.size());
+    }
+    flat.push_back(r);
+  }
+  flat.shrink_to_fit();
+  ranges_.swap(flat);
+
+  // The parent of a range is the one which contains its start at the depth
+  // above.
+  parents_.assign(ranges_.size(), kNoParent);
+  for (std::size_t i = 0; i < ranges_.size(); ++i) {
+    const DwarfFuncRange* parent = find(ranges_[i].low, ranges_[i].depth - 1);
+    if (parent != nullptr) {
+      parents_[i] = parent - ranges_.data();
+    }
+  }
+
+  // Paint the ranges by depth, the deeper ones over the shallower ones, what
+  // stays visible of each range is where it is the innermost function.
+  std::map<Dwarf_Addr, Leaf> pieces;  // by low
+  auto split = [&pieces](Dwarf_Addr addr) {
+    auto it = pieces.upper_bound(addr);
+    if (it == pieces.begin()) {
+      return;
+    }
+    --it;
+    if (it->first < addr && addr < it->second.high) {
+      pieces[addr] = {addr, it->second.high, it->second.index};
+      it->second.high = addr;
+    }
+  };
+  for (std::size_t i = 0; i < ranges_.size(); ++i) {
+    const DwarfFuncRange& r = ranges_[i];
+    split(r.low);
+    split(r.high);
+    pieces.erase(pieces.lower_bound(r.low), pieces.lower_bound(r.high));
+    pieces[r.low] = {r.low, r.high, i};
+  }
+  leaves_.clear();
+  leaves_.reserve(pieces.size());
+  for (const auto& it : pieces) {
+    leaves_.push_back(it.second);
+  }
+}
+
+const DwarfFuncRange* DwarfFuncTable::find(Dwarf_Addr pc, int depth) const {
+  if (depth < 0 || depth > maxDepth()) {
+    return nullptr;
+  }
+  auto begin = ranges_.begin() + depth_begin_[depth];
+  auto end = depth < maxDepth() ? ranges_.begin() + depth_begin_[depth + 1]
+                                : ranges_.end();
+  auto it = std::upper_bound(
+      begin, end, pc,
+      [](Dwarf_Addr addr, const DwarfFuncRange& r) { return addr < r.low; });
+  if (it == begin) {
+    return nullptr;
+  }
+  --it;
+  if (pc >= it->high) {
+    return nullptr;
+  }
+  return &(*it);
+}
+
+const DwarfFuncRange* DwarfFuncTable::findInnermost(Dwarf_Addr pc) const {
+  auto it = std::upper_bound(
+      leaves_.begin(), leaves_.end(), pc,
+      [](Dwarf_Addr addr, const Leaf& leaf) { return addr < leaf.low; });
+  if (it == leaves_.begin()) {
+    return nullptr;
+  }
+  --it;
+  if (pc >= it->high) {
+    return nullptr;
+  }
+  return &ranges_[it->index];
+}
+
+const DwarfFuncRange* DwarfFuncTable::findOutermost(Dwarf_Addr pc) const {
+  const DwarfFuncRange* func = findInnermost(pc);
+  for (const DwarfFuncRange* p = func; p != nullptr; p = parent(p)) {
+    func = p;
+  }
+  return func;
+}
+
+const DwarfFuncRange* DwarfFuncTable::parent(
+    const DwarfFuncRange* range) const {
+  std::size_t index = parents_[range - ranges_.data()];
+  return index == kNoParent ? nullptr : &ranges_[index];
+}
+
+std::size_t DwarfFuncTable::memoryUsage() const {
+  return sizeof(*this) + ranges_.capacity() * sizeof(DwarfFuncRange) +
+         depth_begin_.capacity() * sizeof(std::size_t) +
+         parents_.capacity() * sizeof(std::size_t) +
+         leaves_.capacity() * sizeof(Leaf);
+}
+
+}  // namespace dwarfexpr
@@ -2,335 +2,491 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <map>
 #include <sstream>
 
-#include "dwarfexpr/dwarf_utils.h"  // getLowAndHighPc, getRnglistsBase
-
-/* Adding return codes to DW_DLV, relevant to our purposes here. */
-#define NOT_THIS_CU 10
-#define IN_THIS_CU 11
-#define FOUND_SUBPROG 12
+#include "dwarfexpr/dwarf_attrs.h"  // getAttrValue
+#include "dwarfexpr/dwarf_utils.h"  // getDieRanges
 
 using namespace std;
 
 namespace dwarfexpr {
 
-DwarfSearcher::DwarfSearcher(Dwarf_Debug dbg) : m_dbg(dbg) {}
+DwarfSearcher::DwarfSearcher(Dwarf_Debug dbg)
+    : m_dbg(dbg), m_aranges_loaded(false), m_cu_ranges_loaded(false) {}
 
 DwarfSearcher::~DwarfSearcher() {
   // NOTE: DwarfSearcher does not own m_dbg, DO NOT FREE IT!
 }
 
-int DwarfSearcher::matchCUDie(DwarfCUContext *ctx, Dwarf_Die in_die,
-                              Dwarf_Error *errp) {
-  int res = DW_DLV_NO_ENTRY;
-  bool have_pc_range = false;
-  Dwarf_Addr lowpc = 0;
-  Dwarf_Addr highpc = 0;
-  Dwarf_Off real_ranges_offset = 0;
-
-  res =
-      getLowAndHighPc(ctx->dbg, in_die, &have_pc_range, &lowpc, &highpc, errp);
-  if (res == DW_DLV_OK) {
-    if (have_pc_range) {
-      if (ctx->target_pc < lowpc || ctx->target_pc >= highpc) {
-        /* We have no interest in this CU */
-        res = NOT_THIS_CU;
-      } else {
-        /* td->td_cu_haslowhighpc = have_pc_range; */
-        res = IN_THIS_CU;
-      }
+std::size_t DwarfSearcher::memoryUsage() const {
+  std::size_t bytes = sizeof(*this);
+  bytes += (m_aranges.size() + m_cu_ranges.size()) * sizeof(DwarfAddrRange);
+  bytes += m_aranges_cus.capacity() * sizeof(Dwarf_Off);
+  for (const auto &it : m_func_tables) {
+    bytes += sizeof(it) + it.second.memoryUsage();
+  }
+  for (const auto &it : m_line_tables) {
+    bytes += sizeof(it) + (it.second ? it.second->memoryUsage() : 0);
+  }
+  for (const auto &it : m_call_site_tables) {
+    bytes += sizeof(it) + it.second.memoryUsage();
+  }
+  bytes += m_call_sites.size() * sizeof(*m_call_sites.begin());
+  bytes += m_cu_headers.size() * sizeof(*m_cu_headers.begin());
+  bytes += m_base_types.size() * sizeof(*m_base_types.begin());
+  return bytes;
+}
+
+bool DwarfSearcher::loadAranges(Dwarf_Error *errp) {
+  m_aranges.clear();
+  m_aranges_cus.clear();
+
+  Dwarf_Arange *aranges = nullptr;
+  Dwarf_Signed count = 0;
+  int res = dwarf_get_aranges(m_dbg, &aranges, &count, errp);
+  if (res != DW_DLV_OK) {
+    // DW_DLV_NO_ENTRY: no .debug_aranges section
+    return res == DW_DLV_NO_ENTRY;
+  }
+
+  for (Dwarf_Signed i = 0; i < count; ++i) {
+    Dwarf_Unsigned segment = 0;
+    Dwarf_Unsigned segment_entry_size = 0;
+    Dwarf_Addr start = 0;
+    Dwarf_Unsigned length = 0;
+    Dwarf_Off info_offset = 0;
+    Dwarf_Off cu_offset = 0;
+    if (dwarf_get_arange_info_b(aranges[i], &segment, &segment_entry_size,
+                                &start, &length, &info_offset,
+                                errp) == DW_DLV_OK &&
+        dwarf_get_cu_die_offset(aranges[i], &cu_offset, errp) == DW_DLV_OK) {
+      m_aranges.add(start, start + length, cu_offset);
+      m_aranges_cus.push_back(cu_offset);
     }
+    dwarf_dealloc(m_dbg, aranges[i], DW_DLA_ARANGE);
   }
+  dwarf_dealloc(m_dbg, aranges, DW_DLA_LIST);
+
+  m_aranges.finalize();
+  std::sort(m_aranges_cus.begin(), m_aranges_cus.end());
+  m_aranges_cus.erase(std::unique(m_aranges_cus.begin(), m_aranges_cus.end()),
+                      m_aranges_cus.end());
+  return true;
+}
 
-  Dwarf_Attribute ranges_attr;
-  res = dwarf_attr(in_die, DW_AT_ranges, &ranges_attr, errp);
-  if (res == DW_DLV_OK) {
-    res = dwarf_global_formref(ranges_attr, &real_ranges_offset, errp);
+bool DwarfSearcher::loadCURanges(Dwarf_Error *errp) {
+  m_cu_ranges.clear();
+
+  // loop all cu, must run until DW_DLV_NO_ENTRY to reset the CU iterator of
+  // libdwarf.
+  bool ok = true;
+  for (int cu_number = 0;; ++cu_number) {
+    DwarfCUContext ctx(m_dbg, 0, 1 /* is_info */, 0 /* in_level */, cu_number);
+    Dwarf_Die no_die = 0;
+    int res = DW_DLV_ERROR;
+
+    res = dwarf_next_cu_header_d(m_dbg, ctx.is_info, &ctx.cu_header_length,
+                                 &ctx.version_stamp, &ctx.abbrev_offset,
+                                 &ctx.address_size, &ctx.offset_size,
+                                 &ctx.extension_size, &ctx.signature,
+                                 &ctx.typeoffset, 0, &ctx.header_cu_type, errp);
+    if (res == DW_DLV_ERROR) {
+      ok = false;
+      break;
+    }
+    if (res == DW_DLV_NO_ENTRY) {
+      /* Done. */
+      break;
+    }
+
+    /* The CU will have a single sibling, a cu_die. */
+    res = dwarf_siblingof_b(m_dbg, no_die, ctx.is_info, &ctx.cu_die, errp);
     if (res != DW_DLV_OK) {
-      dwarf_dealloc(ctx->dbg, ranges_attr, DW_DLA_ATTR);
-      return res;
+      /* Impossible case. */
+      continue;
     }
-    dwarf_dealloc(ctx->dbg, ranges_attr, DW_DLA_ATTR);
-
-    Dwarf_Off cu_ranges_base = 0;
-    res = getRnglistsBase(ctx->dbg, in_die, &cu_ranges_base, errp);
-    /*  We can do get ranges now as we already saw
-        ranges base above (if any). */
-    int resr = 0;
-    Dwarf_Ranges *ranges = 0;
-    Dwarf_Signed ranges_count = 0;
-    Dwarf_Unsigned byte_count = 0;
-    Dwarf_Off actualoffset = 0;
-    Dwarf_Signed k = 0;
-    bool done = false;
-
-    resr =
-        dwarf_get_ranges_b(ctx->dbg, real_ranges_offset, in_die, &actualoffset,
-                           &ranges, &ranges_count, &byte_count, errp);
-    if (resr != DW_DLV_OK) {
-      /* Something badly wrong here. */
-      return res;
+
+    Dwarf_Off cu_offset = 0;
+    if (dwarf_dieoffset(ctx.cu_die, &cu_offset, errp) != DW_DLV_OK) {
+      continue;
     }
-    for (k = 0; k < ranges_count && !done; ++k) {
-      Dwarf_Ranges *cur = ranges + k;
-      // Dwarf_Addr lowpcr = 0;
-      // Dwarf_Addr highpcr = 0;
-      Dwarf_Addr baseaddr = cu_ranges_base;
-
-      switch (cur->dwr_type) {
-        case DW_RANGES_ENTRY:
-          lowpc = cur->dwr_addr1 + baseaddr;
-          highpc = cur->dwr_addr2 + baseaddr;
-          // printf("CU range: [0x%llx - 0x%llx]\n", lowpc, highpc);
-          if (ctx->target_pc < lowpc || ctx->target_pc >= highpc) {
-            /* We have no interest in this CU */
-            break;
-          }
-          done = true;
-          res = IN_THIS_CU;
-          break;
-        case DW_RANGES_ADDRESS_SELECTION:
-          baseaddr = cur->dwr_addr2;
-          break;
-        case DW_RANGES_END:
-          break;
-        default:
-          res = DW_DLV_ERROR;
-      }
+    if (std::binary_search(m_aranges_cus.begin(), m_aranges_cus.end(),
+                           cu_offset)) {
+      continue;  // already covered by .debug_aranges
     }
-    dwarf_dealloc_ranges(ctx->dbg, ranges, ranges_count);
-  }
-  return res;
-}
 
-int DwarfSearcher::matchFuncDie(DwarfCUContext *ctx, Dwarf_Die in_die,
-                                Dwarf_Error *errp) {
-  int res = DW_DLV_NO_ENTRY;
-  bool have_pc_range = false;
-  Dwarf_Addr lowpc = 0;
-  Dwarf_Addr highpc = 0;
-  // Dwarf_Off real_ranges_offset = 0;
-  // Dwarf_Bool has_ranges_attr = false;
-
-  res =
-      getLowAndHighPc(ctx->dbg, in_die, &have_pc_range, &lowpc, &highpc, errp);
-  if (res == DW_DLV_OK) {
-    if (have_pc_range) {
-      if (ctx->target_pc < lowpc || ctx->target_pc >= highpc) {
-        /* We have no interest in this subprogram */
-        res = DW_DLV_OK;
-      } else {
-        ctx->func_die = in_die;
-        res = FOUND_SUBPROG;
+    // The base address of `.debug_ranges` entries is the low_pc of the CU.
+    Dwarf_Addr cu_base = 0;
+    if (dwarf_lowpc(ctx.cu_die, &cu_base, errp) != DW_DLV_OK) {
+      cu_base = 0;
+    }
+
+    std::vector<std::pair<Dwarf_Addr, Dwarf_Addr>> ranges;
+    if (getDieRanges(m_dbg, ctx.cu_die, cu_base, &ranges, errp) == DW_DLV_OK) {
+      for (const auto &r : ranges) {
+        m_cu_ranges.add(r.first, r.second, cu_offset);
       }
     }
+    // ctx frees ctx.cu_die
   }
 
-  // TODO: Do we need to check the `DW_AT_ranges` attr for function?
-
-  return res;
+  m_cu_ranges.finalize();
+  return ok;
 }
 
-int DwarfSearcher::searchInDie(DwarfCUContext *ctx, Dwarf_Die in_die,
-                               Dwarf_Error *errp) {
-  Dwarf_Half tag = 0;
-  int res = 0;
+bool DwarfSearcher::listCUs(std::vector<Dwarf_Off> *out_cu_offsets,
+                            Dwarf_Error *errp) {
+  out_cu_offsets->clear();
 
-  res = dwarf_tag(in_die, &tag, errp);
-  if (res != DW_DLV_OK) {
-    return res;
-  }
-
-  if (tag == DW_TAG_subprogram || tag == DW_TAG_inlined_subroutine) {
-    res = matchFuncDie(ctx, in_die, errp);
-    if (res == FOUND_SUBPROG) {
-      ctx->func_die = in_die;
-      return res;
-    } else if (res == DW_DLV_ERROR) {
-      return res;
-    } else if (res == DW_DLV_NO_ENTRY) {
-      /* impossible? */
-      return res;
-    } else if (res == NOT_THIS_CU) {
-      /* impossible */
-      return res;
-    } else if (res == IN_THIS_CU) {
-      /* impossible */
-      return res;
-    } else {
-      /* DW_DLV_OK */
+  // loop all cu, must run until DW_DLV_NO_ENTRY to reset the CU iterator of
+  // libdwarf.
+  bool ok = true;
+  for (int cu_number = 0;; ++cu_number) {
+    DwarfCUContext ctx(m_dbg, 0, 1 /* is_info */, 0 /* in_level */, cu_number);
+    Dwarf_Die no_die = 0;
+    int res = dwarf_next_cu_header_d(
+        m_dbg, ctx.is_info, &ctx.cu_header_length, &ctx.version_stamp,
+        &ctx.abbrev_offset, &ctx.address_size, &ctx.offset_size,
+        &ctx.extension_size, &ctx.signature, &ctx.typeoffset, 0,
+        &ctx.header_cu_type, errp);
+    if (res == DW_DLV_ERROR) {
+      ok = false;
+      break;
+    }
+    if (res == DW_DLV_NO_ENTRY) {
+      /* Done. */
+      break;
     }
-    return DW_DLV_OK;
-  } else if (tag == DW_TAG_compile_unit || tag == DW_TAG_partial_unit ||
-             tag == DW_TAG_type_unit) {
-    if (ctx->in_level) {
-      /*  Something badly wrong, CU DIEs are only
-          at level 0. */
-      return NOT_THIS_CU;
+
+    /* The CU will have a single sibling, a cu_die. */
+    Dwarf_Off cu_offset = 0;
+    if (dwarf_siblingof_b(m_dbg, no_die, ctx.is_info, &ctx.cu_die, errp) ==
+            DW_DLV_OK &&
+        dwarf_dieoffset(ctx.cu_die, &cu_offset, errp) == DW_DLV_OK) {
+      out_cu_offsets->push_back(cu_offset);
     }
-    res = matchCUDie(ctx, in_die, errp);
-    return res;
+    // ctx frees ctx.cu_die
+  }
+  return ok;
+}
+
+bool DwarfSearcher::searchCU(Dwarf_Addr pc, Dwarf_Off *out_cu_offset,
+                             Dwarf_Error *errp) {
+  // Fast path: .debug_aranges, no need to touch .debug_info.
+  if (!m_aranges_loaded) {
+    loadAranges(errp);
+    m_aranges_loaded = true;  // do not try again even if failed
+  }
+  if (m_aranges.find(pc, out_cu_offset)) {
+    return true;
+  }
+
+  // Slow path: decode the ranges of the CUs missing from .debug_aranges.
+  if (!m_cu_ranges_loaded) {
+    loadCURanges(errp);
+    m_cu_ranges_loaded = true;  // do not try again even if failed
   }
-  /*  Keep looking */
-  return DW_DLV_OK;
+  return m_cu_ranges.find(pc, out_cu_offset);
 }
 
 /*  Recursion, following DIE tree.
-    On initial call in_die is a cu_die (in_level 0 )
+    Collect the ranges of all subprograms and inlined subroutines below
+    in_die, `depth` is the depth of the functions found at this level.
 */
-int DwarfSearcher::searchInDieTree(DwarfCUContext *ctx, Dwarf_Die in_die,
-                                   Dwarf_Error *errp) {
-  int res = DW_DLV_ERROR;
-  Dwarf_Die cur_die = in_die;
-  Dwarf_Die child = 0;
-
-  res = searchInDie(ctx, in_die, errp);
-  if (res == DW_DLV_ERROR) {
-    return res;
-  }
-  if (res == DW_DLV_NO_ENTRY) {
-    return res;
-  }
-  if (res == NOT_THIS_CU) {
-    return res;
-  }
-  if (res == IN_THIS_CU) {
-    /*  Fall through to examine details. */
-  } else if (res == FOUND_SUBPROG) {
-    return res;
-  } else {
-    /*  ASSERT: res == DW_DLV_OK */
-    /*  Fall through to examine details. */
-  }
-
-  /*  Now look at the children of the incoming DIE */
-  for (;;) {
-    // Get child.
-    Dwarf_Die sib_die = nullptr;
-    res = dwarf_child(cur_die, &child, errp);
-    if (res == DW_DLV_ERROR) {
-      return res;
-    }
-    // Has child -> recursion.
-    if (res == DW_DLV_OK) {
-      int res2 = 0;
-
-      ctx->in_level += 1;
-      res2 = searchInDieTree(ctx, child, errp);
-      if (child != ctx->cu_die && child != ctx->func_die) {
-        /* No longer need 'child' die. */
-        dwarf_dealloc(ctx->dbg, child, DW_DLA_DIE);
+void DwarfSearcher::collectFuncRanges(Dwarf_Die in_die, Dwarf_Addr cu_base,
+                                      int depth, DwarfFuncTable *table,
+                                      Dwarf_Error *errp) {
+  Dwarf_Die cur_die = nullptr;
+  int res = dwarf_child(in_die, &cur_die, errp);
+  while (res == DW_DLV_OK) {
+    int child_depth = depth;
+    Dwarf_Half tag = 0;
+    if (dwarf_tag(cur_die, &tag, errp) == DW_DLV_OK &&
+        (tag == DW_TAG_subprogram || tag == DW_TAG_inlined_subroutine)) {
+      Dwarf_Off die_offset = 0;
+      std::vector<std::pair<Dwarf_Addr, Dwarf_Addr>> ranges;
+      if (dwarf_dieoffset(cur_die, &die_offset, errp) == DW_DLV_OK &&
+          getDieRanges(m_dbg, cur_die, cu_base, &ranges, errp) == DW_DLV_OK) {
+        Dwarf_Unsigned call_file = 0;
+        Dwarf_Unsigned call_line = 0;
+        if (tag == DW_TAG_inlined_subroutine) {
+          call_file = getAttrValue(m_dbg, cur_die, DW_AT_call_file,
+                                   static_cast<Dwarf_Unsigned>(0));
+          call_line = getAttrValue(m_dbg, cur_die, DW_AT_call_line,
+                                   static_cast<Dwarf_Unsigned>(0));
+        }
+        for (const auto &r : ranges) {
+          table->add(
+              {r.first, r.second, die_offset, depth, call_file, call_line});
+        }
+        child_depth = depth + 1;
       }
-      if (res2 == FOUND_SUBPROG) {
-        return res2;
-      } else if (res2 == IN_THIS_CU) {
-        /* fall thru */
-      } else if (res2 == NOT_THIS_CU) {
-        return res2;
-      } else if (res2 == DW_DLV_ERROR) {
-        return res2;
-      } else if (res2 == DW_DLV_NO_ENTRY) {
-        /* fall thru */
-      } else { /* DW_DLV_OK */
-               /* fall thru */
-      }
-      child = 0;
     }
 
-    // No entry -> no child.
-    res = dwarf_siblingof_b(ctx->dbg, cur_die, ctx->is_info, &sib_die, errp);
-    if (res == DW_DLV_ERROR) {
-      return res;
-    }
-    if (res == DW_DLV_NO_ENTRY) {
-      /* Done at this level. */
-      ctx->in_level -= 1;
-      break;
-    }
-    /* res == DW_DLV_OK */
-    if (cur_die != in_die) {
-      if (child != ctx->cu_die && child != ctx->func_die) {
-        dwarf_dealloc(ctx->dbg, cur_die, DW_DLA_DIE);
-      }
-      cur_die = nullptr;
-    }
+    // Has child -> recursion.
+    collectFuncRanges(cur_die, cu_base, child_depth, table, errp);
+
+    Dwarf_Die sib_die = nullptr;
+    res = dwarf_siblingof_b(m_dbg, cur_die, 1 /* is_info */, &sib_die, errp);
+    dwarf_dealloc(m_dbg, cur_die, DW_DLA_DIE);
     cur_die = sib_die;
-    res = searchInDie(ctx, cur_die, errp);
-    if (res == DW_DLV_ERROR) {
-      return res;
-    } else if (res == DW_DLV_OK) {
-      /* fall through */
-      // continue;
-    } else if (res == FOUND_SUBPROG) {
-      return res;
-    } else if (res == NOT_THIS_CU) {
-      /* impossible */
-    } else if (res == IN_THIS_CU) {
-      /* impossible */
-    } else { /* res == DW_DLV_NO_ENTRY */
-             /* impossible */
-             /* fall through */
-    }
   }
-  return DW_DLV_OK;
+}
+
+const DwarfFuncTable *DwarfSearcher::getFuncTable(Dwarf_Off cu_offset,
+                                                  Dwarf_Error *errp) {
+  auto it = m_func_tables.find(cu_offset);
+  if (it != m_func_tables.end()) {
+    return &it->second;
+  }
+
+  Dwarf_Die cu_die = nullptr;
+  if (dwarf_offdie_b(m_dbg, cu_offset, 1 /* is_info */, &cu_die, errp) !=
+      DW_DLV_OK) {
+    return nullptr;
+  }
+  auto cu_die_guard =
+      make_scope_exit([&]() { dwarf_dealloc(m_dbg, cu_die, DW_DLA_DIE); });
+
+  // The base address of `.debug_ranges` entries is the low_pc of the CU.
+  Dwarf_Addr cu_base = 0;
+  if (dwarf_lowpc(cu_die, &cu_base, errp) != DW_DLV_OK) {
+    cu_base = 0;
+  }
+
+  DwarfFuncTable &table = m_func_tables[cu_offset];
+  collectFuncRanges(cu_die, cu_base, 0, &table, errp);
+  table.finalize();
+  return &table;
+}
+
+const DwarfLineTable *DwarfSearcher::getLineTable(Dwarf_Off cu_offset,
+                                                  Dwarf_Error *errp) {
+  auto it = m_line_tables.find(cu_offset);
+  if (it != m_line_tables.end()) {
+    return it->second.get();
+  }
+
+  Dwarf_Die cu_die = nullptr;
+  if (dwarf_offdie_b(m_dbg, cu_offset, 1 /* is_info */, &cu_die, errp) !=
+      DW_DLV_OK) {
+    return nullptr;
+  }
+  std::unique_ptr<DwarfLineTable> table(new DwarfLineTable());
+  if (table->load(m_dbg, cu_die, errp) != DW_DLV_OK) {
+    table.reset();  // remember that the CU has no line table
+  }
+  dwarf_dealloc(m_dbg, cu_die, DW_DLA_DIE);
+  return (m_line_tables[cu_offset] = std::move(table)).get();
+}
+
+DwarfFileId DwarfSearcher::getFileId(Dwarf_Off cu_offset,
+                                     Dwarf_Unsigned file_num,
+                                     Dwarf_Error *errp) {
+  const DwarfLineTable *lines = getLineTable(cu_offset, errp);
+  return lines != nullptr ? lines->fileId(file_num) : kDwarfNoFileId;
+}
+
+DwarfFileId DwarfSearcher::getDeclFileId(Dwarf_Off cu_offset, Dwarf_Die die,
+                                         Dwarf_Error *errp) {
+  Dwarf_Unsigned file_num =
+      getAttrValue(m_dbg, die, DW_AT_decl_file, MAX_DWARF_UNSIGNED);
+  if (file_num == MAX_DWARF_UNSIGNED) {
+    return kDwarfNoFileId;
+  }
+  return getFileId(cu_offset, file_num, errp);
 }
 
 bool DwarfSearcher::searchFunction(Dwarf_Addr pc, Dwarf_Die *out_cu_die,
                                    Dwarf_Die *out_func_die, Dwarf_Error *errp) {
-  // loop all cu
-  int cu_number = 0;
-  for (;; ++cu_number) {
-    DwarfCUContext ctx(m_dbg, pc, 1 /* is_info */, 0 /* in_level */, cu_number);
-    Dwarf_Die no_die = 0;
-    int res = DW_DLV_ERROR;
+  Dwarf_Off cu_offset = 0;
+  if (!searchCU(pc, &cu_offset, errp)) {
+    return false;
+  }
 
-    res = dwarf_next_cu_header_d(m_dbg, ctx.is_info, &ctx.cu_header_length,
-                                 &ctx.version_stamp, &ctx.abbrev_offset,
-                                 &ctx.address_size, &ctx.offset_size,
-                                 &ctx.extension_size, &ctx.signature,
-                                 &ctx.typeoffset, 0, &ctx.header_cu_type, errp);
-    if (res == DW_DLV_ERROR) {
-      return false;
+  Dwarf_Die cu_die = nullptr;
+  if (dwarf_offdie_b(m_dbg, cu_offset, 1 /* is_info */, &cu_die, errp) !=
+      DW_DLV_OK) {
+    return false;
+  }
+
+  const DwarfFuncTable *table = getFuncTable(cu_offset, errp);
+  const DwarfFuncRange *func =
+      table != nullptr ? table->findOutermost(pc) : nullptr;
+  Dwarf_Die func_die = nullptr;
+  if (func == nullptr ||
+      dwarf_offdie_b(m_dbg, func->die_offset, 1 /* is_info */, &func_die,
+                     errp) != DW_DLV_OK) {
+    dwarf_dealloc(m_dbg, cu_die, DW_DLA_DIE);
+    return false;
+  }
+
+  // transfer ownership, the caller is responsible for free them
+  *out_cu_die = cu_die;
+  *out_func_die = func_die;
+  return true;
+}
+
+std::vector<DwarfFunctionResult> DwarfSearcher::searchFunctions(
+    const std::vector<Dwarf_Addr> &pcs, Dwarf_Error *errp) {
+  std::vector<DwarfFunctionResult> results(
+      pcs.size(), {false, 0, 0, kDwarfNoFileId, MAX_DWARF_UNSIGNED, 0, 0});
+
+  std::vector<size_t> order(pcs.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return pcs[a] < pcs[b]; });
+
+  // Group the pcs by CU, the pcs of each group stay sorted, and the groups are
+  // visited in the order of `.debug_info`.
+  std::map<Dwarf_Off, std::vector<size_t>> cu_groups;
+  for (size_t idx : order) {
+    Dwarf_Off cu_offset = 0;
+    if (searchCU(pcs[idx], &cu_offset, errp)) {
+      cu_groups[cu_offset].push_back(idx);
     }
-    if (res == DW_DLV_NO_ENTRY) {
-      /* Done. */
-      return false;
+  }
+
+  for (const auto &group : cu_groups) {
+    Dwarf_Off cu_offset = group.first;
+    const DwarfFuncTable *table = getFuncTable(cu_offset, errp);
+    if (table == nullptr) {
+      continue;
     }
 
-    /* The CU will have a single sibling, a cu_die. */
-    res = dwarf_siblingof_b(m_dbg, no_die, ctx.is_info, &ctx.cu_die, errp);
-    if (res == DW_DLV_ERROR) {
-      return false;
+    const DwarfLineTable *lines = getLineTable(cu_offset, errp);
+    for (size_t idx : group.second) {
+      DwarfFunctionResult &result = results[idx];
+      const DwarfFuncRange *func = table->findOutermost(pcs[idx]);
+      if (func != nullptr) {
+        result.found = true;
+        result.cu_offset = cu_offset;
+        result.func_offset = func->die_offset;
+      }
+      DwarfLineEntry entry;
+      if (lines != nullptr && lines->find(pcs[idx], &entry)) {
+        result.file = entry.file;
+        result.line_number = entry.line;
+        result.column = entry.column;
+        result.discriminator = entry.discriminator;
+      }
     }
-    if (res == DW_DLV_NO_ENTRY) {
-      /* Impossible case. */
-      return false;
+  }
+
+  return results;
+}
+
+const DwarfCallSite *DwarfSearcher::searchCallSite(Dwarf_Addr return_pc,
+                                                  Dwarf_Error *errp) {
+  if (return_pc == 0) {
+    return nullptr;
+  }
+  auto it = m_call_sites.find(return_pc);
+  if (it != m_call_sites.end()) {
+    return it->second;
+  }
+  const DwarfCallSite *&site = m_call_sites[return_pc];
+
+  // The call is before its return address, which is past the end of the
+  // caller if the callee does not return.
+  Dwarf_Addr call_pc = return_pc - 1;
+  Dwarf_Off cu_offset = 0;
+  if (!searchCU(call_pc, &cu_offset, errp)) {
+    return nullptr;
+  }
+  const DwarfFuncTable *funcs = getFuncTable(cu_offset, errp);
+  const DwarfFuncRange *func =
+      funcs != nullptr ? funcs->findOutermost(call_pc) : nullptr;
+  if (func == nullptr) {
+    return nullptr;
+  }
+
+  auto table_it = m_call_site_tables.find(func->die_offset);
+  if (table_it == m_call_site_tables.end()) {
+    table_it = m_call_site_tables.emplace(func->die_offset,
+                                          DwarfCallSiteTable()).first;
+    Dwarf_Die func_die = nullptr;
+    if (dwarf_offdie_b(m_dbg, func->die_offset, 1 /* is_info */, &func_die,
+                       errp) == DW_DLV_OK) {
+      table_it->second.load(m_dbg, cu_offset, func_die, errp);
+      dwarf_dealloc(m_dbg, func_die, DW_DLA_DIE);
+    }
+  }
+  site = table_it->second.find(return_pc);
+  return site;
+}
+
+bool DwarfSearcher::getBaseType(Dwarf_Off cu_offset, Dwarf_Off type_offset,
+                                DwarfBaseType *out_type, Dwarf_Error *errp) {
+  // The operand is relative to the CU header, which precedes the CU DIE.
+  auto header_it = m_cu_headers.find(cu_offset);
+  if (header_it == m_cu_headers.end()) {
+    Dwarf_Off header_offset = cu_offset;
+    Dwarf_Die cu_die = nullptr;
+    if (dwarf_offdie_b(m_dbg, cu_offset, 1 /* is_info */, &cu_die, errp) ==
+        DW_DLV_OK) {
+      Dwarf_Off die_in_cu = 0;
+      if (dwarf_die_CU_offset(cu_die, &die_in_cu, errp) == DW_DLV_OK) {
+        header_offset = cu_offset - die_in_cu;
+      }
+      dwarf_dealloc(m_dbg, cu_die, DW_DLA_DIE);
     }
+    header_it = m_cu_headers.emplace(cu_offset, header_offset).first;
+  }
 
-    res = searchInDieTree(&ctx, ctx.cu_die, errp);
-    if (res == FOUND_SUBPROG) {
-      // transfer ownership, the caller is responsible for free them
-      *out_cu_die = ctx.cu_die;
-      ctx.cu_die = nullptr;
-      *out_func_die = ctx.func_die;
-      ctx.func_die = nullptr;
-      return true;
-    } else if (res == IN_THIS_CU) {
-      return false;
-    } else if (res == NOT_THIS_CU) {
-      /* This is normal. Keep looking */
-    } else if (res == DW_DLV_ERROR) {
-      return false;
-    } else if (res == DW_DLV_NO_ENTRY) {
-      /* This is odd. Assume normal. */
-    } else {
-      /* DW_DLV_OK. normal. */
+  Dwarf_Off die_offset = header_it->second + type_offset;
+  auto it = m_base_types.find(die_offset);
+  if (it == m_base_types.end()) {
+    DwarfBaseType type = {0, 0};
+    Dwarf_Die die = nullptr;
+    Dwarf_Half tag = 0;
+    if (dwarf_offdie_b(m_dbg, die_offset, 1 /* is_info */, &die, errp) ==
+        DW_DLV_OK) {
+      if (dwarf_tag(die, &tag, errp) == DW_DLV_OK && tag == DW_TAG_base_type) {
+        Dwarf_Unsigned encoding = getAttrValue(
+            m_dbg, die, DW_AT_encoding, static_cast<Dwarf_Unsigned>(0));
+        Dwarf_Unsigned size = getAttrValue(m_dbg, die, DW_AT_byte_size,
+                                           static_cast<Dwarf_Unsigned>(0));
+        if (encoding <= 0xff && size <= 16) {
+          type.encoding = static_cast<uint8_t>(encoding);
+          type.size = static_cast<uint8_t>(size);
+        }
+      }
+      dwarf_dealloc(m_dbg, die, DW_DLA_DIE);
     }
-    // free ctx.cu_die
+    it = m_base_types.emplace(die_offset, type).first;
+  }
+  *out_type = it->second;
+  return it->second.size != 0;
+}
+
+bool DwarfSearcher::searchInlineChain(Dwarf_Addr pc, Dwarf_Off *out_cu_offset,
+                                      std::vector<DwarfInlineFrame> *out_frames,
+                                      Dwarf_Error *errp) {
+  out_frames->clear();
+
+  Dwarf_Off cu_offset = 0;
+  if (!searchCU(pc, &cu_offset, errp)) {
+    return false;
+  }
+  const DwarfFuncTable *table = getFuncTable(cu_offset, errp);
+  if (table == nullptr) {
+    return false;
+  }
+
+  // One binary search for the innermost function, then up through the
+  // enclosing ones, the chain is returned from the outermost.
+  for (const DwarfFuncRange *func = table->findInnermost(pc); func != nullptr;
+       func = table->parent(func)) {
+    out_frames->push_back({func->die_offset, func->call_file, func->call_line});
   }
+  std::reverse(out_frames->begin(), out_frames->end());
 
-  return false;
+  *out_cu_offset = cu_offset;
+  return !out_frames->empty();
 }
 
 }  // namespace dwarfexpr
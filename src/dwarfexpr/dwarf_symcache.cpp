@@ -0,0 +1,348 @@
+#include "dwarfexpr/dwarf_symcache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>  // std::stable_sort, std::upper_bound
+#include <cstdio>
+#include <cstring>
+
+#include "dwarfexpr/dwarf_ranges.h"
+#include "dwarfexpr/dwarf_searcher.h"
+#include "dwarfexpr/dwarf_utils.h"
+
+namespace dwarfexpr {
+
+uint32_t DwarfSymcacheBuilder::internString(const std::string& str) {
+  auto it = string_index_.find(str);
+  if (it != string_index_.end()) {
+    return it->second;
+  }
+  uint32_t offset = static_cast<uint32_t>(strings_.size());
+  strings_.append(str);
+  strings_.push_back('\0');
+  string_index_.emplace(str, offset);
+  return offset;
+}
+
+uint32_t DwarfSymcacheBuilder::internFile(const std::string& file) {
+  auto it = file_index_.find(file);
+  if (it != file_index_.end()) {
+    return it->second;
+  }
+  uint32_t index = static_cast<uint32_t>(files_.size());
+  files_.push_back(internString(file));
+  file_index_.emplace(file, index);
+  return index;
+}
+
+bool DwarfSymcacheBuilder::build(Dwarf_Error* errp) {
+  DwarfSearcher searcher(dbg_);
+  std::vector<Dwarf_Off> cu_offsets;
+  if (!searcher.listCUs(&cu_offsets, errp)) {
+    return false;
+  }
+
+  // All the functions of the module in one table, `call_file` is replaced by
+  // the index in the file table of the symcache.
+  DwarfFuncTable funcs;
+  std::vector<DwarfLineRow> rows;
+  std::vector<std::string> files;
+  std::vector<uint32_t> cu_files;  // CU file index -> symcache file index
+  for (Dwarf_Off cu_offset : cu_offsets) {
+    Dwarf_Die cu_die = nullptr;
+    if (dwarf_offdie_b(dbg_, cu_offset, 1 /* is_info */, &cu_die, errp) !=
+        DW_DLV_OK) {
+      continue;
+    }
+    auto cu_die_guard =
+        make_scope_exit([&]() { dwarf_dealloc(dbg_, cu_die, DW_DLA_DIE); });
+
+    if (getLineRows(dbg_, cu_die, &rows, &files, errp) != DW_DLV_OK) {
+      rows.clear();
+      files.clear();
+    }
+    cu_files.clear();
+    for (const std::string& file : files) {
+      cu_files.push_back(internFile(file));
+    }
+    for (const DwarfLineRow& row : rows) {
+      uint32_t file = row.end_sequence || row.file >= cu_files.size()
+                          ? kDwarfSymcacheNone
+                          : cu_files[row.file];
+      lines_.push_back({row.addr, file, static_cast<uint32_t>(row.line)});
+    }
+
+    // The file index of DW_AT_call_file is 1-based before DWARF5.
+    Dwarf_Half version = 2;
+    Dwarf_Half offset_size = 0;
+    dwarf_get_version_of_die(cu_die, &version, &offset_size);
+    Dwarf_Unsigned file_base = version >= 5 ? 0 : 1;
+
+    const DwarfFuncTable* table = searcher.getFuncTable(cu_offset, errp);
+    if (table == nullptr) {
+      continue;
+    }
+    for (DwarfFuncRange r : table->ranges()) {
+      Dwarf_Unsigned call_file = kDwarfSymcacheNone;
+      if (r.depth > 0 && r.call_file >= file_base &&
+          r.call_file - file_base < cu_files.size()) {
+        call_file = cu_files[r.call_file - file_base];
+      }
+      r.call_file = call_file;
+      funcs.add(r);
+    }
+  }
+  funcs.finalize();
+
+  // Names are resolved once per DIE, many ranges share the same function.
+  std::unordered_map<Dwarf_Off, uint32_t> names;
+  ranges_.clear();
+  ranges_.reserve(funcs.size());
+  depth_begin_.clear();
+  for (const DwarfFuncRange& r : funcs.ranges()) {
+    auto it = names.find(r.die_offset);
+    if (it == names.end()) {
+      std::string name = "?";
+      Dwarf_Die die = nullptr;
+      if (getDieFromOffset(dbg_, r.die_offset, die)) {
+        name = getFunctionName(dbg_, die, true /* demangle */, "?");
+        dwarf_dealloc(dbg_, die, DW_DLA_DIE);
+      }
+      it = names.emplace(r.die_offset, internString(name)).first;
+    }
+    while (depth_begin_.size() <= static_cast<size_t>(r.depth)) {
+      depth_begin_.push_back(static_cast<uint32_t>(ranges_.size()));
+    }
+    ranges_.push_back({r.low, r.high, it->second,
+                       static_cast<uint32_t>(r.call_file),
+                       static_cast<uint32_t>(r.call_line),
+                       static_cast<uint32_t>(r.depth)});
+  }
+  depth_begin_.push_back(static_cast<uint32_t>(ranges_.size()));  // sentinel
+
+  // An end of sequence row sorts before a row starting at the same address,
+  // so that the address belongs to the next sequence.
+  std::stable_sort(lines_.begin(), lines_.end(),
+                   [](const DwarfSymcacheLine& a, const DwarfSymcacheLine& b) {
+                     if (a.addr != b.addr) {
+                       return a.addr < b.addr;
+                     }
+                     return a.file == kDwarfSymcacheNone &&
+                            b.file != kDwarfSymcacheNone;
+                   });
+  return true;
+}
+
+namespace {
+
+uint64_t alignUp(uint64_t offset) { return (offset + 7) & ~7ull; }
+
+bool writeSection(FILE* fp, uint64_t offset, const void* data, size_t size) {
+  long pos = ftell(fp);
+  if (pos < 0 || static_cast<uint64_t>(pos) > offset) {
+    return false;
+  }
+  static const char kZeros[8] = {0};
+  if (fwrite(kZeros, 1, offset - pos, fp) != offset - pos) {
+    return false;
+  }
+  return size == 0 || fwrite(data, 1, size, fp) == size;
+}
+
+}  // namespace
+
+bool DwarfSymcacheBuilder::write(const std::string& path,
+                                 const std::vector<uint8_t>& build_id) {
+  if (build_id.size() > kDwarfSymcacheMaxBuildId) {
+    return false;
+  }
+
+  DwarfSymcacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kDwarfSymcacheMagic, sizeof(header.magic));
+  header.version = kDwarfSymcacheVersion;
+  header.header_size = sizeof(DwarfSymcacheHeader);
+  header.build_id_size = static_cast<uint32_t>(build_id.size());
+  if (!build_id.empty()) {
+    memcpy(header.build_id, build_id.data(), build_id.size());
+  }
+  header.depth_count = static_cast<uint32_t>(depth_begin_.size()) - 1;
+  header.range_count = static_cast<uint32_t>(ranges_.size());
+  header.line_count = static_cast<uint32_t>(lines_.size());
+  header.file_count = static_cast<uint32_t>(files_.size());
+
+  header.depth_offset = alignUp(sizeof(header));
+  header.range_offset = alignUp(header.depth_offset +
+                                depth_begin_.size() * sizeof(uint32_t));
+  header.line_offset = alignUp(header.range_offset +
+                               ranges_.size() * sizeof(DwarfSymcacheRange));
+  header.file_offset = alignUp(header.line_offset +
+                               lines_.size() * sizeof(DwarfSymcacheLine));
+  header.strings_offset =
+      alignUp(header.file_offset + files_.size() * sizeof(uint32_t));
+  header.strings_size = strings_.size();
+
+  FILE* fp = fopen(path.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("Error: can not open %s\n", path.c_str());
+    return false;
+  }
+  bool ok =
+      writeSection(fp, 0, &header, sizeof(header)) &&
+      writeSection(fp, header.depth_offset, depth_begin_.data(),
+                   depth_begin_.size() * sizeof(uint32_t)) &&
+      writeSection(fp, header.range_offset, ranges_.data(),
+                   ranges_.size() * sizeof(DwarfSymcacheRange)) &&
+      writeSection(fp, header.line_offset, lines_.data(),
+                   lines_.size() * sizeof(DwarfSymcacheLine)) &&
+      writeSection(fp, header.file_offset, files_.data(),
+                   files_.size() * sizeof(uint32_t)) &&
+      writeSection(fp, header.strings_offset, strings_.data(), strings_.size());
+  if (fclose(fp) != 0) {
+    ok = false;
+  }
+  return ok;
+}
+
+bool DwarfSymcache::open(const std::string& path) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(DwarfSymcacheHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // the mapping keeps the file
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  data_ = data;
+  size_ = st.st_size;
+
+  const char* base = static_cast<const char*>(data_);
+  header_ = reinterpret_cast<const DwarfSymcacheHeader*>(base);
+  const DwarfSymcacheHeader& h = *header_;
+  auto inBounds = [&](uint64_t offset, uint64_t count, uint64_t size) {
+    return offset % 8 == 0 && offset <= size_ &&
+           count <= (size_ - offset) / size;
+  };
+  if (memcmp(h.magic, kDwarfSymcacheMagic, sizeof(h.magic)) != 0 ||
+      h.version != kDwarfSymcacheVersion ||
+      h.header_size != sizeof(DwarfSymcacheHeader) ||
+      h.build_id_size > kDwarfSymcacheMaxBuildId ||
+      !inBounds(h.depth_offset, h.depth_count + 1ull, sizeof(uint32_t)) ||
+      !inBounds(h.range_offset, h.range_count, sizeof(DwarfSymcacheRange)) ||
+      !inBounds(h.line_offset, h.line_count, sizeof(DwarfSymcacheLine)) ||
+      !inBounds(h.file_offset, h.file_count, sizeof(uint32_t)) ||
+      !inBounds(h.strings_offset, h.strings_size, 1) ||
+      (h.strings_size > 0 && base[h.strings_offset + h.strings_size - 1])) {
+    printf("Error: invalid symcache file: %s\n", path.c_str());
+    close();
+    return false;
+  }
+
+  depth_begin_ = reinterpret_cast<const uint32_t*>(base + h.depth_offset);
+  ranges_ = reinterpret_cast<const DwarfSymcacheRange*>(base + h.range_offset);
+  lines_ = reinterpret_cast<const DwarfSymcacheLine*>(base + h.line_offset);
+  files_ = reinterpret_cast<const uint32_t*>(base + h.file_offset);
+  strings_ = base + h.strings_offset;
+  return true;
+}
+
+void DwarfSymcache::close() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  header_ = nullptr;
+  depth_begin_ = nullptr;
+  ranges_ = nullptr;
+  lines_ = nullptr;
+  files_ = nullptr;
+  strings_ = nullptr;
+}
+
+std::vector<uint8_t> DwarfSymcache::buildId() const {
+  if (header_ == nullptr) {
+    return {};
+  }
+  return std::vector<uint8_t>(header_->build_id,
+                              header_->build_id + header_->build_id_size);
+}
+
+const char* DwarfSymcache::stringAt(uint32_t offset) const {
+  return offset < header_->strings_size ? strings_ + offset : "?";
+}
+
+const char* DwarfSymcache::fileAt(uint32_t index) const {
+  return index < header_->file_count ? stringAt(files_[index]) : "?";
+}
+
+bool DwarfSymcache::lookupFunctions(
+    uint64_t pc, std::vector<DwarfSymcacheFrame>* out_frames) const {
+  out_frames->clear();
+  if (header_ == nullptr) {
+    return false;
+  }
+
+  for (uint32_t depth = 0; depth < header_->depth_count; ++depth) {
+    uint32_t begin_idx = depth_begin_[depth];
+    uint32_t end_idx = depth_begin_[depth + 1];
+    if (begin_idx > end_idx || end_idx > header_->range_count) {
+      break;  // corrupted
+    }
+    const DwarfSymcacheRange* begin = ranges_ + begin_idx;
+    const DwarfSymcacheRange* end = ranges_ + end_idx;
+    const DwarfSymcacheRange* it =
+        std::upper_bound(begin, end, pc,
+                         [](uint64_t addr, const DwarfSymcacheRange& r) {
+                           return addr < r.low;
+                         });
+    if (it == begin) {
+      break;
+    }
+    --it;
+    if (pc >= it->high) {
+      break;
+    }
+    out_frames->push_back(
+        {stringAt(it->name),
+         it->call_file != kDwarfSymcacheNone ? fileAt(it->call_file) : nullptr,
+         it->call_line});
+  }
+  return !out_frames->empty();
+}
+
+bool DwarfSymcache::lookupLine(uint64_t pc, const char** out_file,
+                               uint32_t* out_line) const {
+  if (header_ == nullptr) {
+    return false;
+  }
+  const DwarfSymcacheLine* begin = lines_;
+  const DwarfSymcacheLine* end = lines_ + header_->line_count;
+  const DwarfSymcacheLine* it = std::upper_bound(
+      begin, end, pc,
+      [](uint64_t addr, const DwarfSymcacheLine& l) { return addr < l.addr; });
+  if (it == begin) {
+    return false;
+  }
+  --it;
+  if (it->file == kDwarfSymcacheNone) {
+    return false;  // in a gap between sequences
+  }
+  *out_file = fileAt(it->file);
+  *out_line = it->line;
+  return true;
+}
+
+}  // namespace dwarfexpr
@@ -0,0 +1,100 @@
+#include "dwarfexpr/dwarf_tracer.h"
+
+#include <cinttypes>
+#include <cstdlib>  // std::abs
+#include <string>
+
+namespace dwarfexpr {
+
+static inline std::string regname(Dwarf_Unsigned reg) {  // TODO: arm64 only
+  if (reg == DW_FRAME_CFA_COL) {
+    return "CFA";
+  } else if (reg == 29) {
+    return "W29(FP)";
+  } else if (reg == 30) {
+    return "W30(LR)";
+  } else if (reg == 31) {
+    return "W31(SP)";
+  }
+  return std::string("W") + std::to_string(reg);
+}
+
+static const char* rulename(Dwarf_Small value_type) {
+  switch (value_type) {
+    case DW_EXPR_OFFSET:
+      return "offset(N)";
+    case DW_EXPR_VAL_OFFSET:
+      return "val_offset(N)";
+    case DW_EXPR_EXPRESSION:
+      return "expression(E)";
+    case DW_EXPR_VAL_EXPRESSION:
+      return "val_expression(E)";
+    default:
+      return "?";
+  }
+}
+
+void DwarfPrintTracer::onEvent(const DwarfTraceEvent& event) {
+  const char* opcode_name = "?";
+  switch (event.type) {
+    case DwarfTraceEvent::Type::kRegister:
+      dwarf_get_OP_name(event.opcode, &opcode_name);
+      fprintf(out_, "op=%s reg%llu = 0x%" PRIx64 "\n", opcode_name, event.reg,
+              event.value);
+      break;
+    case DwarfTraceEvent::Type::kRegisterOffset:
+      fprintf(out_, "reg%llu %s 0x%llx = 0x%" PRIx64 "\n", event.reg,
+              event.offset >= 0 ? "+" : "-", std::abs(event.offset),
+              event.value);
+      break;
+    case DwarfTraceEvent::Type::kNotImplemented:
+      dwarf_get_OP_name(event.opcode, &opcode_name);
+      fprintf(out_, "Error: not implemented op: %s\n", opcode_name);
+      break;
+    case DwarfTraceEvent::Type::kExpressionRange:
+      fprintf(out_, "evaluateExpression [0x%llx - 0x%llx] pc=0x%llx\n",
+              event.low, event.high, event.pc);
+      break;
+    case DwarfTraceEvent::Type::kNoExpression:
+      fprintf(out_,
+              "Error: unable to find the target pc in the address range, "
+              "pc=0x%llx\n",
+              event.pc);
+      break;
+    case DwarfTraceEvent::Type::kFde:
+      fprintf(out_, "fde: [0x%llx - 0x%llx] pc=0x%llx\n", event.low,
+              event.high, event.pc);
+      break;
+    case DwarfTraceEvent::Type::kRegisterRule:
+    case DwarfTraceEvent::Type::kRegisterRuleFailed:
+      fprintf(out_, "0x%llx: %s=%s %s%s%lld", event.pc,
+              regname(event.reg).c_str(), rulename(event.value_type),
+              regname(event.base_reg).c_str(), event.offset >= 0 ? "+" : "-",
+              std::abs(event.offset));
+      if (event.addr != 0) {
+        fprintf(out_, " addr=0x%llx", event.addr);
+      }
+      if (event.type == DwarfTraceEvent::Type::kRegisterRule) {
+        fprintf(out_, " val=0x%" PRIx64 "\n", event.value);
+      } else {
+        fprintf(out_, " Error: can not evaluate the rule\n");
+      }
+      break;
+    case DwarfTraceEvent::Type::kExpressionFailed:
+      fprintf(out_,
+              "0x%llx: Error: can not evaluate the expression of %s, "
+              "error=%" PRIu64 " at op 0x%llx\n",
+              event.pc, regname(event.reg).c_str(), event.value, event.addr);
+      break;
+    case DwarfTraceEvent::Type::kMemoryInvalid:
+      fprintf(out_,
+              "Error: can not read memory at addr: 0x%llx, size=0x%" PRIx64
+              "\n",
+              event.addr, event.value);
+      break;
+    default:
+      break;
+  }
+}
+
+}  // namespace dwarfexpr
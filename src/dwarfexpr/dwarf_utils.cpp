@@ -7,6 +7,9 @@
 #include <iomanip>  // std::setfill std::setw
 #include <sstream>
 
+#include "dwarfexpr/dwarf_files.h"
+#include "dwarfexpr/dwarf_lines.h"
+
 using namespace std;
 
 namespace dwarfexpr {
@@ -250,6 +253,142 @@ int getRnglistsBase(Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Off* base_out,
   return res;
 }
 
+/**
+ * @brief Get all the address ranges of a DIE, from `DW_AT_low_pc` and
+ *        `DW_AT_high_pc`, or from `DW_AT_ranges`.
+ * @param base_addr  Base address of the range list entries (`DW_AT_low_pc`
+ *                   of the CU), only used for `.debug_ranges`.
+ * @param ranges_out Ranges [low, high) found will be appended to it.
+ * @return DW_DLV_OK if the DIE has any address range.
+ */
+int getDieRanges(Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Addr base_addr,
+                 std::vector<std::pair<Dwarf_Addr, Dwarf_Addr>>* ranges_out,
+                 Dwarf_Error* error) {
+  bool have_pc_range = false;
+  Dwarf_Addr lowpc = 0;
+  Dwarf_Addr highpc = 0;
+  int res =
+      getLowAndHighPc(dbg, die, &have_pc_range, &lowpc, &highpc, error);
+  if (res == DW_DLV_OK && have_pc_range) {
+    ranges_out->emplace_back(lowpc, highpc);
+    return DW_DLV_OK;
+  }
+
+  Dwarf_Attribute ranges_attr = nullptr;
+  res = dwarf_attr(die, DW_AT_ranges, &ranges_attr, error);
+  if (res != DW_DLV_OK) {
+    return res;
+  }
+  auto attr_guard =
+      make_scope_exit([&]() { dwarf_dealloc(dbg, ranges_attr, DW_DLA_ATTR); });
+
+  Dwarf_Half form = 0;
+  res = dwarf_whatform(ranges_attr, &form, error);
+  if (res != DW_DLV_OK) {
+    return res;
+  }
+
+  Dwarf_Half version = 2;
+  Dwarf_Half offset_size = 0;
+  dwarf_get_version_of_die(die, &version, &offset_size);
+
+  if (version >= 5 || form == DW_FORM_rnglistx) {
+    // .debug_rnglists, the entries are cooked by libdwarf.
+    Dwarf_Unsigned index_or_offset = 0;
+    if (form == DW_FORM_rnglistx) {
+      res = dwarf_formudata(ranges_attr, &index_or_offset, error);
+    } else {
+      Dwarf_Off offset = 0;
+      res = dwarf_global_formref(ranges_attr, &offset, error);
+      index_or_offset = offset;
+    }
+    if (res != DW_DLV_OK) {
+      return res;
+    }
+
+    Dwarf_Rnglists_Head head = nullptr;
+    Dwarf_Unsigned count = 0;
+    Dwarf_Unsigned global_offset = 0;
+    res = dwarf_rnglists_get_rle_head(ranges_attr, form, index_or_offset,
+                                      &head, &count, &global_offset, error);
+    if (res != DW_DLV_OK) {
+      return res;
+    }
+    for (Dwarf_Unsigned i = 0; i < count; ++i) {
+      unsigned entry_len = 0;
+      unsigned rle_value = 0;
+      Dwarf_Unsigned raw1 = 0;
+      Dwarf_Unsigned raw2 = 0;
+      Dwarf_Bool debug_addr_unavailable = false;
+      Dwarf_Unsigned cooked1 = 0;
+      Dwarf_Unsigned cooked2 = 0;
+      if (dwarf_get_rnglists_entry_fields_a(
+              head, i, &entry_len, &rle_value, &raw1, &raw2,
+              &debug_addr_unavailable, &cooked1, &cooked2,
+              error) != DW_DLV_OK) {
+        break;
+      }
+      if (debug_addr_unavailable) {
+        continue;
+      }
+      switch (rle_value) {
+        case DW_RLE_offset_pair:
+        case DW_RLE_startx_endx:
+        case DW_RLE_startx_length:
+        case DW_RLE_start_end:
+        case DW_RLE_start_length:
+          if (cooked1 < cooked2) {
+            ranges_out->emplace_back(cooked1, cooked2);
+          }
+          break;
+        default:
+          // DW_RLE_base_address, DW_RLE_base_addressx, DW_RLE_end_of_list
+          break;
+      }
+    }
+    dwarf_dealloc_rnglists_head(head);
+    return DW_DLV_OK;
+  }
+
+  // .debug_ranges
+  Dwarf_Off ranges_offset = 0;
+  res = dwarf_global_formref(ranges_attr, &ranges_offset, error);
+  if (res != DW_DLV_OK) {
+    return res;
+  }
+
+  Dwarf_Ranges* ranges = nullptr;
+  Dwarf_Signed ranges_count = 0;
+  Dwarf_Unsigned byte_count = 0;
+  Dwarf_Off actual_offset = 0;
+  res = dwarf_get_ranges_b(dbg, ranges_offset, die, &actual_offset, &ranges,
+                           &ranges_count, &byte_count, error);
+  if (res != DW_DLV_OK) {
+    return res;
+  }
+  Dwarf_Addr base = base_addr;
+  for (Dwarf_Signed k = 0; k < ranges_count; ++k) {
+    Dwarf_Ranges* cur = ranges + k;
+    switch (cur->dwr_type) {
+      case DW_RANGES_ENTRY:
+        if (cur->dwr_addr1 < cur->dwr_addr2) {
+          ranges_out->emplace_back(cur->dwr_addr1 + base,
+                                   cur->dwr_addr2 + base);
+        }
+        break;
+      case DW_RANGES_ADDRESS_SELECTION:
+        base = cur->dwr_addr2;
+        break;
+      case DW_RANGES_END:
+        break;
+      default:
+        break;
+    }
+  }
+  dwarf_dealloc_ranges(dbg, ranges, ranges_count);
+  return DW_DLV_OK;
+}
+
 std::string getFunctionName(Dwarf_Debug dbg, Dwarf_Die func_die, bool demangle,
                             std::string def_val) {
   Dwarf_Error error = nullptr;
@@ -288,9 +427,14 @@ std::string getFunctionName(Dwarf_Debug dbg, Dwarf_Die func_die, bool demangle,
   // Some functions have a "specification" attribute
   // which means they were defined elsewhere. The name
   // attribute is not repeated, and must be taken from
-  // the specification DIE.
-  Dwarf_Attribute attr;
-  if (dwarf_attr(func_die, DW_AT_specification, &attr, &error) == DW_DLV_OK) {
+  // the specification DIE. Inlined subroutines and
+  // out-of-line instances take the name from the
+  // "abstract_origin" DIE the same way.
+  for (Dwarf_Half ref_attr_num : {DW_AT_specification, DW_AT_abstract_origin}) {
+    Dwarf_Attribute attr;
+    if (dwarf_attr(func_die, ref_attr_num, &attr, &error) != DW_DLV_OK) {
+      continue;
+    }
     auto guard =
         make_scope_exit([&]() { dwarf_dealloc(dbg, attr, DW_DLA_ATTR); });
 
@@ -329,30 +473,36 @@ std::string demangleName(const std::string& mangled) {
   return result;
 }
 
-std::string getDeclFile(Dwarf_Debug dbg, Dwarf_Die cu_die, Dwarf_Die func_die,
-                        std::string def_val) {
+std::string getSrcFileName(Dwarf_Debug dbg, Dwarf_Die cu_die,
+                           Dwarf_Unsigned file_num, std::string def_val) {
   Dwarf_Error error = nullptr;
-  Dwarf_Attribute file_attr = nullptr;
-
-  if (dwarf_attr(func_die, DW_AT_decl_file, &file_attr, &error) == DW_DLV_OK) {
-    Dwarf_Unsigned fileNum = getAttrNumb(file_attr, MAX_DWARF_UNSIGNED);
-    dwarf_dealloc(dbg, file_attr, DW_DLA_ATTR);
-
-    if (fileNum != MAX_DWARF_UNSIGNED) {
-      Dwarf_Signed fileIdx = fileNum - 1;
-
-      // Get all source files of cu.
-      char** srcFiles;
-      Dwarf_Signed fileCnt;
-      if (dwarf_srcfiles(cu_die, &srcFiles, &fileCnt, &error) == DW_DLV_OK) {
-        if (fileIdx < fileCnt) {
-          std::string retVal = srcFiles[fileIdx];
-          dwarf_dealloc(dbg, srcFiles, DW_DLA_LIST);
-          return retVal;
-        }
-        dwarf_dealloc(dbg, srcFiles, DW_DLA_LIST);
-      }
+
+  // The file index is 1-based before DWARF5, and 0-based since DWARF5.
+  Dwarf_Half version = 2;
+  Dwarf_Half offset_size = 0;
+  if (dwarf_get_version_of_die(cu_die, &version, &offset_size) != DW_DLV_OK) {
+    version = 2;
+  }
+  if (version < 5) {
+    if (file_num == 0) {
+      return def_val;  // no source file
     }
+    file_num -= 1;
+  }
+
+  // Get all source files of cu.
+  char** srcFiles;
+  Dwarf_Signed fileCnt;
+  if (dwarf_srcfiles(cu_die, &srcFiles, &fileCnt, &error) == DW_DLV_OK) {
+    std::string retVal = def_val;
+    if (file_num < static_cast<Dwarf_Unsigned>(fileCnt)) {
+      retVal = srcFiles[file_num];
+    }
+    for (Dwarf_Signed i = 0; i < fileCnt; ++i) {
+      dwarf_dealloc(dbg, srcFiles[i], DW_DLA_STRING);
+    }
+    dwarf_dealloc(dbg, srcFiles, DW_DLA_LIST);
+    return retVal;
   }
 
   DWARF_ERROR(getDwarfError(error));
@@ -378,97 +528,105 @@ Dwarf_Unsigned getDeclLine(Dwarf_Debug dbg, Dwarf_Die func_die,
 std::pair<std::string, Dwarf_Unsigned> getFileNameAndLineNumber(
     Dwarf_Debug dbg, Dwarf_Die cu_die, Dwarf_Addr pc, std::string def_val1,
     Dwarf_Unsigned def_val2) {
-  auto result = std::make_pair(def_val1, def_val2);
+  std::vector<std::pair<std::string, Dwarf_Unsigned>> results =
+      getFileNameAndLineNumbers(dbg, cu_die, {pc}, def_val1, def_val2);
+  return results.front();
+}
+
+std::vector<std::pair<std::string, Dwarf_Unsigned>> getFileNameAndLineNumbers(
+    Dwarf_Debug dbg, Dwarf_Die cu_die, const std::vector<Dwarf_Addr>& pcs,
+    std::string def_val1, Dwarf_Unsigned def_val2) {
+  std::vector<std::pair<std::string, Dwarf_Unsigned>> results(
+      pcs.size(), std::make_pair(def_val1, def_val2));
 
   Dwarf_Error error = nullptr;
+  DwarfLineTable table;
+  int res = table.load(dbg, cu_die, &error);
+  if (res != DW_DLV_OK) {
+    if (res == DW_DLV_ERROR) {
+      DWARF_ERROR(getDwarfError(error));
+    }
+    return results;
+  }
+
+  for (size_t i = 0; i < pcs.size(); ++i) {
+    DwarfLineEntry entry;
+    if (table.find(pcs[i], &entry)) {
+      results[i].first = DwarfFilePool::global()->path(entry.file, def_val1);
+      results[i].second = entry.line;
+    }
+  }
+  return results;
+}
+
+int getLineRows(Dwarf_Debug dbg, Dwarf_Die cu_die,
+                std::vector<DwarfLineRow>* rows_out,
+                std::vector<std::string>* files_out, Dwarf_Error* error) {
+  rows_out->clear();
+  files_out->clear();
+
   Dwarf_Unsigned line_version = 0;
   Dwarf_Small table_type = 0;
   Dwarf_Line_Context line_context = 0;
-
-  if (dwarf_srclines_b(cu_die, &line_version, &table_type, &line_context,
-                       &error) != DW_DLV_OK) {
-    DWARF_ERROR(getDwarfError(error));
-    return result;
+  int res = dwarf_srclines_b(cu_die, &line_version, &table_type, &line_context,
+                             error);
+  if (res != DW_DLV_OK) {
+    return res;
   }
   auto line_context_guard =
       make_scope_exit([&]() { dwarf_srclines_dealloc_b(line_context); });
-
   if (table_type != 1) {
-    // if table_type == 0: no lines, just table header and names
-    // if table_type == 2: experimental two-level line table, not standard DWARF
-    printf("Error: unsupport table type %d\n", table_type);
-    return result;
+    return DW_DLV_NO_ENTRY;  // no lines, or not standard DWARF
   }
 
+  char** src_files = nullptr;
+  Dwarf_Signed file_count = 0;
+  if (dwarf_srcfiles(cu_die, &src_files, &file_count, error) == DW_DLV_OK) {
+    for (Dwarf_Signed i = 0; i < file_count; ++i) {
+      files_out->emplace_back(src_files[i]);
+      dwarf_dealloc(dbg, src_files[i], DW_DLA_STRING);
+    }
+    dwarf_dealloc(dbg, src_files, DW_DLA_LIST);
+  }
+  // The file number is 1-based before DWARF5, and 0-based since DWARF5.
+  Dwarf_Unsigned file_base = line_version >= 5 ? 0 : 1;
+
   Dwarf_Line* line_buf = 0;
   Dwarf_Signed line_count = 0;
-  if (dwarf_srclines_from_linecontext(line_context, &line_buf, &line_count,
-                                      &error) != DW_DLV_OK) {
-    DWARF_ERROR(getDwarfError(error));
-    return result;
+  res = dwarf_srclines_from_linecontext(line_context, &line_buf, &line_count,
+                                        error);
+  if (res != DW_DLV_OK) {
+    return res;
   }
-  // no need to free `line_buf`, `line_context` is its owner.
-
-  Dwarf_Addr prev_lineaddr = 0;
-  Dwarf_Unsigned prev_lineno = 0;
-  char* prev_linesrcfile = nullptr;
-  bool found = false;
-  for (int i = 0; i < line_count; ++i) {
+  rows_out->reserve(line_count);
+  for (Dwarf_Signed i = 0; i < line_count; ++i) {
     Dwarf_Line line = line_buf[i];
-
-    Dwarf_Unsigned lineno = 0;
-    if (dwarf_lineno(line, &lineno, &error) != DW_DLV_OK) {
-      DWARF_ERROR(getDwarfError(error));
-      break;
-    }
-
-    /*
-    Dwarf_Unsigned filenum = 0;
-    if (dwarf_line_srcfileno(line, &filenum, errp) != DW_DLV_OK) {
-            continue;
-    }
-    if (filenum >= 1) {
-            filenum -= 1;
-    }
-    */
-
-    char* linesrcfile = nullptr;
-    if (dwarf_linesrc(line, &linesrcfile, &error) != DW_DLV_OK) {
-      DWARF_ERROR(getDwarfError(error));
-      break;
-    }
-
-    Dwarf_Addr lineaddr = 0;
-    if (dwarf_lineaddr(line, &lineaddr, &error) != DW_DLV_OK) {
-      DWARF_ERROR(getDwarfError(error));
-      break;
-    }
-
-    if (prev_linesrcfile && lineaddr > pc) {
-      result.first.assign(prev_linesrcfile);
-      result.second = prev_lineno;
-      found = true;
-      break;
+    DwarfLineRow row = {0, MAX_DWARF_UNSIGNED, 0, false, 0, false, 0};
+    Dwarf_Unsigned file_num = 0;
+    Dwarf_Bool end_sequence = false;
+    Dwarf_Bool is_stmt = false;
+    Dwarf_Bool prologue_end = false;
+    Dwarf_Bool epilogue_begin = false;
+    Dwarf_Unsigned isa = 0;
+    if (dwarf_lineaddr(line, &row.addr, error) != DW_DLV_OK ||
+        dwarf_lineno(line, &row.line, error) != DW_DLV_OK ||
+        dwarf_line_srcfileno(line, &file_num, error) != DW_DLV_OK ||
+        dwarf_lineendsequence(line, &end_sequence, error) != DW_DLV_OK ||
+        dwarf_lineoff_b(line, &row.column, error) != DW_DLV_OK ||
+        dwarf_linebeginstatement(line, &is_stmt, error) != DW_DLV_OK ||
+        dwarf_prologue_end_etc(line, &prologue_end, &epilogue_begin, &isa,
+                               &row.discriminator, error) != DW_DLV_OK) {
+      return DW_DLV_ERROR;
     }
-
-    prev_lineaddr = lineaddr;
-    prev_lineno = lineno;
-    if (prev_linesrcfile) {
-      dwarf_dealloc(dbg, prev_linesrcfile, DW_DLA_STRING);
+    if (file_num >= file_base &&
+        file_num - file_base < static_cast<Dwarf_Unsigned>(file_count)) {
+      row.file = file_num - file_base;
     }
-    prev_linesrcfile = linesrcfile;
+    row.end_sequence = end_sequence;
+    row.is_stmt = is_stmt;
+    rows_out->push_back(row);
   }
-
-  if (!found) {
-    result.first.assign(prev_linesrcfile);
-    result.second = prev_lineno;
-    found = true;
-  }
-  if (prev_linesrcfile) {
-    dwarf_dealloc(dbg, prev_linesrcfile, DW_DLA_STRING);
-  }
-
-  return result;
+  return DW_DLV_OK;
 }
 
 void walkDIE(Dwarf_Debug dbg, Dwarf_Die parent_die, Dwarf_Die die, int cur_lv,
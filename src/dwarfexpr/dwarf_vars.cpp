@@ -1,7 +1,9 @@
 #include "dwarfexpr/dwarf_vars.h"
 
 #include <algorithm>  // std::min
+#include <cstring>    // memcpy
 #include <sstream>
+#include <vector>
 
 #include "dwarfexpr/dwarf_utils.h"
 
@@ -64,27 +66,37 @@ DwarfVar::DwarfValue DwarfVar::evalValue(
   if (location_) {
     DwarfExpression::Result loc = location_->evalValue(context, pc);
     if (loc.type == DwarfExpression::Result::Type::kValue) {
-      return formatValue(type_, reinterpret_cast<char*>(&loc.value),
-                         sizeof(Dwarf_Signed));
+      // The bytes of the value in the memory of the little endian target.
+      uint64_t parts[2] = {loc.value, loc.value_high};
+      char bytes[sizeof(parts)];
+      for (size_t b = 0; b < sizeof(bytes); ++b) {
+        bytes[b] = static_cast<char>(parts[b / 8] >> (b % 8 * 8));
+      }
+      return formatValue(type_, bytes, sizeof(bytes));
     } else if (loc.type == DwarfExpression::Result::Type::kAddress) {
-      return evalValueAtLoc(type_, loc.value, context.memory);
+      return evalValueAtLoc(type_, loc.value, context, pc);
+    } else if (loc.type == DwarfExpression::Result::Type::kComposite) {
+      return evalComposite(type_, loc.pieces, context);
     }  // else loc.type == DwarfExpression::Result::Type::kInvalid
   }
   return "unknown";
 }
 
 DwarfVar::DwarfValue DwarfVar::evalValueAtLoc(
-    DwarfType* type, Dwarf_Addr addr,
-    DwarfExpression::MemoryProvider memory) const {
+    DwarfType* type, Dwarf_Addr addr, const DwarfExpression::Context& context,
+    Dwarf_Addr pc) const {
   char* buf = nullptr;
   size_t buf_size = 0;
   if (addr != 0) {
     size_t size = type->size();
     if (size != MAX_SIZE) {
-      bool found = memory(addr, size, &buf, &buf_size);
+      bool found = context.memory != nullptr &&
+                   context.memory(addr, size, &buf, &buf_size);
       if (!found) {
-        printf("Error: can not read memory at addr: 0x%llx, size=0x%zx\n", addr,
-              size);
+        if (DWARFEXPR_TRACING(context.tracer)) {
+          context.tracer->onEvent(
+              DwarfTraceEvent::MemoryInvalid(pc, addr, size));
+        }
         std::stringstream ss;
         ss << "unknown(addr=" << std::hex << addr << ")";
         return ss.str();
@@ -94,6 +106,82 @@ DwarfVar::DwarfValue DwarfVar::evalValueAtLoc(
   return formatValue(type, buf, buf_size);
 }
 
+// Copy `size_bits` bits from `src` at bit `src_bit` to `dst` at bit `dst_bit`,
+// the bits are numbered from the least significant one of the first byte.
+static void copyBits(char* dst, size_t dst_bit, const char* src,
+                     size_t src_bit, size_t size_bits) {
+  if (dst_bit % 8 == 0 && src_bit % 8 == 0 && size_bits % 8 == 0) {
+    memcpy(dst + dst_bit / 8, src + src_bit / 8, size_bits / 8);
+    return;
+  }
+  for (size_t i = 0; i < size_bits; ++i) {
+    size_t s = src_bit + i;
+    size_t d = dst_bit + i;
+    if ((src[s / 8] >> (s % 8)) & 1) {
+      dst[d / 8] |= 1 << (d % 8);
+    } else {
+      dst[d / 8] &= ~(1 << (d % 8));
+    }
+  }
+}
+
+DwarfVar::DwarfValue DwarfVar::evalComposite(
+    DwarfType* type, const DwarfPieces& pieces,
+    const DwarfExpression::Context& context) const {
+  size_t size = type->size();
+  if (size == MAX_SIZE) {
+    return "unknown type";
+  }
+  std::vector<char> buf(size, 0);  // the optimized out pieces stay 0
+  size_t bit = 0;
+  for (size_t i = 0; i < pieces.size() && bit < size * 8; ++i) {
+    const DwarfPiece& piece = pieces[i];
+    size_t size_bits = std::min<size_t>(piece.size_bits, size * 8 - bit);
+    switch (piece.kind) {
+      case DwarfPiece::Kind::kRegister:
+      case DwarfPiece::Kind::kValue: {
+        // The providers give the low 64 bits of the registers only, a wider
+        // piece, e.g. of a vector register, can not be assembled.
+        uint64_t value = piece.value;
+        if (piece.offset_bits + size_bits > sizeof(value) * 8) {
+          return "unknown";
+        }
+        if (piece.kind == DwarfPiece::Kind::kRegister &&
+            (context.registers == nullptr ||
+             !context.registers(piece.reg, &value))) {
+          return "unknown";
+        }
+        // The bytes of the value in the memory of the target, which is
+        // little endian like the expressions.
+        char bytes[sizeof(value)];
+        for (size_t b = 0; b < sizeof(bytes); ++b) {
+          bytes[b] = static_cast<char>(value >> (b * 8));
+        }
+        copyBits(buf.data(), bit, bytes, piece.offset_bits, size_bits);
+        break;
+      }
+      case DwarfPiece::Kind::kMemory: {
+        size_t read_size = (piece.offset_bits + size_bits + 7) / 8;
+        char* mem = nullptr;
+        size_t mem_size = 0;
+        if (context.memory == nullptr ||
+            !context.memory(piece.value, read_size, &mem, &mem_size) ||
+            mem_size < read_size) {
+          std::stringstream ss;
+          ss << "unknown(addr=" << std::hex << piece.value << ")";
+          return ss.str();
+        }
+        copyBits(buf.data(), bit, mem, piece.offset_bits, size_bits);
+        break;
+      }
+      default:
+        break;
+    }
+    bit += size_bits;
+  }
+  return formatValue(type, buf.data(), size);
+}
+
 DwarfVar::DwarfValue DwarfVar::formatValue(DwarfType* type, char* buf,
                                            size_t buf_size) const {
   if (type->tag() == DW_TAG_pointer_type) {
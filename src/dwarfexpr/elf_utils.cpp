@@ -0,0 +1,235 @@
+#include "dwarfexpr/elf_utils.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace dwarfexpr {
+
+namespace {
+
+// Only the fields we need from the ELF spec, <elf.h> is not available on
+// every platform.
+constexpr uint8_t kElfClass32 = 1;
+constexpr uint8_t kElfClass64 = 2;
+constexpr uint8_t kElfData2Lsb = 1;
+constexpr uint8_t kElfData2Msb = 2;
+constexpr uint32_t kPtNote = 4;
+constexpr uint32_t kShtNote = 7;
+constexpr uint32_t kNtGnuBuildId = 3;
+
+class ElfReader {
+ public:
+  ElfReader() : fp_(nullptr), is_64_(false), is_lsb_(true) {}
+  ElfReader(FILE* fp, bool is_64, bool is_lsb)
+      : fp_(fp), is_64_(is_64), is_lsb_(is_lsb) {}
+
+  bool read(uint64_t offset, void* buf, size_t size) {
+    return fseek(fp_, static_cast<long>(offset), SEEK_SET) == 0 &&
+           fread(buf, 1, size, fp_) == size;
+  }
+
+  uint64_t get(const uint8_t* p, size_t size) const {
+    uint64_t v = 0;
+    for (size_t i = 0; i < size; ++i) {
+      size_t shift = is_lsb_ ? i : size - 1 - i;
+      v |= static_cast<uint64_t>(p[i]) << (shift * 8);
+    }
+    return v;
+  }
+
+  // Size of a "word": an address or an offset.
+  size_t word() const { return is_64_ ? 8 : 4; }
+  bool is64() const { return is_64_; }
+
+ private:
+  FILE* fp_;
+  bool is_64_;
+  bool is_lsb_;
+};
+
+// Scan a note segment/section for the GNU build-id.
+bool findBuildIdNote(ElfReader* reader, uint64_t offset, uint64_t size,
+                     std::vector<uint8_t>* out_build_id) {
+  if (size > (16u << 20)) {
+    return false;  // not a sane note section
+  }
+  std::vector<uint8_t> buf(size);
+  if (!reader->read(offset, buf.data(), buf.size())) {
+    return false;
+  }
+
+  size_t pos = 0;
+  while (pos + 12 <= buf.size()) {
+    uint64_t namesz = reader->get(&buf[pos], 4);
+    uint64_t descsz = reader->get(&buf[pos + 4], 4);
+    uint64_t type = reader->get(&buf[pos + 8], 4);
+    size_t name_pos = pos + 12;
+    size_t desc_pos = name_pos + ((namesz + 3) & ~3ull);
+    size_t next_pos = desc_pos + ((descsz + 3) & ~3ull);
+    if (desc_pos + descsz > buf.size()) {
+      return false;
+    }
+    if (type == kNtGnuBuildId && namesz == 4 &&
+        memcmp(&buf[name_pos], "GNU", 4) == 0) {
+      out_build_id->assign(buf.begin() + desc_pos,
+                           buf.begin() + desc_pos + descsz);
+      return true;
+    }
+    pos = next_pos;
+  }
+  return false;
+}
+
+struct ElfHeader {
+  ElfReader reader;
+  uint16_t machine;
+  uint64_t phoff;
+  uint64_t shoff;
+  uint64_t phentsize;
+  uint64_t phnum;
+  uint64_t shentsize;
+  uint64_t shnum;
+};
+
+// Open the ELF file and parse its header, the caller closes `*out_fp` on
+// success.
+bool openElf(const std::string& path, FILE** out_fp, ElfHeader* out_ehdr) {
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (fp == nullptr) {
+    return false;
+  }
+
+  uint8_t ident[16];
+  if (fread(ident, 1, sizeof(ident), fp) != sizeof(ident) ||
+      memcmp(ident, "\x7f" "ELF", 4) != 0 ||
+      (ident[4] != kElfClass32 && ident[4] != kElfClass64) ||
+      (ident[5] != kElfData2Lsb && ident[5] != kElfData2Msb)) {
+    fclose(fp);
+    return false;
+  }
+  ElfReader reader(fp, ident[4] == kElfClass64, ident[5] == kElfData2Lsb);
+
+  // ELF header, the layout only differs in the size of the address/offset
+  // fields.
+  uint8_t ehdr[64];
+  size_t ehdr_size = reader.is64() ? 64 : 52;
+  if (!reader.read(0, ehdr, ehdr_size)) {
+    fclose(fp);
+    return false;
+  }
+  size_t w = reader.word();
+  out_ehdr->reader = reader;
+  out_ehdr->machine = static_cast<uint16_t>(reader.get(ehdr + 18, 2));
+  // skip e_ident, e_type, e_machine, e_version and e_entry
+  const uint8_t* p = ehdr + 24 + w;
+  out_ehdr->phoff = reader.get(p, w);
+  out_ehdr->shoff = reader.get(p + w, w);
+  p += 2 * w + 4 /* e_flags */ + 2 /* e_ehsize */;
+  out_ehdr->phentsize = reader.get(p, 2);
+  out_ehdr->phnum = reader.get(p + 2, 2);
+  out_ehdr->shentsize = reader.get(p + 4, 2);
+  out_ehdr->shnum = reader.get(p + 6, 2);
+
+  *out_fp = fp;
+  return true;
+}
+
+}  // namespace
+
+bool readElfBuildId(const std::string& path,
+                    std::vector<uint8_t>* out_build_id) {
+  out_build_id->clear();
+
+  FILE* fp = nullptr;
+  ElfHeader ehdr;
+  if (!openElf(path, &fp, &ehdr)) {
+    return false;
+  }
+  ElfReader& reader = ehdr.reader;
+  size_t w = reader.word();
+  bool found = false;
+
+  // Section headers first, they survive `strip`; then the program headers.
+  uint8_t hdr[64];
+  for (uint64_t i = 0;
+       !found && i < ehdr.shnum && ehdr.shentsize <= sizeof(hdr); ++i) {
+    if (!reader.read(ehdr.shoff + i * ehdr.shentsize, hdr, ehdr.shentsize)) {
+      break;
+    }
+    uint64_t type = reader.get(hdr + 4, 4);
+    if (type != kShtNote) {
+      continue;
+    }
+    // sh_name, sh_type, sh_flags, sh_addr, sh_offset, sh_size
+    uint64_t offset = reader.get(hdr + 8 + 2 * w, w);
+    uint64_t size = reader.get(hdr + 8 + 3 * w, w);
+    found = findBuildIdNote(&reader, offset, size, out_build_id);
+  }
+  for (uint64_t i = 0;
+       !found && i < ehdr.phnum && ehdr.phentsize <= sizeof(hdr); ++i) {
+    if (!reader.read(ehdr.phoff + i * ehdr.phentsize, hdr, ehdr.phentsize)) {
+      break;
+    }
+    uint64_t type = reader.get(hdr, 4);
+    if (type != kPtNote) {
+      continue;
+    }
+    // 64-bit: p_type, p_flags, p_offset, p_vaddr, p_paddr, p_filesz
+    // 32-bit: p_type, p_offset, p_vaddr, p_paddr, p_filesz
+    uint64_t offset =
+        reader.is64() ? reader.get(hdr + 8, 8) : reader.get(hdr + 4, 4);
+    uint64_t size =
+        reader.is64() ? reader.get(hdr + 32, 8) : reader.get(hdr + 16, 4);
+    found = findBuildIdNote(&reader, offset, size, out_build_id);
+  }
+
+  fclose(fp);
+  return found;
+}
+
+bool readElfMachine(const std::string& path, uint16_t* out_machine) {
+  FILE* fp = nullptr;
+  ElfHeader ehdr;
+  if (!openElf(path, &fp, &ehdr)) {
+    return false;
+  }
+  *out_machine = ehdr.machine;
+  fclose(fp);
+  return true;
+}
+
+std::string buildIdToHex(const std::vector<uint8_t>& build_id) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(build_id.size() * 2);
+  for (uint8_t b : build_id) {
+    hex.push_back(kHex[b >> 4]);
+    hex.push_back(kHex[b & 0xf]);
+  }
+  return hex;
+}
+
+bool buildIdFromHex(const std::string& hex,
+                    std::vector<uint8_t>* out_build_id) {
+  if (hex.empty() || hex.size() % 2 != 0) {
+    return false;
+  }
+  auto nibble = [](char c) -> int {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  };
+  out_build_id->clear();
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    int hi = nibble(hex[i]);
+    int lo = nibble(hex[i + 1]);
+    if (hi < 0 || lo < 0) {
+      return false;
+    }
+    out_build_id->push_back(static_cast<uint8_t>(hi << 4 | lo));
+  }
+  return true;
+}
+
+}  // namespace dwarfexpr
@@ -0,0 +1,200 @@
+#include "dwarfexpr/symbol_store.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>  // std::sort, std::lower_bound
+#include <cstdio>
+#include <cstring>
+
+#include "dwarfexpr/elf_utils.h"
+
+namespace dwarfexpr {
+
+namespace {
+
+uint64_t alignUp(uint64_t offset) { return (offset + 7) & ~7ull; }
+
+bool entryLess(const SymbolStoreEntry& a, const SymbolStoreEntry& b) {
+  int cmp = memcmp(a.build_id, b.build_id, kSymbolStoreMaxBuildId);
+  return cmp != 0 ? cmp < 0 : a.build_id_size < b.build_id_size;
+}
+
+bool makeEntry(const std::vector<uint8_t>& build_id, SymbolStoreEntry* entry) {
+  if (build_id.empty() || build_id.size() > kSymbolStoreMaxBuildId) {
+    return false;
+  }
+  memset(entry, 0, sizeof(*entry));
+  memcpy(entry->build_id, build_id.data(), build_id.size());
+  entry->build_id_size = static_cast<uint32_t>(build_id.size());
+  return true;
+}
+
+void listDir(const std::string& dir, std::vector<std::string>* out_names) {
+  out_names->clear();
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return;
+  }
+  while (dirent* ent = readdir(d)) {
+    if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+      out_names->emplace_back(ent->d_name);
+    }
+  }
+  closedir(d);
+  std::sort(out_names->begin(), out_names->end());  // stable index files
+}
+
+bool isDir(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+}  // namespace
+
+int SymbolStore::buildIndex(const std::string& store_dir,
+                            const std::string& index_path) {
+  if (!isDir(store_dir)) {
+    printf("Error: not a directory: %s\n", store_dir.c_str());
+    return -1;
+  }
+
+  std::vector<SymbolStoreEntry> entries;
+  std::string strings;
+  std::vector<std::string> names, ids, files;
+  std::vector<uint8_t> build_id;
+  // Only the `<name>/<id>/<file>` level holds debug files.
+  listDir(store_dir, &names);
+  for (const std::string& name : names) {
+    listDir(store_dir + "/" + name, &ids);
+    for (const std::string& id : ids) {
+      std::string id_dir = name + "/" + id;
+      listDir(store_dir + "/" + id_dir, &files);
+      for (const std::string& file : files) {
+        std::string rel_path = id_dir + "/" + file;
+        SymbolStoreEntry entry;
+        if (!readElfBuildId(store_dir + "/" + rel_path, &build_id) ||
+            !makeEntry(build_id, &entry)) {
+          continue;  // e.g. a `.sym` file
+        }
+        entry.path = static_cast<uint32_t>(strings.size());
+        strings.append(rel_path);
+        strings.push_back('\0');
+        entries.push_back(entry);
+      }
+    }
+  }
+  std::sort(entries.begin(), entries.end(), entryLess);
+
+  SymbolStoreHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kSymbolStoreMagic, sizeof(header.magic));
+  header.version = kSymbolStoreVersion;
+  header.header_size = sizeof(SymbolStoreHeader);
+  header.entry_count = static_cast<uint32_t>(entries.size());
+  header.entries_offset = alignUp(sizeof(header));
+  header.strings_offset = alignUp(header.entries_offset +
+                                  entries.size() * sizeof(SymbolStoreEntry));
+  header.strings_size = strings.size();
+
+  FILE* fp = fopen(index_path.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("Error: can not open %s\n", index_path.c_str());
+    return -1;
+  }
+  // Both the header and the entries are multiples of 8 bytes, so there is no
+  // padding between the sections.
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(entries.data(), sizeof(SymbolStoreEntry), entries.size(),
+                   fp) == entries.size() &&
+            fwrite(strings.data(), 1, strings.size(), fp) == strings.size();
+  if (fclose(fp) != 0) {
+    ok = false;
+  }
+  return ok ? static_cast<int>(entries.size()) : -1;
+}
+
+bool SymbolStore::open(const std::string& store_dir,
+                       const std::string& index_path) {
+  close();
+
+  int fd = ::open(index_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(SymbolStoreHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // the mapping keeps the file
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  data_ = data;
+  size_ = st.st_size;
+
+  const char* base = static_cast<const char*>(data_);
+  header_ = reinterpret_cast<const SymbolStoreHeader*>(base);
+  const SymbolStoreHeader& h = *header_;
+  auto inBounds = [&](uint64_t offset, uint64_t count, uint64_t size) {
+    return offset % 8 == 0 && offset <= size_ &&
+           count <= (size_ - offset) / size;
+  };
+  if (memcmp(h.magic, kSymbolStoreMagic, sizeof(h.magic)) != 0 ||
+      h.version != kSymbolStoreVersion ||
+      h.header_size != sizeof(SymbolStoreHeader) ||
+      !inBounds(h.entries_offset, h.entry_count, sizeof(SymbolStoreEntry)) ||
+      !inBounds(h.strings_offset, h.strings_size, 1) ||
+      (h.strings_size > 0 && base[h.strings_offset + h.strings_size - 1])) {
+    printf("Error: invalid symbol store index: %s\n", index_path.c_str());
+    close();
+    return false;
+  }
+
+  store_dir_ = store_dir;
+  entries_ = reinterpret_cast<const SymbolStoreEntry*>(base + h.entries_offset);
+  strings_ = base + h.strings_offset;
+  return true;
+}
+
+void SymbolStore::close() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+  store_dir_.clear();
+  data_ = nullptr;
+  size_ = 0;
+  header_ = nullptr;
+  entries_ = nullptr;
+  strings_ = nullptr;
+}
+
+size_t SymbolStore::size() const {
+  return header_ != nullptr ? header_->entry_count : 0;
+}
+
+bool SymbolStore::lookup(const std::vector<uint8_t>& build_id,
+                         std::string* out_path) const {
+  SymbolStoreEntry key;
+  if (header_ == nullptr || !makeEntry(build_id, &key)) {
+    return false;
+  }
+  const SymbolStoreEntry* end = entries_ + header_->entry_count;
+  const SymbolStoreEntry* it = std::lower_bound(entries_, end, key, entryLess);
+  if (it == end || entryLess(key, *it)) {
+    return false;
+  }
+  if (it->path >= header_->strings_size) {
+    return false;
+  }
+  *out_path = store_dir_ + "/" + (strings_ + it->path);
+  return true;
+}
+
+}  // namespace dwarfexpr
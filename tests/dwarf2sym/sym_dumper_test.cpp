@@ -0,0 +1,90 @@
+#include "sym_dumper.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace dwarf2sym {
+
+using dwarfexpr::DwarfFrames;
+
+constexpr uint16_t kEmAarch64 = 183;
+constexpr Dwarf_Half kArm64Fp = 29;
+constexpr Dwarf_Half kArm64Lr = 30;
+constexpr Dwarf_Half kArm64Sp = 31;
+constexpr Dwarf_Half kArm64RegCount = 32;
+
+static DwarfFrames::CfiRule Reg(Dwarf_Unsigned reg, Dwarf_Signed offset = 0) {
+  DwarfFrames::CfiRule rule;
+  rule.offset_relevant = 1;
+  rule.reg = reg;
+  rule.offset = offset;
+  return rule;
+}
+
+static DwarfFrames::CfiRule SameValue() {
+  DwarfFrames::CfiRule rule;
+  rule.reg = DW_FRAME_SAME_VAL;
+  return rule;
+}
+
+static DwarfFrames::CfiRule AtCfa(Dwarf_Signed offset) {
+  return Reg(DW_FRAME_CFA_COL, offset);
+}
+
+static std::string WriteCfi(uint16_t machine,
+                            const std::vector<DwarfFrames::CfiTable>& tables) {
+  char* buf = nullptr;
+  size_t size = 0;
+  FILE* out = open_memstream(&buf, &size);
+  SymDumper::writeCfiTables(machine, tables, out);
+  fclose(out);
+  std::string text(buf, size);
+  free(buf);
+  return text;
+}
+
+TEST(SymDumperTest, arm64_cfi) {
+  // stp x29, x30, [sp, #-16]!; mov x29, sp; ...; ldp x29, x30, [sp], #16; ret
+  DwarfFrames::CfiTable table = {};
+  table.low_pc = 0x1000;
+  table.high_pc = 0x1018;
+  table.ra_reg = kArm64Lr;
+
+  DwarfFrames::CfiRow entry;
+  entry.pc = 0x1000;
+  entry.cfa = Reg(kArm64Sp, 0);
+  entry.regs.resize(kArm64RegCount);
+  entry.regs[19] = SameValue();
+  entry.regs[kArm64Fp] = SameValue();
+  entry.regs[kArm64Lr] = SameValue();  // the return address is in lr
+  table.rows.push_back(entry);
+
+  DwarfFrames::CfiRow saved = entry;
+  saved.pc = 0x1004;
+  saved.cfa = Reg(kArm64Sp, 16);
+  saved.regs[kArm64Fp] = AtCfa(-16);
+  saved.regs[kArm64Lr] = AtCfa(-8);
+  table.rows.push_back(saved);
+
+  DwarfFrames::CfiRow frame = saved;
+  frame.pc = 0x1008;
+  frame.cfa = Reg(kArm64Fp, 16);
+  table.rows.push_back(frame);
+
+  DwarfFrames::CfiRow restored = entry;
+  restored.pc = 0x1014;
+  table.rows.push_back(restored);
+
+  EXPECT_EQ(
+      "STACK CFI INIT 1000 18 .cfa: sp 0 + .ra: x30\n"
+      "STACK CFI 1004 .cfa: sp 16 + x29: .cfa -16 + ^ .ra: .cfa -8 + ^\n"
+      "STACK CFI 1008 .cfa: x29 16 +\n"
+      "STACK CFI 1014 .cfa: sp 0 + x29: x29 .ra: x30\n",
+      WriteCfi(kEmAarch64, {table}));
+}
+
+}  // namespace dwarf2sym
@@ -1,7 +1,9 @@
 #include "dwarfexpr/dwarf_expression.h"
+#include "dwarfexpr/dwarf_expression_eval.h"
 
 #include <gtest/gtest.h>
 
+#include <cstring>  // memcpy
 #include <numeric>
 #include <vector>
 
@@ -78,13 +80,13 @@ TYPED_TEST_P(DwarfExpressionTest, empty_ops) {
 }
 
 TYPED_TEST_P(DwarfExpressionTest, not_implemented) {
-  // DW_OP_piece not implemented error.
-  this->expr_.setOps({OP(DW_OP_nop, 0), OP(DW_OP_nop, 1), OP(DW_OP_piece, 2)});
+  // DW_OP_xderef not implemented error.
+  this->expr_.setOps({OP(DW_OP_nop, 0), OP(DW_OP_nop, 1), OP(DW_OP_xderef, 2)});
   Result ret = this->expr_.evaluate(this->ctx_, 0, &this->stack_);
   ASSERT_FALSE(ret.valid());
   ASSERT_EQ(ErrorCode::kNotImplemented, ret.error_code);
   ASSERT_EQ(2U, ret.error_addr);
-  ASSERT_EQ(DW_OP_piece, this->GetOpCodeByOffset(ret.error_addr));
+  ASSERT_EQ(DW_OP_xderef, this->GetOpCodeByOffset(ret.error_addr));
 }
 
 TYPED_TEST_P(DwarfExpressionTest, illegal_op) {
@@ -476,12 +478,517 @@ TYPED_TEST_P(DwarfExpressionTest, op_rot) {
   ASSERT_EQ(0x30U, this->StackAt(2));
 }
 
+TYPED_TEST_P(DwarfExpressionTest, op_skip) {
+  // The offset counts from the end of the 3-byte DW_OP_skip.
+  this->expr_.setOps({OP1(DW_OP_skip, 1, 0), OP(DW_OP_lit1, 3),
+                      OP(DW_OP_lit2, 4)});
+  Result ret = this->expr_.evaluate(this->ctx_, 0, &this->stack_);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(1, this->stack_.size());
+  ASSERT_EQ(2U, ret.value);
+
+  // Skip to the end of the expression.
+  this->ClearStack();
+  this->expr_.setOps({OP(DW_OP_lit3, 0), OP1(DW_OP_skip, 1, 1),
+                      OP(DW_OP_lit1, 4)});
+  this->expr_.compile();
+  ASSERT_TRUE(this->expr_.compiled());
+  ret = this->expr_.evaluate(this->ctx_, 0, &this->stack_);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(3U, ret.value);
+
+  // The target is not the offset of an op.
+  this->ClearStack();
+  this->expr_.setOps({OP1(DW_OP_skip, 0xfffe, 0), OP(DW_OP_lit1, 3)});
+  ret = this->expr_.evaluate(this->ctx_, 0, &this->stack_);
+  ASSERT_FALSE(ret.valid());
+  ASSERT_EQ(ErrorCode::kIllegalOpd, ret.error_code);
+  ASSERT_EQ(0U, ret.error_addr);
+
+  // The target is before the expression.
+  this->ClearStack();
+  this->expr_.setOps({OP(DW_OP_lit3, 0), OP1(DW_OP_skip, 0xfff0, 1),
+                      OP(DW_OP_lit1, 4)});
+  ret = this->expr_.evaluate(this->ctx_, 0, &this->stack_);
+  ASSERT_FALSE(ret.valid());
+  ASSERT_EQ(ErrorCode::kIllegalOpd, ret.error_code);
+  ASSERT_EQ(1U, ret.error_addr);
+
+  // The target is past the end of the expression.
+  this->ClearStack();
+  this->expr_.setOps({OP(DW_OP_lit3, 0), OP1(DW_OP_skip, 2, 1),
+                      OP(DW_OP_lit1, 4)});
+  ret = this->expr_.evaluate(this->ctx_, 0, &this->stack_);
+  ASSERT_FALSE(ret.valid());
+  ASSERT_EQ(ErrorCode::kIllegalOpd, ret.error_code);
+  ASSERT_EQ(1U, ret.error_addr);
+}
+
+TYPED_TEST_P(DwarfExpressionTest, op_bra) {
+  this->expr_.setOps({OP(DW_OP_lit0, 0), OP1(DW_OP_bra, 1, 1),
+                      OP(DW_OP_lit5, 4), OP(DW_OP_lit7, 5)});
+  this->expr_.compile();
+
+  // The condition is zero, no branch.
+  Result ret = this->expr_.evaluate(this->ctx_, 0, &this->stack_);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(2, this->stack_.size());
+  ASSERT_EQ(7U, this->StackAt(0));
+  ASSERT_EQ(5U, this->StackAt(1));
+
+  this->ClearStack();
+  this->expr_.setOps({OP(DW_OP_lit1, 0), OP1(DW_OP_bra, 1, 1),
+                      OP(DW_OP_lit5, 4), OP(DW_OP_lit7, 5)});
+  ret = this->expr_.evaluate(this->ctx_, 0, &this->stack_);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(1, this->stack_.size());
+  ASSERT_EQ(7U, this->StackAt(0));
+
+  // Requires one stack element.
+  this->ClearStack();
+  this->expr_.setOps({OP1(DW_OP_bra, 1, 0), OP(DW_OP_lit7, 3)});
+  ret = this->expr_.evaluate(this->ctx_, 0, &this->stack_);
+  ASSERT_FALSE(ret.valid());
+  ASSERT_EQ(ErrorCode::kStackIndexInvalid, ret.error_code);
+}
+
 REGISTER_TYPED_TEST_SUITE_P(DwarfExpressionTest, empty_ops, not_implemented,
                             illegal_op, op_addr, op_deref, op_deref_size,
                             op_const_unsigned, op_const_signed, op_dup, op_drop,
-                            op_over, op_pick, op_swap, op_rot);
+                            op_over, op_pick, op_swap, op_rot, op_skip, op_bra);
 using DwarfExpressionTypes = ::testing::Types<uint64_t>;
 INSTANTIATE_TYPED_TEST_SUITE_P(TypedDwarfExpressionTest, DwarfExpressionTest,
                                DwarfExpressionTypes);
 
+TEST(DwarfExpressionPieceTest, composite) {
+  const uint8_t implicit[] = {0x34, 0x12};
+  DwarfExpression expr;
+  // A struct of a register, a stack value, an implicit value, a memory word,
+  // an optimized out word and 4 bits at bit 2 of a register.
+  expr.setOps({OP(DW_OP_reg1, 0), OP1(DW_OP_piece, 8, 1),
+               OP(DW_OP_lit5, 3), OP(DW_OP_stack_value, 4),
+               OP1(DW_OP_piece, 4, 5),
+               OP2(DW_OP_implicit_value, 2,
+                   reinterpret_cast<Dwarf_Unsigned>(implicit), 7),
+               OP1(DW_OP_piece, 2, 11), OP1(DW_OP_addr, 0x1000, 13),
+               OP1(DW_OP_piece, 8, 22), OP1(DW_OP_piece, 8, 24),
+               OP(DW_OP_reg2, 26), OP2(DW_OP_bit_piece, 4, 2, 27)});
+  expr.compile();
+  Context ctx = {};
+  Result ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(Result::Type::kComposite, ret.type);
+  ASSERT_EQ(6U, ret.pieces.size());
+
+  ASSERT_EQ(DwarfPiece::Kind::kRegister, ret.pieces[0].kind);
+  ASSERT_EQ(1U, ret.pieces[0].reg);
+  ASSERT_EQ(64U, ret.pieces[0].size_bits);
+  ASSERT_EQ(DwarfPiece::Kind::kValue, ret.pieces[1].kind);
+  ASSERT_EQ(5U, ret.pieces[1].value);
+  ASSERT_EQ(32U, ret.pieces[1].size_bits);
+  ASSERT_EQ(DwarfPiece::Kind::kValue, ret.pieces[2].kind);
+  ASSERT_EQ(0x1234U, ret.pieces[2].value);
+  ASSERT_EQ(DwarfPiece::Kind::kMemory, ret.pieces[3].kind);
+  ASSERT_EQ(0x1000U, ret.pieces[3].value);
+  ASSERT_EQ(DwarfPiece::Kind::kEmpty, ret.pieces[4].kind);
+  ASSERT_EQ(64U, ret.pieces[4].size_bits);
+  ASSERT_EQ(DwarfPiece::Kind::kRegister, ret.pieces[5].kind);
+  ASSERT_EQ(2U, ret.pieces[5].reg);
+  ASSERT_EQ(4U, ret.pieces[5].size_bits);
+  ASSERT_EQ(2U, ret.pieces[5].offset_bits);
+}
+
+TEST(DwarfStackTest, spill) {
+  DwarfStack stack;
+  const size_t size = DwarfStack::kInlineSize * 3;
+  for (size_t i = 0; i < size; ++i) {
+    stack.push(i);
+  }
+  ASSERT_EQ(size, stack.size());
+  for (size_t i = 0; i < size; ++i) {
+    ASSERT_EQ(static_cast<Dwarf_Signed>(size - 1 - i), stack.at(i));
+  }
+  stack.pop();
+  ASSERT_EQ(static_cast<Dwarf_Signed>(size - 2), stack.top());
+}
+
+// A dense register array instead of a `std::function`.
+struct RegisterArray {
+  uint64_t values[4];
+  bool operator()(int reg_num, uint64_t* value) const {
+    if (reg_num < 0 || reg_num >= 4) {
+      return false;
+    }
+    *value = values[reg_num];
+    return true;
+  }
+};
+
+struct NoMemory {
+  bool operator()(uint64_t, size_t, char**, size_t*) const { return false; }
+};
+
+struct NoCfa {
+  Dwarf_Addr operator()(Dwarf_Addr) const { return 0; }
+};
+
+TEST(DwarfExpressionProvidersTest, register_array) {
+  DwarfExpression expr;
+  expr.setOps({OP1(DW_OP_breg2, 0x10, 0)});
+  expr.compile();
+  Context ctx = {};
+  RegisterArray regs = {{0, 0, 0x1000, 0}};
+  Result ret = expr.evaluate(ctx, regs, NoMemory(), NoCfa(), 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(DwarfExpression::Result::Type::kAddress, ret.type);
+  ASSERT_EQ(0x1010U, ret.value);
+
+  expr.setOps({OP(DW_OP_reg7, 0)});
+  ret = expr.evaluate(ctx, regs, NoMemory(), NoCfa(), 0);
+  ASSERT_FALSE(ret.valid());
+  ASSERT_EQ(ErrorCode::kRegisterInvalid, ret.error_code);
+
+  expr.setOps({OP(DW_OP_lit1, 0), OP(DW_OP_deref, 1)});
+  ret = expr.evaluate(ctx, regs, NoMemory(), NoCfa(), 0);
+  ASSERT_FALSE(ret.valid());
+  ASSERT_EQ(ErrorCode::kMemoryInvalid, ret.error_code);
+  ASSERT_EQ(1U, ret.error_addr);
+}
+
+TEST(DwarfExpressionArithmeticTest, div_overflow) {
+  const Dwarf_Signed kMin = std::numeric_limits<Dwarf_Signed>::min();
+  DwarfExpression expr;
+  Context ctx = {};
+  expr.setOps({OP1(DW_OP_const8s, static_cast<Dwarf_Unsigned>(kMin), 0),
+               OP1(DW_OP_const1s, static_cast<Dwarf_Unsigned>(-1), 9),
+               OP(DW_OP_div, 11), OP(DW_OP_stack_value, 12)});
+  Result ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(kMin, static_cast<Dwarf_Signed>(ret.value));
+
+  expr.setOps({OP1(DW_OP_const8s, static_cast<Dwarf_Unsigned>(kMin), 0),
+               OP1(DW_OP_const1s, static_cast<Dwarf_Unsigned>(-1), 9),
+               OP(DW_OP_mod, 11), OP(DW_OP_stack_value, 12)});
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(0U, ret.value);
+}
+
+struct RecordTracer : public DwarfTracer {
+  void onEvent(const DwarfTraceEvent& event) override {
+    events.push_back(event);
+  }
+  std::vector<DwarfTraceEvent> events;
+};
+
+TEST(DwarfExpressionTracerTest, register_offset) {
+  DwarfExpression expr;
+  expr.setOps({OP1(DW_OP_breg2, 0x10, 0), OP(DW_OP_xderef, 1)});
+  RecordTracer tracer;
+  Context ctx = {};
+  ctx.registers = [](int reg_num, uint64_t* value) {
+    *value = 0x1000;
+    return true;
+  };
+  ctx.tracer = &tracer;
+  Result ret = expr.evaluate(ctx, 0x20);
+  ASSERT_EQ(ErrorCode::kNotImplemented, ret.error_code);
+
+  ASSERT_EQ(2U, tracer.events.size());
+  ASSERT_EQ(DwarfTraceEvent::Type::kRegisterOffset, tracer.events[0].type);
+  ASSERT_EQ(0x20U, tracer.events[0].pc);
+  ASSERT_EQ(2U, tracer.events[0].reg);
+  ASSERT_EQ(0x10, tracer.events[0].offset);
+  ASSERT_EQ(0x1010U, tracer.events[0].value);
+  ASSERT_EQ(DwarfTraceEvent::Type::kNotImplemented, tracer.events[1].type);
+  ASSERT_EQ(DW_OP_xderef, tracer.events[1].opcode);
+}
+
+TEST(DwarfExpressionTracerTest, memory_invalid) {
+  DwarfExpression expr;
+  expr.setOps({OP1(DW_OP_addr, 0x4000, 0), OP(DW_OP_deref, 9)});
+  RecordTracer tracer;
+  Context ctx = {};
+  ctx.memory = [](uint64_t addr, size_t size, char** buf, size_t* out_size) {
+    return false;
+  };
+  ctx.tracer = &tracer;
+  Result ret = expr.evaluate(ctx, 0x20);
+  ASSERT_EQ(ErrorCode::kMemoryInvalid, ret.error_code);
+  ASSERT_EQ(9U, ret.error_addr);
+
+  ASSERT_EQ(1U, tracer.events.size());
+  ASSERT_EQ(DwarfTraceEvent::Type::kMemoryInvalid, tracer.events[0].type);
+  ASSERT_EQ(0x20U, tracer.events[0].pc);
+  ASSERT_EQ(0x4000U, tracer.events[0].addr);
+  ASSERT_EQ(8U, tracer.events[0].value);
+}
+
+TEST(DwarfExpressionDecodeTest, operands) {
+  const uint8_t bytes[] = {
+      DW_OP_breg29,         0x70,  // sleb -16
+      DW_OP_const2s,        0xfe, 0xff,
+      DW_OP_addr,           1,    2,    3, 4, 5, 6, 7, 8,
+      DW_OP_bregx,          0x81, 0x01, 0x08,  // uleb 129, sleb 8
+      DW_OP_implicit_value, 2,    0xaa, 0xbb,
+      DW_OP_stack_value};
+  DwarfExpression expr;
+  ASSERT_TRUE(DwarfExpression::decode(bytes, sizeof(bytes), 8, 4, 5, &expr));
+  ASSERT_TRUE(expr.compiled());
+  ASSERT_EQ(6U, expr.count());
+
+  ASSERT_EQ(DW_OP_breg29, expr.getOp(0).opcode);
+  ASSERT_EQ(-16, static_cast<Dwarf_Signed>(expr.getOp(0).op1));
+  ASSERT_EQ(0U, expr.getOp(0).off);
+  ASSERT_EQ(-2, static_cast<Dwarf_Signed>(expr.getOp(1).op1));
+  ASSERT_EQ(2U, expr.getOp(1).off);
+  ASSERT_EQ(0x0807060504030201U, expr.getOp(2).op1);
+  ASSERT_EQ(129U, expr.getOp(3).op1);
+  ASSERT_EQ(8U, expr.getOp(3).op2);
+  ASSERT_EQ(2U, expr.getOp(4).op1);
+  ASSERT_EQ(reinterpret_cast<Dwarf_Unsigned>(&bytes[20]), expr.getOp(4).op2);
+  ASSERT_EQ(DW_OP_stack_value, expr.getOp(5).opcode);
+  ASSERT_EQ(22U, expr.getOp(5).off);
+}
+
+TEST(DwarfExpressionDecodeTest, branch) {
+  const uint8_t bytes[] = {DW_OP_lit1, DW_OP_bra, 0x01, 0x00, DW_OP_lit5,
+                           DW_OP_lit7};
+  DwarfExpression expr;
+  ASSERT_TRUE(DwarfExpression::decode(bytes, sizeof(bytes), 8, 4, 5, &expr));
+  Context ctx = {};
+  std::stack<Dwarf_Signed> stack;
+  Result ret = expr.evaluate(ctx, 0, &stack);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(1U, stack.size());
+  ASSERT_EQ(7U, ret.value);
+}
+
+TEST(DwarfExpressionDecodeTest, branch_end) {
+  // The end of the decoded bytes is a target, not past it.
+  const uint8_t end[] = {DW_OP_lit3, DW_OP_skip, 0x02, 0x00,
+                         DW_OP_const1u, 0x05};
+  DwarfExpression expr;
+  ASSERT_TRUE(DwarfExpression::decode(end, sizeof(end), 8, 4, 5, &expr));
+  Context ctx = {};
+  Result ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(3U, ret.value);
+
+  const uint8_t past_end[] = {DW_OP_lit3, DW_OP_skip, 0x03, 0x00,
+                              DW_OP_const1u, 0x05};
+  ASSERT_TRUE(
+      DwarfExpression::decode(past_end, sizeof(past_end), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_FALSE(ret.valid());
+  ASSERT_EQ(ErrorCode::kIllegalOpd, ret.error_code);
+  ASSERT_EQ(1U, ret.error_addr);
+}
+
+TEST(DwarfExpressionDecodeTest, entry_value) {
+  // DW_OP_entry_value(DW_OP_reg1) + 2, DW_OP_stack_value
+  const uint8_t bytes[] = {DW_OP_entry_value, 0x01, DW_OP_reg1,
+                           DW_OP_plus_uconst, 0x02, DW_OP_stack_value};
+  DwarfExpression expr;
+  ASSERT_TRUE(DwarfExpression::decode(bytes, sizeof(bytes), 8, 4, 5, &expr));
+  Context ctx = {};
+  Result ret = expr.evaluate(ctx, 0);
+  ASSERT_EQ(ErrorCode::kEntryValueInvalid, ret.error_code);
+
+  ctx.entryValue = [](uint32_t reg, uint64_t* value) {
+    *value = reg == 1 ? 40 : 0;
+    return reg == 1;
+  };
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(Result::Type::kValue, ret.type);
+  ASSERT_EQ(42U, ret.value);
+
+  // Only a register is supported in the block.
+  const uint8_t unsupported[] = {DW_OP_GNU_entry_value, 0x02, DW_OP_breg1,
+                                 0x00, DW_OP_stack_value};
+  ASSERT_TRUE(DwarfExpression::decode(unsupported, sizeof(unsupported), 8, 4,
+                                      5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_EQ(ErrorCode::kNotImplemented, ret.error_code);
+}
+
+// The base types of the typed ops by CU offset.
+static bool TestBaseType(Dwarf_Off offset, DwarfBaseType* type) {
+  switch (offset) {
+    case 0x10:
+      *type = {DW_ATE_signed, 4};
+      return true;
+    case 0x20:
+      *type = {DW_ATE_float, 8};
+      return true;
+    case 0x30:
+      *type = {DW_ATE_float, 4};
+      return true;
+    case 0x40:
+      *type = {DW_ATE_unsigned, 16};
+      return true;
+    case 0x50:
+      *type = {DW_ATE_unsigned, 8};
+      return true;
+    default:
+      return false;
+  }
+}
+
+TEST(DwarfExpressionDecodeTest, typed) {
+  Context ctx = {};
+  ctx.registers = [](int reg_num, uint64_t* value) {
+    *value = 0x3fc00000;  // 1.5f
+    return reg_num == 1;
+  };
+  DwarfExpression expr;
+
+  // (double)(int32_t)-1
+  const uint8_t convert[] = {DW_OP_const_type, 0x10, 4, 0xff, 0xff, 0xff, 0xff,
+                             DW_OP_convert, 0x20, DW_OP_stack_value};
+  ASSERT_TRUE(
+      DwarfExpression::decode(convert, sizeof(convert), 8, 4, 5, &expr));
+  Result ret = expr.evaluate(ctx, 0);
+  ASSERT_EQ(ErrorCode::kTypeInvalid, ret.error_code);
+  ctx.baseType = TestBaseType;
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  double real = 0;
+  memcpy(&real, &ret.value, sizeof(real));
+  ASSERT_EQ(-1.0, real);
+
+  // (int32_t)(float)reg1, the type stays with the value through DW_OP_swap.
+  const uint8_t regval[] = {DW_OP_GNU_regval_type, 0x01, 0x30, DW_OP_lit0,
+                            DW_OP_swap, DW_OP_GNU_convert, 0x10,
+                            DW_OP_stack_value};
+  ASSERT_TRUE(DwarfExpression::decode(regval, sizeof(regval), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(1U, ret.value);
+
+  // A 16-byte constant.
+  uint8_t wide[20] = {DW_OP_const_type, 0x40, 16};
+  wide[3] = 0x11;   // the low 64 bits
+  wide[11] = 0x22;  // the high 64 bits
+  wide[19] = DW_OP_stack_value;
+  ASSERT_TRUE(DwarfExpression::decode(wide, sizeof(wide), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(0x11U, ret.value);
+  ASSERT_EQ(0x22U, ret.value_high);
+
+  // The operands of a binary op have the same type.
+  uint8_t float_plus[13] = {DW_OP_const_type, 0x20, 8};
+  float_plus[10] = 0x3f;  // 1/256.0
+  float_plus[11] = DW_OP_lit1;
+  float_plus[12] = DW_OP_plus;
+  ASSERT_TRUE(
+      DwarfExpression::decode(float_plus, sizeof(float_plus), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_EQ(ErrorCode::kTypeInvalid, ret.error_code);
+  ASSERT_EQ(12U, ret.error_addr);
+
+  // The arithmetic of the floats and of the 16-byte integers.
+  float_plus[11] = DW_OP_dup;
+  ASSERT_TRUE(
+      DwarfExpression::decode(float_plus, sizeof(float_plus), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_EQ(ErrorCode::kNotImplemented, ret.error_code);
+  ASSERT_EQ(12U, ret.error_addr);
+
+  uint8_t wide_lt[21] = {};
+  memcpy(wide_lt, wide, 19);
+  wide_lt[19] = DW_OP_dup;
+  wide_lt[20] = DW_OP_lt;
+  ASSERT_TRUE(
+      DwarfExpression::decode(wide_lt, sizeof(wide_lt), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_EQ(ErrorCode::kNotImplemented, ret.error_code);
+  ASSERT_EQ(20U, ret.error_addr);
+
+  // The sizes of the block and of the type differ.
+  const uint8_t mismatch[] = {DW_OP_const_type, 0x10, 1, 0xff,
+                              DW_OP_stack_value};
+  ASSERT_TRUE(
+      DwarfExpression::decode(mismatch, sizeof(mismatch), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_EQ(ErrorCode::kIllegalOpd, ret.error_code);
+}
+
+TEST(DwarfExpressionDecodeTest, typed_unsigned) {
+  Context ctx = {};
+  ctx.baseType = TestBaseType;
+  DwarfExpression expr;
+
+  // 2^63 and 3 of an unsigned 64-bit type, then the op.
+  uint8_t ops[24] = {DW_OP_const_type, 0x50, 8};
+  ops[10] = 0x80;
+  ops[11] = DW_OP_const_type;
+  ops[12] = 0x50;
+  ops[13] = 8;
+  ops[14] = 3;
+  ops[22] = DW_OP_div;
+  ops[23] = DW_OP_stack_value;
+  ASSERT_TRUE(DwarfExpression::decode(ops, sizeof(ops), 8, 4, 5, &expr));
+  Result ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(0x2aaaaaaaaaaaaaaaU, ret.value);
+
+  ops[22] = DW_OP_mod;
+  ASSERT_TRUE(DwarfExpression::decode(ops, sizeof(ops), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(2U, ret.value);
+
+  ops[22] = DW_OP_lt;
+  ASSERT_TRUE(DwarfExpression::decode(ops, sizeof(ops), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(0U, ret.value);
+
+  ops[22] = DW_OP_gt;
+  ASSERT_TRUE(DwarfExpression::decode(ops, sizeof(ops), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(1U, ret.value);
+
+  // The quotient keeps the unsigned type, it can not be added to a generic
+  // value, but the result of the comparison is generic.
+  uint8_t typed_plus[26] = {};
+  memcpy(typed_plus, ops, 22);
+  typed_plus[22] = DW_OP_div;
+  typed_plus[23] = DW_OP_lit1;
+  typed_plus[24] = DW_OP_plus;
+  typed_plus[25] = DW_OP_stack_value;
+  ASSERT_TRUE(
+      DwarfExpression::decode(typed_plus, sizeof(typed_plus), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_EQ(ErrorCode::kTypeInvalid, ret.error_code);
+  ASSERT_EQ(24U, ret.error_addr);
+
+  typed_plus[22] = DW_OP_lt;
+  ASSERT_TRUE(
+      DwarfExpression::decode(typed_plus, sizeof(typed_plus), 8, 4, 5, &expr));
+  ret = expr.evaluate(ctx, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(1U, ret.value);
+}
+
+TEST(DwarfExpressionDecodeTest, malformed) {
+  DwarfExpression expr;
+  const uint8_t truncated[] = {DW_OP_lit1, DW_OP_const4u, 1, 2};
+  ASSERT_FALSE(
+      DwarfExpression::decode(truncated, sizeof(truncated), 8, 4, 5, &expr));
+  ASSERT_EQ(0U, expr.count());
+
+  const uint8_t unterminated_uleb[] = {DW_OP_constu, 0x80};
+  ASSERT_FALSE(DwarfExpression::decode(
+      unterminated_uleb, sizeof(unterminated_uleb), 8, 4, 5, &expr));
+
+  const uint8_t unknown[] = {DW_OP_lit1, 0x00};
+  ASSERT_FALSE(
+      DwarfExpression::decode(unknown, sizeof(unknown), 8, 4, 5, &expr));
+}
+
 }  // namespace dwarfexpr
\ No newline at end of file
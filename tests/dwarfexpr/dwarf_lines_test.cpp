@@ -0,0 +1,134 @@
+#include "dwarfexpr/dwarf_lines.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "dwarfexpr/dwarf_line_index.h"
+
+namespace dwarfexpr {
+
+static DwarfLineRow Row(Dwarf_Addr addr, Dwarf_Unsigned line,
+                        bool is_stmt = true, Dwarf_Unsigned file = 0) {
+  return {addr, file, line, false, 0, is_stmt, 0};
+}
+
+static DwarfLineRow EndSequence(Dwarf_Addr addr) {
+  return {addr, 0, 0, true, 0, false, 0};
+}
+
+static uint32_t LineOf(const DwarfLineTable& table, Dwarf_Addr pc) {
+  DwarfLineEntry entry;
+  return table.find(pc, &entry) ? entry.line : 0;
+}
+
+TEST(DwarfLineTableTest, find_in_sequences) {
+  DwarfLineTable table;
+  // The sequences are not in address order in the table.
+  table.build({Row(0x200, 20), Row(0x210, 21), EndSequence(0x220),
+               Row(0x100, 10), Row(0x108, 11), EndSequence(0x110)},
+              {"a.c"});
+  ASSERT_EQ(2u, table.sequences().size());
+
+  EXPECT_EQ(0u, LineOf(table, 0xff));
+  EXPECT_EQ(10u, LineOf(table, 0x100));
+  EXPECT_EQ(10u, LineOf(table, 0x107));
+  EXPECT_EQ(11u, LineOf(table, 0x10f));
+  EXPECT_EQ(0u, LineOf(table, 0x110));  // gap between the sequences
+  EXPECT_EQ(20u, LineOf(table, 0x200));
+  EXPECT_EQ(21u, LineOf(table, 0x21f));
+  EXPECT_EQ(0u, LineOf(table, 0x220));
+
+  DwarfLineEntry entry;
+  ASSERT_TRUE(table.find(0x100, &entry));
+  EXPECT_EQ("a.c", DwarfFilePool::global()->path(entry.file, "?"));
+}
+
+TEST(DwarfLineTableTest, find_in_overlapped_sequences) {
+  DwarfLineTable table;
+  // Like the sequences of the functions discarded by the linker.
+  table.build({Row(0x0, 1), EndSequence(0x1000), Row(0x0, 2),
+               EndSequence(0x10), Row(0x20, 3), EndSequence(0x30)},
+              {"a.c"});
+
+  EXPECT_EQ(2u, LineOf(table, 0x8));
+  EXPECT_EQ(3u, LineOf(table, 0x28));
+  EXPECT_EQ(1u, LineOf(table, 0x30));
+  EXPECT_EQ(0u, LineOf(table, 0x1000));
+}
+
+TEST(DwarfLineTableTest, prefer_is_stmt_row) {
+  DwarfLineTable table;
+  table.build({Row(0x0, 1), Row(0x10, 2), Row(0x10, 3, false), Row(0x18, 4),
+               Row(0x18, 5, false), Row(0x18, 6, false), EndSequence(0x20)},
+              {"a.c"});
+
+  EXPECT_EQ(2u, LineOf(table, 0x10));
+  EXPECT_EQ(4u, LineOf(table, 0x1f));
+  EXPECT_EQ(1u, LineOf(table, 0xf));
+}
+
+TEST(DwarfLineTableTest, decode_blocks) {
+  // Enough rows for several blocks, with lines going back and forth, files,
+  // columns and discriminators.
+  std::vector<DwarfLineRow> rows;
+  for (Dwarf_Addr i = 0; i < 100; ++i) {
+    Dwarf_Unsigned line = i % 3 == 0 ? 1000 - i : i * 7;
+    rows.push_back({0x1000 + i * 4, i % 5 == 0 ? 1u : 0u, line, false, i % 7,
+                    true, i % 11 == 0 ? i : 0});
+  }
+  rows.push_back(EndSequence(0x1000 + 100 * 4));
+  DwarfLineTable table;
+  table.build(rows, {"a.c", "b.c"});
+
+  for (size_t i = 0; i < 100; ++i) {
+    DwarfLineEntry entry;
+    ASSERT_TRUE(table.find(rows[i].addr + 3, &entry));
+    EXPECT_EQ(rows[i].addr, entry.addr);
+    EXPECT_EQ(rows[i].line, entry.line);
+    EXPECT_EQ(table.files()[rows[i].file], entry.file);
+    EXPECT_EQ(rows[i].column, entry.column);
+    EXPECT_EQ(rows[i].discriminator, entry.discriminator);
+  }
+}
+
+TEST(DwarfLineIndexTest, find_line_ranges) {
+  DwarfLineTable table1;
+  table1.build({Row(0x100, 10), Row(0x108, 11), Row(0x110, 10),
+                Row(0x118, 12, true, 1), EndSequence(0x120)},
+               {"/src/a.c", "/src/include/b.h"});
+  DwarfLineTable table2;
+  table2.build({Row(0x200, 10), Row(0x204, 10), EndSequence(0x20c)},
+               {"/src/a.c"});
+
+  DwarfLineIndex index1;
+  index1.addTable(table1);
+  DwarfLineIndex index2;
+  index2.addTable(table2);
+  DwarfLineIndex index;
+  index.merge(&index1);
+  index.merge(&index2);
+  index.finalize();
+
+  std::vector<DwarfFileId> files = index.findFiles("a.c");
+  ASSERT_EQ(1u, files.size());
+  EXPECT_EQ(files, index.findFiles("/src/a.c"));
+  EXPECT_TRUE(index.findFiles("c").empty());
+  EXPECT_EQ(1u, index.findFiles("include/b.h").size());
+
+  std::vector<DwarfLineAddrRange> ranges;
+  ASSERT_TRUE(index.find(files[0], 10, &ranges));
+  ASSERT_EQ(3u, ranges.size());  // the ranges of 0x200 are joined
+  EXPECT_EQ(0x100u, ranges[0].low);
+  EXPECT_EQ(0x108u, ranges[0].high);
+  EXPECT_EQ(0x110u, ranges[1].low);
+  EXPECT_EQ(0x118u, ranges[1].high);
+  EXPECT_EQ(0x200u, ranges[2].low);
+  EXPECT_EQ(0x20cu, ranges[2].high);
+
+  EXPECT_FALSE(index.find(files[0], 12, &ranges));
+  EXPECT_FALSE(index.find(files[0], 13, &ranges));
+}
+
+}  // namespace dwarfexpr
@@ -0,0 +1,140 @@
+#include "dwarfexpr/dwarf_location.h"
+
+#include <gtest/gtest.h>
+
+#include <initializer_list>
+#include <utility>  // std::move
+
+#include "dwarfexpr/dwarf_expression_eval.h"
+
+namespace dwarfexpr {
+
+using Result = DwarfExpression::Result;
+using ErrorCode = DwarfExpression::ErrorCode;
+using Context = DwarfExpression::Context;
+using Kind = DwarfLocation::SimpleLocation::Kind;
+
+// A location of the given expressions, without a DIE.
+class TestLocation : public DwarfLocation {
+ public:
+  TestLocation() : DwarfLocation(nullptr, nullptr, 8, 4, 5) {}
+
+  void add(std::initializer_list<DwarfOp> ops) {
+    LocationExpression loc_expr = {};
+    loc_expr.expr.setOps(ops);
+    loc_expr.expr.compile();
+    addExpression(std::move(loc_expr));
+  }
+
+  Kind kind() const { return exprs_.back().simple.kind; }
+  // The result of the interpreter.
+  Result evaluate(const Context& context) const {
+    return exprs_.back().expr.evaluate(context, 0);
+  }
+};
+
+static bool Registers(int reg_num, uint64_t* value) {
+  if (reg_num >= 32) {
+    return false;
+  }
+  *value = 0x1000 + reg_num;
+  return true;
+}
+
+static void ExpectSameResult(const TestLocation& loc, const Context& ctx) {
+  Result expected = loc.evaluate(ctx);
+  Result ret = loc.evalValue(ctx, 0);
+  EXPECT_EQ(expected.type, ret.type);
+  EXPECT_EQ(expected.value, ret.value);
+  EXPECT_EQ(expected.error_code, ret.error_code);
+  EXPECT_EQ(expected.error_addr, ret.error_addr);
+}
+
+TEST(DwarfLocationTest, simple_locations) {
+  TestLocation frame_base;
+  frame_base.add({{DW_OP_breg31, 0x20, 0, 0, 0}});
+  Context ctx = {};
+  ctx.frameBaseLoc = &frame_base;
+  ctx.registers = Registers;
+
+  TestLocation breg;
+  breg.add({{DW_OP_breg29, static_cast<Dwarf_Unsigned>(-16), 0, 0, 0}});
+  ASSERT_EQ(Kind::kBreg, breg.kind());
+  ExpectSameResult(breg, ctx);
+  ASSERT_EQ(0x1000U + 29 - 16, breg.evalValue(ctx, 0).value);
+
+  TestLocation bregx;
+  bregx.add({{DW_OP_bregx, 40, 8, 0, 0}});
+  ASSERT_EQ(Kind::kBreg, bregx.kind());
+  ExpectSameResult(bregx, ctx);  // the register is invalid
+
+  TestLocation fbreg;
+  fbreg.add({{DW_OP_fbreg, 8, 0, 0, 0}});
+  ASSERT_EQ(Kind::kFbreg, fbreg.kind());
+  ExpectSameResult(fbreg, ctx);
+  ASSERT_EQ(0x1000U + 31 + 0x20 + 8, fbreg.evalValue(ctx, 0).value);
+
+  TestLocation reg;
+  reg.add({{DW_OP_reg3, 0, 0, 0, 0}});
+  ASSERT_EQ(Kind::kReg, reg.kind());
+  ExpectSameResult(reg, ctx);
+  ASSERT_EQ(Result::Type::kValue, reg.evalValue(ctx, 0).type);
+
+  TestLocation addr;
+  addr.add({{DW_OP_addr, 0x4000, 0, 0, 0}});
+  ASSERT_EQ(Kind::kAddr, addr.kind());
+  ExpectSameResult(addr, ctx);
+
+  // Falls back to the interpreter.
+  TestLocation deref;
+  deref.add({{DW_OP_breg29, 0, 0, 0, 0}, {DW_OP_deref, 0, 0, 0, 2}});
+  ASSERT_EQ(Kind::kNone, deref.kind());
+  ExpectSameResult(deref, ctx);
+
+  // No frame base.
+  ctx.frameBaseLoc = nullptr;
+  ExpectSameResult(fbreg, ctx);
+}
+
+TEST(DwarfLocationTest, fbreg_concrete_providers) {
+  // Only the frame base is in the context, the providers are given apart.
+  auto regs = [](uint32_t reg_num, uint64_t* value) {
+    return Registers(static_cast<int>(reg_num), value);
+  };
+  auto memory = [](uint64_t, size_t, char**, size_t*) { return false; };
+  auto cfa = [](Dwarf_Addr) -> Dwarf_Addr { return 0x8000; };
+
+  TestLocation breg_base;
+  breg_base.add({{DW_OP_breg31, 0x20, 0, 0, 0}});
+  TestLocation cfa_base;
+  cfa_base.add({{DW_OP_call_frame_cfa, 0, 0, 0, 0}});
+  Context ctx = {};
+
+  // A single op, and the interpreter.
+  TestLocation fbreg;
+  fbreg.add({{DW_OP_fbreg, 8, 0, 0, 0}});
+  TestLocation fbreg_value;
+  fbreg_value.add({{DW_OP_fbreg, 8, 0, 0, 0}, {DW_OP_stack_value, 0, 0, 0, 2}});
+
+  ctx.frameBaseLoc = &breg_base;
+  Result ret = fbreg.evalValue(ctx, regs, memory, cfa, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(0x1000U + 31 + 0x20 + 8, ret.value);
+  ret = fbreg_value.evalValue(ctx, regs, memory, cfa, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(0x1000U + 31 + 0x20 + 8, ret.value);
+
+  ctx.frameBaseLoc = &cfa_base;
+  ret = fbreg.evalValue(ctx, regs, memory, cfa, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(0x8008U, ret.value);
+  ret = fbreg_value.evalValue(ctx, regs, memory, cfa, 0);
+  ASSERT_TRUE(ret.valid());
+  ASSERT_EQ(0x8008U, ret.value);
+
+  // The providers of the empty context are missing.
+  ret = fbreg_value.evalValue(ctx, 0);
+  ASSERT_EQ(ErrorCode::kFrameBaseInvalid, ret.error_code);
+}
+
+}  // namespace dwarfexpr
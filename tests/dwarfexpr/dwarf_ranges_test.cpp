@@ -0,0 +1,59 @@
+#include "dwarfexpr/dwarf_ranges.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace dwarfexpr {
+
+static DwarfFuncRange Func(Dwarf_Addr low, Dwarf_Addr high,
+                           Dwarf_Off die_offset, int depth) {
+  return {low, high, die_offset, depth, 0, 0};
+}
+
+// The DIE offsets of the chain of the pc, from the outermost.
+static std::vector<Dwarf_Off> ChainOf(const DwarfFuncTable& table,
+                                      Dwarf_Addr pc) {
+  std::vector<Dwarf_Off> chain;
+  for (const DwarfFuncRange* func = table.findInnermost(pc); func != nullptr;
+       func = table.parent(func)) {
+    chain.insert(chain.begin(), func->die_offset);
+  }
+  return chain;
+}
+
+TEST(DwarfFuncTableTest, inline_chain) {
+  DwarfFuncTable table;
+  table.add(Func(0x100, 0x200, 0x10, 0));  // f
+  table.add(Func(0x120, 0x180, 0x20, 1));  // g inlined in f
+  table.add(Func(0x130, 0x140, 0x30, 2));  // h inlined in g
+  table.add(Func(0x190, 0x1a0, 0x40, 1));  // h inlined in f
+  table.finalize();
+
+  EXPECT_EQ(std::vector<Dwarf_Off>(), ChainOf(table, 0xff));
+  EXPECT_EQ(std::vector<Dwarf_Off>({0x10}), ChainOf(table, 0x100));
+  EXPECT_EQ(std::vector<Dwarf_Off>({0x10, 0x20}), ChainOf(table, 0x12f));
+  EXPECT_EQ(std::vector<Dwarf_Off>({0x10, 0x20, 0x30}),
+            ChainOf(table, 0x130));
+  EXPECT_EQ(std::vector<Dwarf_Off>({0x10, 0x20}), ChainOf(table, 0x140));
+  EXPECT_EQ(std::vector<Dwarf_Off>({0x10}), ChainOf(table, 0x180));
+  EXPECT_EQ(std::vector<Dwarf_Off>({0x10, 0x40}), ChainOf(table, 0x19f));
+  EXPECT_EQ(std::vector<Dwarf_Off>(), ChainOf(table, 0x200));
+  EXPECT_EQ(0x10u, table.findOutermost(0x135)->die_offset);
+}
+
+TEST(DwarfFuncTableTest, nested_subprogram) {
+  DwarfFuncTable table;
+  table.add(Func(0x100, 0x200, 0x10, 0));  // f
+  table.add(Func(0x300, 0x340, 0x20, 1));  // n nested in f, out of its code
+  table.add(Func(0x310, 0x320, 0x30, 2));  // g inlined in n
+  table.finalize();
+
+  EXPECT_EQ(std::vector<Dwarf_Off>({0x20}), ChainOf(table, 0x300));
+  EXPECT_EQ(std::vector<Dwarf_Off>({0x20, 0x30}), ChainOf(table, 0x310));
+  EXPECT_EQ(0x20u, table.findOutermost(0x318)->die_offset);
+  EXPECT_EQ(0x10u, table.findOutermost(0x100)->die_offset);
+  EXPECT_EQ(nullptr, table.findOutermost(0x200));
+}
+
+}  // namespace dwarfexpr
@@ -0,0 +1,144 @@
+#include "dwarfexpr/dwarf_searcher.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace dwarfexpr {
+
+using Result = DwarfExpression::Result;
+using Context = DwarfExpression::Context;
+
+// A DWARF 5 CU of a 12-byte header:
+//   0x0c DW_TAG_compile_unit "t.c"
+//   0x11   DW_TAG_base_type "int", DW_ATE_signed, 4 bytes
+//   0x18   DW_TAG_base_type "double", DW_ATE_float, 8 bytes
+static const uint8_t kDebugAbbrev[] = {
+    0x01, 0x11, 0x01, 0x03, 0x08, 0x00, 0x00,                    // CU
+    0x02, 0x24, 0x00, 0x03, 0x08, 0x3e, 0x0b, 0x0b, 0x0b, 0x00,  // base
+    0x00, 0x00};
+static const uint8_t kDebugInfo[] = {
+    0x1f, 0x00, 0x00, 0x00,  // unit_length
+    0x05, 0x00,              // version
+    0x01,                    // DW_UT_compile
+    0x08,                    // address_size
+    0x00, 0x00, 0x00, 0x00,  // debug_abbrev_offset
+    0x01, 't', '.', 'c', 0x00,
+    0x02, 'i', 'n', 't', 0x00, 0x05, 0x04,
+    0x02, 'd', 'o', 'u', 'b', 'l', 'e', 0x00, 0x04, 0x08,
+    0x00};
+static const char kShstrtab[] = "\0.debug_abbrev\0.debug_info\0.shstrtab";
+
+// A relocatable ELF64 of the sections above.
+static std::vector<uint8_t> BuildElf() {
+  struct Section {
+    uint32_t name;
+    const void* data;
+    uint64_t size;
+  };
+  const Section sections[] = {
+      {1, kDebugAbbrev, sizeof(kDebugAbbrev)},
+      {15, kDebugInfo, sizeof(kDebugInfo)},
+      {27, kShstrtab, sizeof(kShstrtab)},
+  };
+  constexpr size_t kEhdrSize = 64;
+  constexpr size_t kShdrSize = 64;
+  constexpr uint16_t kShnum = 4;
+
+  std::vector<uint8_t> elf(kEhdrSize);
+  auto put = [&elf](size_t off, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      elf[off + i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+  };
+  const uint8_t ident[] = {0x7f, 'E', 'L', 'F', 2 /* ELFCLASS64 */,
+                           1 /* ELFDATA2LSB */, 1 /* EV_CURRENT */};
+  memcpy(elf.data(), ident, sizeof(ident));
+  put(16, 1, 2);           // e_type, ET_REL
+  put(18, 62, 2);          // e_machine, EM_X86_64
+  put(20, 1, 4);           // e_version
+  put(52, kEhdrSize, 2);   // e_ehsize
+  put(58, kShdrSize, 2);   // e_shentsize
+  put(60, kShnum, 2);      // e_shnum
+  put(62, kShnum - 1, 2);  // e_shstrndx
+
+  std::vector<uint64_t> offsets;
+  for (const Section& section : sections) {
+    offsets.push_back(elf.size());
+    const uint8_t* data = static_cast<const uint8_t*>(section.data);
+    elf.insert(elf.end(), data, data + section.size);
+  }
+  while (elf.size() % 8 != 0) {
+    elf.push_back(0);
+  }
+  put(40, elf.size(), 8);  // e_shoff
+
+  elf.resize(elf.size() + kShdrSize);  // the null section
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    size_t shdr = elf.size();
+    elf.resize(shdr + kShdrSize);
+    put(shdr, sections[i].name, 4);       // sh_name
+    put(shdr + 4, i == 2 ? 3 : 1, 4);     // sh_type, SHT_STRTAB/PROGBITS
+    put(shdr + 24, offsets[i], 8);        // sh_offset
+    put(shdr + 32, sections[i].size, 8);  // sh_size
+    put(shdr + 48, 1, 8);                 // sh_addralign
+  }
+  return elf;
+}
+
+TEST(DwarfSearcherTest, base_type) {
+  char path[] = "/tmp/dwarf_searcher_test_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  FILE* file = fdopen(fd, "wb");
+  ASSERT_NE(nullptr, file);
+  std::vector<uint8_t> elf = BuildElf();
+  ASSERT_EQ(elf.size(), fwrite(elf.data(), 1, elf.size(), file));
+  fclose(file);
+
+  Dwarf_Debug dbg = nullptr;
+  Dwarf_Error error = nullptr;
+  int res = dwarf_init_path(path, nullptr, 0, DW_GROUPNUMBER_ANY, nullptr,
+                            nullptr, &dbg, &error);
+  remove(path);
+  ASSERT_EQ(DW_DLV_OK, res);
+
+  {
+    DwarfSearcher searcher(dbg);
+    std::vector<Dwarf_Off> cus;
+    ASSERT_TRUE(searcher.listCUs(&cus, nullptr));
+    ASSERT_EQ(1U, cus.size());
+    ASSERT_EQ(0x0cU, cus[0]);
+
+    // The operands are relative to the CU header, not to the CU DIE.
+    DwarfBaseType type = {};
+    ASSERT_TRUE(searcher.getBaseType(cus[0], 0x11, &type, nullptr));
+    ASSERT_EQ(DW_ATE_signed, type.encoding);
+    ASSERT_EQ(4, type.size);
+    ASSERT_FALSE(searcher.getBaseType(cus[0], 0x0c, &type, nullptr));
+
+    // (double)(int32_t)-1
+    Context ctx = {};
+    ctx.baseType = [&](Dwarf_Off offset, DwarfBaseType* out_type) {
+      return searcher.getBaseType(cus[0], offset, out_type, nullptr);
+    };
+    const uint8_t convert[] = {DW_OP_const_type, 0x11, 4, 0xff, 0xff, 0xff,
+                               0xff, DW_OP_convert, 0x18, DW_OP_stack_value};
+    DwarfExpression expr;
+    ASSERT_TRUE(
+        DwarfExpression::decode(convert, sizeof(convert), 8, 4, 5, &expr));
+    Result ret = expr.evaluate(ctx, 0);
+    ASSERT_TRUE(ret.valid());
+    double real = 0;
+    memcpy(&real, &ret.value, sizeof(real));
+    ASSERT_EQ(-1.0, real);
+  }
+
+  dwarf_finish(dbg);
+}
+
+}  // namespace dwarfexpr